@@ -156,6 +156,23 @@ color_t TFT_readPixel(int16_t x, int16_t y) {
   return readPixel(x, y);
 }
 
+//=================================================================
+int TFT_readRect(int x, int y, int w, int h, color_t *dst) {
+	int x1 = x + tft_dispWin.x1, y1 = y + tft_dispWin.y1;
+	int x2 = x1 + w - 1, y2 = y1 + h - 1;
+
+	// clipping, only the part inside the display window is read
+	if (x1 < tft_dispWin.x1) x1 = tft_dispWin.x1;
+	if (y1 < tft_dispWin.y1) y1 = tft_dispWin.y1;
+	if (x2 > tft_dispWin.x2) x2 = tft_dispWin.x2;
+	if (y2 > tft_dispWin.y2) y2 = tft_dispWin.y2;
+	if ((x2 < x1) || (y2 < y1)) return 0;
+
+	color_t *buf = dst + ((y1 - y - tft_dispWin.y1) * w) + (x1 - x - tft_dispWin.x1);
+	if (read_rect(x1, y1, x2, y2, buf, w) != ESP_OK) return -1;
+	return (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
 //--------------------------------------------------------------------------
 static void _drawFastVLine(int16_t x, int16_t y, int16_t h, color_t color) {
 	// clipping
@@ -671,6 +688,8 @@ void TFT_drawEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 	stopx *= rx;
 	stopy = 0;
 
+	// keep the display selected, so pixels of all sections are coalesced
+	disp_select();
 	while( stopx >= stopy ) {
 		_draw_ellipse_section(x, y, x0, y0, color, option);
 		y++;
@@ -717,6 +736,7 @@ void TFT_drawEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 			ychg += rxrx2;
 		}
 	}
+	disp_deselect();
 }
 
 //-----------------------------------------------------------------------------------------------------------------------
@@ -1266,7 +1286,7 @@ int compile_font_file(char *fontfile, uint8_t dbg)
 
 	if (bptr > 0) {
 		size += bptr;
-        if (fwrite(outfile, 1, bptr, ffd_out) != bptr) goto error;
+        if (fwrite(outfile, 1, bptr, ffd_out) != (size_t)bptr) goto error;
 	}
 
 	// write font ID
@@ -1548,11 +1568,15 @@ static int printProportionalChar(int x, int y) {
 
 		// === buffer Glyph data for faster sending ===
 		len = char_width * tft_cfont.y_size;
-		color_t *color_line = heap_caps_malloc(len*3, MALLOC_CAP_DMA);
+		uint8_t *color_line = heap_caps_malloc(len*TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
 		if (color_line) {
+			// colors in the display pixel format
+			uint8_t fg_pix[TFT_PIXEL_BYTES], bg_pix[TFT_PIXEL_BYTES];
+			TFT_pixel_store(fg_pix, tft_fg);
+			TFT_pixel_store(bg_pix, tft_bg);
 			// fill with background color
 			for (int n = 0; n < len; n++) {
-				color_line[n] = tft_bg;
+				memcpy(color_line + (n*TFT_PIXEL_BYTES), bg_pix, TFT_PIXEL_BYTES);
 			}
 			// set character pixels to foreground color
 			uint8_t mask = 0x80;
@@ -1565,7 +1589,7 @@ static int printProportionalChar(int x, int y) {
 					if ((ch & mask) != 0) {
 						// visible pixel
 						bufPos = ((j + fontChar.adjYOffset) * char_width) + (fontChar.xOffset + i);  // bufY + bufX
-						color_line[bufPos] = tft_fg;
+						memcpy(color_line + (bufPos*TFT_PIXEL_BYTES), fg_pix, TFT_PIXEL_BYTES);
 						/*
 						bufY = (j + fontChar.adjYOffset) * char_width;
 						bufX = fontChar.xOffset + i;
@@ -1583,7 +1607,7 @@ static int printProportionalChar(int x, int y) {
 			}
 			// send to display in one transaction
 			disp_select();
-			send_data(x, y, x+char_width-1, y+tft_cfont.y_size-1, len, color_line);
+			send_pixels(x, y, x+char_width-1, y+tft_cfont.y_size-1, len, color_line);
 			disp_deselect();
 			free(color_line);
 
@@ -1634,24 +1658,28 @@ static void printChar(uint8_t c, int x, int y) {
 	if ((tft_font_buffered_char) && (!tft_font_transparent)) {
 		// === buffer Glyph data for faster sending ===
 		len = tft_cfont.x_size * tft_cfont.y_size;
-		color_t *color_line = heap_caps_malloc(len*3, MALLOC_CAP_DMA);
+		uint8_t *color_line = heap_caps_malloc(len*TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
 		if (color_line) {
+			// colors in the display pixel format
+			uint8_t fg_pix[TFT_PIXEL_BYTES], bg_pix[TFT_PIXEL_BYTES];
+			TFT_pixel_store(fg_pix, tft_fg);
+			TFT_pixel_store(bg_pix, tft_bg);
 			// set character pixels
 			for (j=0; j<tft_cfont.y_size; j++) {
 				for (k=0; k < fz; k++) {
 					ch = tft_cfont.font[temp+k];
 					mask=0x80;
-					for (i=0; i<8; i++) {
-						color_t pix_color = tft_bg;
-						if ((ch & mask) !=0) pix_color = tft_fg;
-						color_line[(j*tft_cfont.x_size) + (i+(k*8))] = pix_color;
+					// the last byte of a row may have padding bits
+					for (i=0; (i<8) && ((i+(k*8)) < tft_cfont.x_size); i++) {
+						uint8_t *pix = ((ch & mask) !=0) ? fg_pix : bg_pix;
+						memcpy(color_line + (((j*tft_cfont.x_size) + (i+(k*8))) * TFT_PIXEL_BYTES), pix, TFT_PIXEL_BYTES);
 						mask >>= 1;
 					}
 				}
 				temp += (fz);
 			}
 			// send to display in one transaction
-			send_data(x, y, x+tft_cfont.x_size-1, y+tft_cfont.y_size-1, len, color_line);
+			send_pixels(x, y, x+tft_cfont.x_size-1, y+tft_cfont.y_size-1, len, color_line);
 			free(color_line);
 
 			return;
@@ -1915,6 +1943,25 @@ static void _draw7seg(int16_t x, int16_t y, int8_t num, int16_t w, int16_t l, co
 }
 //==============================================================================
 
+// The text line at tft_y does not fit into the clip window. If the clip window covers
+// the rows of the scroll area, the area is scrolled up and the new line is cleared.
+// Returns 1 if the line can be printed
+//-------------------------------------
+static int _text_scroll(int height) {
+	int n = tft_y + height - 1 - tft_dispWin.y2;
+
+	if ((!tft_scroll.active) || (tft_scroll.cols) || (tft_font_rotate != 0)) return 0;
+	if ((tft_dispWin.y1 != tft_scroll.first) || (tft_dispWin.y2 != tft_scroll.last)) return 0;
+	if (height > tft_scroll.lines) return 0;
+	if (n <= 0) return 1;
+
+	disp_scroll_set(tft_scroll.first, tft_scroll.last, tft_scroll.offset + n);
+	tft_y -= n;
+	// the new line shows what was at the top of the area
+	_fillRect(tft_dispWin.x1, tft_y, tft_dispWin.x2 - tft_dispWin.x1 + 1, tft_dispWin.y2 - tft_y + 1, tft_bg);
+	return 1;
+}
+
 //======================================
 void TFT_print(char *st, int x, int y) {
 	int stl, i, tmpw, tmph, fh;
@@ -1983,7 +2030,7 @@ void TFT_print(char *st, int x, int y) {
 		else if (ch == 0x0A) { // ==== '\n', new line ====
 			if (tft_cfont.bitmap == 1) {
 				tft_y += tmph + tft_font_line_space;
-				if (tft_y > (tft_dispWin.y2-tmph)) break;
+				if ((tft_y > (tft_dispWin.y2-tmph)) && (!_text_scroll(tmph))) break;
 				tft_x = tft_dispWin.x1;
 			}
 		}
@@ -1999,7 +2046,7 @@ void TFT_print(char *st, int x, int y) {
 			if ((tft_x+tmpw) > (tft_dispWin.x2)) {
 				if (tft_text_wrap == 0) break;
 				tft_y += tmph + tft_font_line_space;
-				if (tft_y > (tft_dispWin.y2-tmph)) break;
+				if ((tft_y > (tft_dispWin.y2-tmph)) && (!_text_scroll(tmph))) break;
 				tft_x = tft_dispWin.x1;
 			}
 
@@ -2040,6 +2087,8 @@ void TFT_print(char *st, int x, int y) {
 // Input: m new rotation value (0 to 3)
 //=================================
 void TFT_setRotation(uint8_t rot) {
+	// a buffering backend sends what was drawn in the old orientation
+	TFT_flush();
 	tft_orientation = rot;
 	_tft_setRotation(rot);
 
@@ -2068,6 +2117,30 @@ void TFT_setGammaCurve(uint8_t gm) {
 	disp_spi_transfer_cmd_data(TFT_CMD_GAMMASET, &gamma_curve, 1);
 }
 
+//==========================================
+void TFT_setScrollArea(int top, int bottom) {
+	int size = (tft_scroll.cols) ? tft_width : tft_height;
+	int offset = (tft_scroll.cols) ? TFT_STATIC_X_OFFSET : TFT_STATIC_Y_OFFSET;
+
+	if ((top > bottom) || (top < 0) || (bottom >= size)) disp_scroll_set(0, -1, 0);
+	else disp_scroll_set(top + offset, bottom + offset, 0);
+}
+
+//=============================
+void TFT_scrollTo(int line) {
+	if (!tft_scroll.active) return;
+	disp_scroll_set(tft_scroll.first, tft_scroll.last, line);
+}
+
+//================================================
+esp_err_t TFT_setPartialArea(int top, int bottom) {
+	int size = (tft_scroll.cols) ? tft_width : tft_height;
+	int offset = (tft_scroll.cols) ? TFT_STATIC_X_OFFSET : TFT_STATIC_Y_OFFSET;
+
+	if ((top > bottom) || (top < 0) || (bottom >= size)) return ESP_ERR_INVALID_ARG;
+	return disp_partial_set(top + offset, bottom + offset);
+}
+
 //===========================================================
 color_t HSBtoRGB(float _hue, float _sat, float _brightness) {
  float red = 0.0;
@@ -2232,7 +2305,8 @@ typedef struct {
     uint8_t		*membuff;		// memory buffer containing the image
     uint32_t	bufsize;		// size of the memory buffer
     uint32_t	bufptr;			// memory buffer current position
-    color_t		*linbuf[2];		// memory buffer used for display output
+    uint8_t		*linbuf[2];		// memory buffer used for display output, display pixel format
+    TFT_fence_t	linbuf_fence[2];	// the buffer can be reused when its fence is done
     uint8_t		linbuf_idx;
 } JPGIODEV;
 
@@ -2326,20 +2400,21 @@ static UINT tjd_output (
 
 
 	if ((len > 0) && (len <= JPG_IMAGE_LINE_BUF_SIZE)) {
-		uint8_t *dest = (uint8_t *)(dev->linbuf[dev->linbuf_idx]);
+		// wait until the buffer is sent, the other one may still be on the wire
+		TFT_wait(dev->linbuf_fence[dev->linbuf_idx]);
+		uint8_t *dest = dev->linbuf[dev->linbuf_idx];
 
 		for (y = top; y <= bottom; y++) {
 			for (x = left; x <= right; x++) {
 				// Clip to display area
 				if ((x >= dleft) && (y >= dtop) && (x <= dright) && (y <= dbottom)) {
-					*dest++ = (*src++) & 0xFC;
-					*dest++ = (*src++) & 0xFC;
-					*dest++ = (*src++) & 0xFC;
+					TFT_pixel_store(dest, (color_t){src[0] & 0xFC, src[1] & 0xFC, src[2] & 0xFC});
+					dest += TFT_PIXEL_BYTES;
 				}
-				else src += 3; // skip
+				src += 3;
 			}
 		}
-		send_data(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx]);
+		dev->linbuf_fence[dev->linbuf_idx] = send_pixels_start(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx]);
 		dev->linbuf_idx = ((dev->linbuf_idx + 1) & 1);
 	}
 	else {
@@ -2364,6 +2439,8 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 
 	dev.linbuf[0] = NULL;
 	dev.linbuf[1] = NULL;
+	dev.linbuf_fence[0] = TFT_fence();
+	dev.linbuf_fence[1] = TFT_fence();
     dev.linbuf_idx = 0;
 
    	dev.fhndl = NULL;
@@ -2412,12 +2489,12 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 			dev.x = x;
 			dev.y = y;
 
-			dev.linbuf[0] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*3, MALLOC_CAP_DMA);
+			dev.linbuf[0] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
 			if (dev.linbuf[0] == NULL) {
 				if (tft_image_debug) printf("Error allocating line buffer #0\r\n");
 				goto exit;
 			}
-			dev.linbuf[1] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*3, MALLOC_CAP_DMA);
+			dev.linbuf[1] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
 			if (dev.linbuf[1] == NULL) {
 				if (tft_image_debug) printf("Error allocating line buffer #1\r\n");
 				goto exit;
@@ -2443,6 +2520,7 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 
 exit:
 	if (work) free(work);  // free work buffer
+	TFT_wait(TFT_fence());  // line buffers may still be in use
 	if (dev.linbuf[0]) free(dev.linbuf[0]);
 	if (dev.linbuf[1]) free(dev.linbuf[1]);
     if (dev.fhndl) fclose(dev.fhndl);  // close input file
@@ -2457,7 +2535,6 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	int i, err=0;
 	int img_xsize, img_ysize, img_xstart, img_xlen, img_ystart, img_ylen;
 	int img_pos, img_pix_pos, scan_lines, rd_len;
-	uint8_t tmpc;
 	uint16_t wtemp;
 	uint32_t temp;
 	int disp_xstart, disp_xend, disp_ystart, disp_yend;
@@ -2465,6 +2542,7 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	char err_buf[64];
 	uint8_t *line_buf[2] = {NULL,NULL};
 	uint8_t lb_idx = 0;
+	TFT_fence_t lb_fence[2] = {TFT_fence(), TFT_fence()};
 	uint8_t *scale_buf = NULL;
 	uint8_t scale_pix;
 	uint16_t co[3] = {0,0,0};			// RGB sum
@@ -2506,7 +2584,7 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	if ((buf[0] != 'B') || (buf[1] != 'M')) {err=-4; goto exit;} // accept only images with 'BM' id
 
 	memcpy(&temp, buf+2, 4);				// file size
-	if (temp != size) {err=-5; goto exit;}
+	if (temp != (uint32_t)size) {err=-5; goto exit;}
 
 	memcpy(&img_pos, buf+10, 4);			// start of pixel data
 
@@ -2546,8 +2624,8 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	// ** set display and image areas
 	if (x < tft_dispWin.x1) {
 		disp_xstart = tft_dispWin.x1;
-		img_xstart = -x;	// image pixel line X offset
-		img_xlen += x;
+		img_xstart = tft_dispWin.x1 - x;	// image pixel line X offset
+		img_xlen -= img_xstart;
 	}
 	else {
 		disp_xstart = x;
@@ -2555,8 +2633,8 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	}
 	if (y < tft_dispWin.y1) {
 		disp_ystart = tft_dispWin.y1;
-		img_ystart = -y;	// image pixel line Y offset
-		img_ylen += y;
+		img_ystart = tft_dispWin.y1 - y;	// image pixel line Y offset
+		img_ylen -= img_ystart;
 	}
 	else {
 		disp_ystart = y;
@@ -2644,6 +2722,8 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 			err = -16;
 			goto exit1;
 		}
+		// wait until the buffer is sent, the other one may still be on the wire
+		TFT_wait(lb_fence[lb_idx]);
 		if (scale == 0) {
 			// Read the line of color data into color buffer
 			if (fhndl) {
@@ -2657,12 +2737,10 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 			else memcpy(line_buf[lb_idx], imgbuf+img_pos, img_xsize*3);
 
 			if (img_xstart > 0)	memmove(line_buf[lb_idx], line_buf[lb_idx]+(img_xstart*3), rd_len);
-			// Convert colors BGR-888 (BMP) -> RGB-888 (DISPLAY) ===
+			// Convert colors BGR-888 (BMP) -> display pixel format, in place ===
 			for (i=0; i < rd_len; i += 3) {
-				tmpc = line_buf[lb_idx][i+2] & 0xfc;				// save R
-				line_buf[lb_idx][i+2] = line_buf[lb_idx][i] & 0xfc;	// B -> R
-				line_buf[lb_idx][i] = tmpc;							// R -> B
-				line_buf[lb_idx][i+1] &= 0xfc;						// G
+				uint8_t *bgr = line_buf[lb_idx] + i;
+				TFT_pixel_store(line_buf[lb_idx] + ((i / 3) * TFT_PIXEL_BYTES), (color_t){bgr[2] & 0xfc, bgr[1] & 0xfc, bgr[0] & 0xfc});
 			}
 			img_pos += (img_xsize*3);
 		}
@@ -2702,14 +2780,13 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 						npix++;
 					}
 				}
-				// Place the average in display buffer, convert BGR-888 (BMP) -> RGB-888 (DISPLAY)
-				line_buf[lb_idx][n+2] = (uint8_t)(co[0] / npix);	// B
-				line_buf[lb_idx][n+1] = (uint8_t)(co[1] / npix);	// G
-				line_buf[lb_idx][n] = (uint8_t)(co[2] / npix);		// R
+				// Place the average in display buffer, convert BGR-888 (BMP) -> display pixel format
+				TFT_pixel_store(line_buf[lb_idx] + ((n / 3) * TFT_PIXEL_BYTES),
+						(color_t){(uint8_t)(co[2] / npix), (uint8_t)(co[1] / npix), (uint8_t)(co[0] / npix)});
 			}
 		}
 
-		send_data(disp_xstart, disp_yend, disp_xend, disp_yend, img_xlen, (color_t *)line_buf[lb_idx]);
+		lb_fence[lb_idx] = send_pixels_start(disp_xstart, disp_yend, disp_xend, disp_yend, img_xlen, line_buf[lb_idx]);
 		lb_idx = (lb_idx + 1) & 1;  // change buffer
 
 		disp_yend--;
@@ -2718,6 +2795,7 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 exit1:
 	disp_deselect();
 exit:
+	TFT_wait(TFT_fence());  // line buffers may still be in use
 	if (scale_buf) free(scale_buf);
 	if (line_buf[0]) free(line_buf[0]);
 	if (line_buf[1]) free(line_buf[1]);
@@ -2731,6 +2809,19 @@ exit:
 // ============= Touch panel functions =========================================
 
 #if USE_TOUCH == TOUCH_TYPE_XPT2046
+// One 12-bit conversion, 'type' is the XPT2046 control byte
+//-----------------------------------------
+static int touch_get_data(uint8_t type)
+{
+	spi_transaction_t t = {
+		.length = 24,
+		.flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA,
+		.tx_data = {type, 0, 0},
+	};
+	if (spi_device_polling_transmit(tft_ts_spi, &t) != ESP_OK) return -1;
+	return ((t.rx_data[1] << 8) | t.rx_data[2]) >> 3;
+}
+
 //-------------------------------------------------------
 static int tp_get_data_xpt2046(uint8_t type, int samples)
 {
@@ -2749,6 +2840,8 @@ static int tp_get_data_xpt2046(uint8_t type, int samples)
 
     // read data
 	while (i < 10) {
+		// between sample sets the display may get the bus
+		if (tft_sched_yield_due(TFT_SCHED_TOUCH)) tft_sched_yield(TFT_SCHED_TOUCH);
     	minval = 5000;
     	maxval = 0;
 		// get values
@@ -2757,8 +2850,8 @@ static int tp_get_data_xpt2046(uint8_t type, int samples)
 			if (result < 0) break;
 
 			vbuf[n] = result;
-			if (result < minval) minval = result;
-			if (result > maxval) maxval = result;
+			if ((uint32_t)result < minval) minval = result;
+			if ((uint32_t)result > maxval) maxval = result;
 		}
 		if (result < 0) break;
 		dif = maxval - minval;
@@ -2796,7 +2889,7 @@ static int tp_get_data_xpt2046(uint8_t type, int samples)
 static int TFT_read_touch_xpt2046(int *x, int* y)
 {
 	int res = 0, result = -1;
-	if (spi_device_select(tft_ts_spi, 0) != ESP_OK) return 0;
+	if (tft_sched_acquire(TFT_SCHED_TOUCH) != ESP_OK) return 0;
 
     result = tp_get_data_xpt2046(0xB0, 3);  // Z; pressure; touch detect
 	if (result <= 50) goto exit;
@@ -2813,7 +2906,7 @@ static int TFT_read_touch_xpt2046(int *x, int* y)
 	*y = result;
 	res = 1;
 exit:
-	spi_device_deselect(tft_ts_spi);
+	tft_sched_release(TFT_SCHED_TOUCH);
 	return res;
 }
 #endif
@@ -2825,6 +2918,7 @@ int TFT_read_touch(int *x, int* y, uint8_t raw)
     *y = 0;
 	if (tft_ts_spi == NULL) return 0;
     #if USE_TOUCH == TOUCH_TYPE_NONE
+	(void)raw;
 	return 0;
     #else
 	int result = -1;
@@ -2839,7 +2933,9 @@ int TFT_read_touch(int *x, int* y, uint8_t raw)
     uint32_t tft_tp_calx = TP_CALX_STMPE610;
     uint32_t tft_tp_caly = TP_CALY_STMPE610;
     uint16_t Xx, Yy, Z=0;
+    if (tft_sched_acquire(TFT_SCHED_TOUCH) != ESP_OK) return 0;
     result = stmpe610_get_touch(&Xx, &Yy, &Z);
+    tft_sched_release(TFT_SCHED_TOUCH);
     if (result == 0) return 0;
     X = Xx;
     Y = Yy;
@@ -162,6 +162,25 @@ void TFT_drawPixel(int16_t x, int16_t y, color_t color);
 //------------------------------------------
 color_t TFT_readPixel(int16_t x, int16_t y);
 
+/*
+ * Read a rectangular area from display GRAM
+ * Large areas are read in DMA sized chunks directly into 'dst'.
+ * Needs the read device, see TFT_read_device_init()
+ * 
+ * Params:
+ *       x: horizontal position of the top left corner, relative to the display window
+ *       y: vertical position of the top left corner, relative to the display window
+ *       w: width
+ *       h: height
+ *     dst: buffer of w*h colors, row by row; pixels outside the display window are not changed
+ *          for reads without copying it should be DMA capable and word aligned
+ * 
+ * Returns:
+ *      number of pixels read, -1 on error
+*/
+//---------------------------------------------------------
+int TFT_readRect(int x, int y, int w, int h, color_t *dst);
+
 /*
  * Draw vertical line at given x,y coordinates
  * 
@@ -564,6 +583,51 @@ void TFT_invertDisplay(const uint8_t mode);
 //=================================
 void TFT_setGammaCurve(uint8_t gm);
 
+/*
+ * Set the hardware scroll area, see TFT_scrollTo()
+ * The controller scrolls along its gate lines: the rows of the screen in portrait orientations,
+ * the columns in landscape orientations (tft_scroll.cols is set, 'top' and 'bottom' are the first
+ * and the last column). The area is not scrolled after the call.
+ * Drawing coordinates are not changed by scrolling: the clip window, the text cursor and all drawing
+ * functions use the screen position, drawing inside the area goes to where it is shown.
+ * If the clip window covers exactly the rows of the area, TFT_print() scrolls the text up
+ * instead of stopping at the bottom of the clip window (text log).
+ * Turned off by TFT_setRotation() or with 'top' > 'bottom'. Ignored in partial mode (TFT_POWER_PARTIAL).
+ *
+ * Params:
+ * 		top:	first line of the scroll area, 0 ~ tft_height-1 (tft_width-1 for columns)
+ * 		bottom:	last line of the scroll area
+ */
+//=========================================
+void TFT_setScrollArea(int top, int bottom);
+
+/*
+ * Scroll the scroll area, line 'line' of the area is shown at its top (left) and the lines
+ * before it are shown at its end; 0 shows the area as drawn. Costs one command on the bus,
+ * the content is not sent again.
+ *
+ * Params:
+ * 		line:	scroll position, taken modulo the number of lines of the area
+ */
+//============================
+void TFT_scrollTo(int line);
+
+/*
+ * Set the lines shown in partial mode (TFT_setPower(TFT_POWER_PARTIAL)), the other lines are
+ * shown black. The lines run along the gate lines as for TFT_setScrollArea(): rows in portrait
+ * orientations, columns in landscape orientations. TFT_setRotation() clears the area and leaves
+ * partial mode.
+ *
+ * Params:
+ * 		top:	first line of the partial area, 0 ~ tft_height-1 (tft_width-1 for columns)
+ * 		bottom:	last line of the partial area
+ *
+ * Returns:
+ *      ESP_OK on success, ESP_ERR_INVALID_ARG if the lines are outside of the screen
+ */
+//===============================================
+esp_err_t TFT_setPartialArea(int top, int bottom);
+
 /*
  * Compare two color structures
  * Returns 0 if equal, 1 if not equal
@@ -0,0 +1,561 @@
+/*
+ *
+ * BAND RENDERER DISPLAY BUS BACKEND
+ *
+ * While the band renderer is active, 'tft_bus' points to tft_bus_band: the fills
+ * and pixel sends of the drawing functions are recorded into a display list with
+ * their windows. TFT_flush() replays the list into a band buffer of a few display
+ * rows, band after band from the top, and sends each band to the display backend.
+ * There are two band buffers, the next band is rasterized while the last one is sent.
+ *
+ * Only the pixels that were drawn are sent: a band in which all pixels were drawn
+ * is sent with one window and RAMWR straight from the band buffer, otherwise the
+ * drawn rows spans are combined into rectangles.
+ *
+ * The memory used does not depend on the display size, only on the band height
+ * and the list size.
+ *
+*/
+
+#include <string.h>
+#include "tft.h"
+#include "tft_bus.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_heap_caps.h"
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+tft_band_stats_t tft_band_stats = {0};
+
+// ====================================================
+
+#define BAND_OP_FILL        0
+#define BAND_OP_SEND        1
+
+// Rectangles of a partly drawn band which are extended row by row
+#define BAND_OPEN_RECTS     16
+
+// Raster task events, the FREE and READY bits are shifted by the buffer index
+#define BAND_EVT_FREE       0x01
+#define BAND_EVT_READY      0x04
+#define BAND_EVT_START      0x10
+#define BAND_EVT_STOP       0x20
+#define BAND_EVT_DONE       0x40
+
+// A list entry, followed by the pixels of a send rounded up to 4 bytes
+typedef struct {
+    uint8_t op;
+    uint8_t pixel[3];       // packed fill pixel
+    int16_t x1;             // window, framebuffer coordinates
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+    uint32_t len;           // pixels written to the window
+} band_entry_t;
+
+typedef struct {
+    int16_t x1;
+    int16_t x2;
+    int16_t y1;             // first row in the band
+    int16_t row;            // last row it was extended to
+} band_open_t;
+
+static uint8_t *band_list = NULL;
+static uint32_t band_used = 0;                  // bytes used in the list
+static int band_y1 = 0;                         // rows the listed writes reach
+static int band_y2 = -1;
+static const tft_bus_t *band_target = NULL;     // backend the bands are sent to
+static int band_window[4] = {0};                // window of the next write, display coordinates
+static int band_h = 0;                          // band height in rows
+static int band_mask_words = 0;                 // mask words per band row
+static uint8_t *band_buf[2] = {NULL, NULL};
+static uint32_t *band_mask[2] = {NULL, NULL};   // drawn pixels of the band buffers, one bit per pixel
+static TFT_fence_t band_fence[2] = {0};
+static EventGroupHandle_t band_events = NULL;
+static int band_first = 0;                      // bands the raster task renders
+static int band_last = -1;
+
+// ==== Rasterizing ====
+
+//----------------------------------------------------------------
+static inline uint32_t band_entry_size(const band_entry_t *e) {
+    return sizeof(band_entry_t) + ((e->op == BAND_OP_SEND) ? (((e->len * TFT_PIXEL_BYTES) + 3) & ~3) : 0);
+}
+
+// Set the mask bits x1 ~ x2
+//----------------------------------------------------
+static void band_mark(uint32_t *mask, int x1, int x2) {
+    int w1 = x1 >> 5;
+    int w2 = x2 >> 5;
+    uint32_t first = 0xFFFFFFFF << (x1 & 31);
+    uint32_t last = 0xFFFFFFFF >> (31 - (x2 & 31));
+
+    if (w1 == w2) {
+        mask[w1] |= first & last;
+        return;
+    }
+    mask[w1] |= first;
+    for (int i = w1 + 1; i < w2; i++) mask[i] = 0xFFFFFFFF;
+    mask[w2] |= last;
+}
+
+// Write the rows of the entry which are in the band starting at row 'by1'
+//---------------------------------------------------------------------------------
+static void band_raster_entry(int idx, int by1, int by2, const band_entry_t *e) {
+    int w = e->x2 - e->x1 + 1;
+    if (w <= 0) return;
+
+    int y = (e->y1 > by1) ? e->y1 : by1;
+    uint32_t first = (uint32_t)(y - e->y1) * w;
+    int x1 = (e->x1 < 0) ? 0 : e->x1;
+    const uint8_t *pixels = (const uint8_t *)(e + 1);
+
+    for (; (first < e->len) && (y <= e->y2) && (y <= by2); y++, first += w) {
+        uint32_t n = e->len - first;
+        if (n > (uint32_t)w) n = w;
+        int x2 = e->x1 + n - 1;
+        if (x2 >= tft_width) x2 = tft_width - 1;
+        if (x2 < x1) continue;
+
+        uint8_t *dst = band_buf[idx] + ((((y - by1) * tft_width) + x1) * TFT_PIXEL_BYTES);
+        uint32_t count = x2 - x1 + 1;
+        if (e->op == BAND_OP_FILL) {
+            // the run is doubled with every copy
+            memcpy(dst, e->pixel, TFT_PIXEL_BYTES);
+            for (uint32_t done = 1; done < count; ) {
+                uint32_t copy = ((count - done) < done) ? (count - done) : done;
+                memcpy(dst + (done * TFT_PIXEL_BYTES), dst, copy * TFT_PIXEL_BYTES);
+                done += copy;
+            }
+        }
+        else memcpy(dst, pixels + ((first + (x1 - e->x1)) * TFT_PIXEL_BYTES), count * TFT_PIXEL_BYTES);
+        band_mark(band_mask[idx] + ((y - by1) * band_mask_words), x1, x2);
+    }
+}
+
+// Replay the list into band buffer 'idx' for band 'band'
+//----------------------------------------
+static void band_raster(int idx, int band) {
+    int by1 = band * band_h;
+    int by2 = by1 + band_h - 1;
+    if (by2 >= tft_height) by2 = tft_height - 1;
+
+    memset(band_mask[idx], 0, band_h * band_mask_words * sizeof(uint32_t));
+    for (uint32_t pos = 0; pos < band_used; ) {
+        const band_entry_t *e = (const band_entry_t *)(band_list + pos);
+        if ((e->y1 <= by2) && (e->y2 >= by1)) band_raster_entry(idx, by1, by2, e);
+        pos += band_entry_size(e);
+    }
+}
+
+// ==== Sending ====
+
+// First run of set bits at or after 'x' in a mask row of 'width' bits, returns 0 if there is none
+//------------------------------------------------------------------------------------------
+static uint8_t band_next_span(const uint32_t *mask, int width, int x, int *x1, int *x2) {
+    while (x < width) {
+        uint32_t bits = mask[x >> 5] >> (x & 31);
+        if (bits) {
+            x += __builtin_ctz(bits);
+            break;
+        }
+        x = (x | 31) + 1;
+    }
+    if (x >= width) return 0;
+
+    *x1 = x;
+    while (x < width) {
+        uint32_t bits = ~mask[x >> 5] >> (x & 31);
+        if (bits) {
+            x += __builtin_ctz(bits);
+            break;
+        }
+        x = (x | 31) + 1;
+    }
+    *x2 = ((x < width) ? x : width) - 1;
+    return 1;
+}
+
+//------------------------------------------------------------
+static uint8_t band_row_full(const uint32_t *mask, int width) {
+    int i;
+    for (i = 0; i < (width >> 5); i++) {
+        if (mask[i] != 0xFFFFFFFF) return 0;
+    }
+    if (width & 31) return (mask[i] == (0xFFFFFFFF >> (32 - (width & 31))));
+    return 1;
+}
+
+// Send the band buffer rows ry1 ~ ry2, columns x1 ~ x2 of the band starting at row 'by1'
+//-------------------------------------------------------------------------------------------
+static void band_put_rect(int idx, int by1, int x1, int ry1, int x2, int ry2) {
+    uint32_t w = x2 - x1 + 1;
+    uint32_t h = ry2 - ry1 + 1;
+
+    band_target->window(x1 + TFT_STATIC_X_OFFSET, by1 + ry1 + TFT_STATIC_Y_OFFSET,
+                        x2 + TFT_STATIC_X_OFFSET, by1 + ry2 + TFT_STATIC_Y_OFFSET);
+    band_target->send_rect(band_buf[idx] + (((ry1 * tft_width) + x1) * TFT_PIXEL_BYTES), w, h, tft_width);
+    tft_band_stats.rects++;
+    tft_band_stats.pixels += w * h;
+}
+
+// Send the drawn pixels of band buffer 'idx', records the fence after which it can be rasterized again
+//--------------------------------------
+static void band_put(int idx, int band) {
+    int by1 = band * band_h;
+    int rows = tft_height - by1;
+    if (rows > band_h) rows = band_h;
+
+    int full = 1;
+    for (int r = 0; (r < rows) && full; r++) full = band_row_full(band_mask[idx] + (r * band_mask_words), tft_width);
+    if (full) {
+        // the whole band with one transfer, straight from the band buffer
+        band_target->window(TFT_STATIC_X_OFFSET, by1 + TFT_STATIC_Y_OFFSET,
+                            tft_width - 1 + TFT_STATIC_X_OFFSET, by1 + rows - 1 + TFT_STATIC_Y_OFFSET);
+        band_target->send(band_buf[idx], tft_width * rows);
+        band_fence[idx] = band_target->fence();
+        tft_band_stats.bands++;
+        tft_band_stats.pixels += tft_width * rows;
+        return;
+    }
+
+    // Equal spans of consecutive rows are sent as one rectangle,
+    // a rectangle is sent when the next row does not continue it
+    band_open_t open[BAND_OPEN_RECTS];
+    int n_open = 0;
+    for (int r = 0; r <= rows; r++) {
+        int x1, x2;
+        int x = 0;
+        const uint32_t *mask = band_mask[idx] + (r * band_mask_words);
+
+        while ((r < rows) && band_next_span(mask, tft_width, x, &x1, &x2)) {
+            int i;
+            for (i = 0; i < n_open; i++) {
+                if ((open[i].x1 == x1) && (open[i].x2 == x2) && (open[i].row == (r - 1))) break;
+            }
+            if (i < n_open) open[i].row = r;
+            else if (n_open < BAND_OPEN_RECTS) open[n_open++] = (band_open_t){ .x1 = x1, .x2 = x2, .y1 = r, .row = r };
+            else band_put_rect(idx, by1, x1, r, x2, r);
+            x = x2 + 1;
+        }
+        for (int i = 0; i < n_open; i++) {
+            if (open[i].row == r) continue;
+            band_put_rect(idx, by1, open[i].x1, open[i].y1, open[i].x2, open[i].row);
+            open[i--] = open[--n_open];
+        }
+    }
+    // the rectangles are copied by the backend
+    band_fence[idx] = band_target->fence();
+}
+
+#if TFT_BAND_RASTER_CORE >= 0
+//------------------------------------------
+static void band_raster_task(void *arg) {
+    (void)arg;
+    while (1) {
+        EventBits_t bits = xEventGroupWaitBits(band_events, BAND_EVT_START | BAND_EVT_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (bits & BAND_EVT_STOP) break;
+
+        for (int k = band_first; k <= band_last; k++) {
+            xEventGroupWaitBits(band_events, BAND_EVT_FREE << (k & 1), pdTRUE, pdTRUE, portMAX_DELAY);
+            band_raster(k & 1, k);
+            xEventGroupSetBits(band_events, BAND_EVT_READY << (k & 1));
+        }
+    }
+    xEventGroupSetBits(band_events, BAND_EVT_DONE);
+    vTaskDelete(NULL);
+}
+#endif
+
+// Replay the list band by band and send the bands to the display, the list is empty afterwards
+//------------------------
+static void band_flush() {
+    if (band_used == 0) return;
+
+    if (band_target->acquire() == ESP_OK) {
+        band_first = band_y1 / band_h;
+        band_last = band_y2 / band_h;
+        if (band_events) {
+            // band k+1 is rasterized by the task while band k is sent
+            xEventGroupSetBits(band_events, BAND_EVT_FREE | (BAND_EVT_FREE << 1) | BAND_EVT_START);
+            for (int k = band_first; k <= band_last; k++) {
+                xEventGroupWaitBits(band_events, BAND_EVT_READY << (k & 1), pdTRUE, pdTRUE, portMAX_DELAY);
+                band_put(k & 1, k);
+                if (k > band_first) {
+                    band_target->wait(band_fence[(k - 1) & 1]);
+                    xEventGroupSetBits(band_events, BAND_EVT_FREE << ((k - 1) & 1));
+                }
+            }
+        }
+        else {
+            // band k+1 is rasterized while band k is sent
+            for (int k = band_first; k <= band_last; k++) {
+                band_target->wait(band_fence[k & 1]);
+                band_raster(k & 1, k);
+                band_put(k & 1, k);
+            }
+        }
+        tft_band_stats.flushes++;
+        band_target->release();
+    }
+    band_used = 0;
+    band_y1 = tft_height;
+    band_y2 = -1;
+}
+
+// ==== Recording ====
+
+// Add an entry for a write of 'len' pixels to the window with 'payload' bytes following it,
+// the list is replayed first if it is full. Returns NULL if the list can not hold the entry
+//---------------------------------------------------------------------------
+static band_entry_t *band_record(uint8_t op, uint32_t len, uint32_t payload) {
+    uint32_t size = sizeof(band_entry_t) + ((payload + 3) & ~3);
+    if (size > TFT_BAND_LIST_SIZE) return NULL;
+    if ((band_used + size) > TFT_BAND_LIST_SIZE) {
+        tft_band_stats.list_full++;
+        band_flush();
+    }
+
+    band_entry_t *e = (band_entry_t *)(band_list + band_used);
+    e->op = op;
+    e->x1 = band_window[0] - TFT_STATIC_X_OFFSET;
+    e->y1 = band_window[1] - TFT_STATIC_Y_OFFSET;
+    e->x2 = band_window[2] - TFT_STATIC_X_OFFSET;
+    e->y2 = band_window[3] - TFT_STATIC_Y_OFFSET;
+    e->len = len;
+    band_used += size;
+    if (band_used > tft_band_stats.list_max) tft_band_stats.list_max = band_used;
+
+    // rows the write reaches on the display
+    int w = e->x2 - e->x1 + 1;
+    if ((w > 0) && (len > 0)) {
+        int y1 = e->y1;
+        int y2 = e->y1 + ((len - 1) / w);
+        if (y2 > e->y2) y2 = e->y2;
+        if (y1 < 0) y1 = 0;
+        if (y2 >= tft_height) y2 = tft_height - 1;
+        if ((y1 <= y2) && (y1 < band_y1)) band_y1 = y1;
+        if ((y1 <= y2) && (y2 > band_y2)) band_y2 = y2;
+    }
+    return e;
+}
+
+// A write too large for the list goes to the display backend after the listed ones
+//--------------------------------------
+static uint8_t band_direct_begin() {
+    band_flush();
+    if (band_target->acquire() != ESP_OK) return 0;
+    band_target->window(band_window[0], band_window[1], band_window[2], band_window[3]);
+    return 1;
+}
+
+// The caller can change the pixels when the write returns
+//---------------------------
+static void band_direct_end() {
+    band_target->wait(band_target->fence());
+    band_target->release();
+}
+
+// ==== Backend operations ====
+
+//----------------------------------
+static esp_err_t band_acquire() {
+    // recording does not need the bus
+    return ESP_OK;
+}
+
+//------------------------
+static void band_release() {
+}
+
+//---------------------------
+static void band_invalidate() {
+    band_target->invalidate();
+}
+
+// Commands are sent after the listed writes, in the order they were drawn
+//--------------------------------
+static void band_cmd(uint8_t cmd) {
+    band_flush();
+    band_target->cmd(cmd);
+}
+
+//---------------------------------------------------------------------------
+static void band_cmd_data(uint8_t cmd, const uint8_t *data, uint32_t len) {
+    band_flush();
+    band_target->cmd_data(cmd, data, len);
+}
+
+//---------------------------------------------------------
+static void band_set_window(int x1, int y1, int x2, int y2) {
+    band_window[0] = x1;
+    band_window[1] = y1;
+    band_window[2] = x2;
+    band_window[3] = y2;
+}
+
+//--------------------------------------------------------------
+static void band_fill(color_t color, uint32_t len, uint8_t sync) {
+    (void)sync;
+    band_entry_t *e = band_record(BAND_OP_FILL, len, 0);
+    TFT_pixel_pack(e->pixel, color);
+}
+
+//----------------------------------------------------------
+static void band_send(const uint8_t *pixels, uint32_t len) {
+    band_entry_t *e = band_record(BAND_OP_SEND, len, len * TFT_PIXEL_BYTES);
+    if (e) memcpy(e + 1, pixels, len * TFT_PIXEL_BYTES);
+    else if (band_direct_begin()) {
+        band_target->send(pixels, len);
+        band_direct_end();
+    }
+}
+
+//---------------------------------------------------------------
+static void band_send_colors(const color_t *colors, uint32_t len) {
+    band_entry_t *e = band_record(BAND_OP_SEND, len, len * TFT_PIXEL_BYTES);
+    if (e) TFT_pixels_store((uint8_t *)(e + 1), colors, len);
+    else if (band_direct_begin()) {
+        band_target->send_colors(colors, len);
+        band_direct_end();
+    }
+}
+
+//---------------------------------------------------------------------------------------------
+static void band_send_rect(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    // listed as a window of 'w' x 'h' pixels written row after row
+    int window[4];
+    memcpy(window, band_window, sizeof(window));
+    band_window[2] = band_window[0] + w - 1;
+    band_window[3] = band_window[1] + h - 1;
+
+    band_entry_t *e = band_record(BAND_OP_SEND, w * h, w * h * TFT_PIXEL_BYTES);
+    if (e) {
+        uint8_t *dst = (uint8_t *)(e + 1);
+        for (uint32_t y = 0; y < h; y++, pixels += stride * TFT_PIXEL_BYTES, dst += w * TFT_PIXEL_BYTES) {
+            memcpy(dst, pixels, w * TFT_PIXEL_BYTES);
+        }
+    }
+    else if (band_direct_begin()) {
+        band_target->send_rect(pixels, w, h, stride);
+        band_direct_end();
+    }
+    memcpy(band_window, window, sizeof(window));
+}
+
+//------------------------------------------------------
+static esp_err_t band_read(uint8_t *dst, uint32_t len) {
+    if (!band_direct_begin()) return ESP_FAIL;
+    esp_err_t ret = band_target->read(dst, len);
+    band_target->release();
+    return ret;
+}
+
+// Transfers of the display backend may still run after a flush
+//-----------------------------------
+static TFT_fence_t band_fence_get() {
+    return band_target->fence();
+}
+
+//---------------------------------------
+static void band_wait(TFT_fence_t fence) {
+    band_target->wait(fence);
+}
+
+//-------------------------------------------------
+static uint8_t band_fence_done(TFT_fence_t fence) {
+    return band_target->fence_done(fence);
+}
+
+// ==== Band renderer backend =================================
+const tft_bus_t tft_bus_band = {
+    .name = "band",
+    .acquire = band_acquire,
+    .release = band_release,
+    .init = NULL,
+    .invalidate = band_invalidate,
+    .cmd = band_cmd,
+    .cmd_data = band_cmd_data,
+    .window = band_set_window,
+    .fill = band_fill,
+    .send = band_send,
+    .send_colors = band_send_colors,
+    .send_rect = band_send_rect,
+    .read = band_read,
+    .fence = band_fence_get,
+    .wait = band_wait,
+    .fence_done = band_fence_done,
+    .flush = band_flush,
+};
+
+//------------------------
+static void band_free() {
+    for (int i = 0; i < 2; i++) {
+        heap_caps_free(band_buf[i]);
+        heap_caps_free(band_mask[i]);
+        band_buf[i] = NULL;
+        band_mask[i] = NULL;
+    }
+    heap_caps_free(band_list);
+    band_list = NULL;
+    if (band_events) vEventGroupDelete(band_events);
+    band_events = NULL;
+}
+
+//=====================================
+esp_err_t TFT_band_begin(int height) {
+    // the display backend must draw directly
+    if ((tft_bus->flush != NULL) || (tft_bus->send_rect == NULL)) return ESP_ERR_INVALID_STATE;
+    if (height <= 0) height = TFT_BAND_HEIGHT;
+
+    // the rows are as long as the longer side, the orientation can change
+    int row = (tft_width > tft_height) ? tft_width : tft_height;
+    band_h = height;
+    band_mask_words = (row + 31) / 32;
+    band_list = heap_caps_malloc(TFT_BAND_LIST_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    for (int i = 0; i < 2; i++) {
+        band_buf[i] = heap_caps_malloc(row * height * TFT_PIXEL_BYTES, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+        band_mask[i] = heap_caps_malloc(band_mask_words * height * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if ((band_list == NULL) || (band_buf[0] == NULL) || (band_buf[1] == NULL) ||
+        (band_mask[0] == NULL) || (band_mask[1] == NULL)) {
+        band_free();
+        return ESP_ERR_NO_MEM;
+    }
+
+#if TFT_BAND_RASTER_CORE >= 0
+    band_events = xEventGroupCreate();
+    if ((band_events == NULL) ||
+        (xTaskCreatePinnedToCore(band_raster_task, "tft_band", TFT_BAND_TASK_STACK, NULL,
+                                 uxTaskPriorityGet(NULL), NULL, TFT_BAND_RASTER_CORE) != pdPASS)) {
+        band_free();
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    // earlier transfers must be finished before the backend changes
+    TFT_flush();
+    band_target = tft_bus;
+    band_fence[0] = band_target->fence();
+    band_fence[1] = band_fence[0];
+    band_used = 0;
+    band_y1 = tft_height;
+    band_y2 = -1;
+    tft_bus = &tft_bus_band;
+    return ESP_OK;
+}
+
+//====================
+void TFT_band_end() {
+    if (tft_bus != &tft_bus_band) return;
+
+    TFT_flush();
+    tft_bus = band_target;
+    if (band_events) {
+        xEventGroupSetBits(band_events, BAND_EVT_STOP);
+        xEventGroupWaitBits(band_events, BAND_EVT_DONE, pdTRUE, pdTRUE, portMAX_DELAY);
+    }
+    band_free();
+}
@@ -0,0 +1,140 @@
+/*
+ *
+ * DISPLAY BUS BACKENDS
+ *
+ * tftspi.c does not access the bus itself, every display transfer goes through
+ * the backend 'tft_bus' points to:
+ *   tft_bus_spi  ESP-IDF spi_master (default), tft_bus_spi.c
+ *   tft_bus_rec  records the operations without any hardware, tft_bus_rec.c
+ *   tft_bus_fb   renders into a framebuffer, TFT_flush() sends it to the display, tft_fb.c
+ *   tft_bus_band records a display list, TFT_flush() renders and sends it in bands, tft_band.c
+ *   tft_bus_canvas renders into a canvas, TFT_blitCanvas() sends it, tft_canvas.c
+ *
+*/
+
+#ifndef _TFT_BUS_H_
+#define _TFT_BUS_H_
+
+#include "tftspi.h"
+
+// ==== Bus backend operations ==================================
+// All operations are called from the drawing task only.
+// Colors are already converted (gray scale) when they reach the backend.
+typedef struct {
+    const char *name;
+
+    // Get exclusive use of the bus, called by the outermost disp_select()
+    esp_err_t (*acquire)(void);
+    // Give the bus back, called by the outermost disp_deselect() when all transfers are finished
+    void (*release)(void);
+    // Called by TFT_display_init() after the controller is initialized and rotated,
+    // may draw to the display, which is cleared afterwards. Can be NULL
+    void (*init)(void);
+    // The controller state is unknown (hardware reset), cached state must not be used
+    void (*invalidate)(void);
+
+    // Send a command without / with data, all earlier transfers are finished first,
+    // the command is sent when the call returns
+    void (*cmd)(uint8_t cmd);
+    void (*cmd_data)(uint8_t cmd, const uint8_t *data, uint32_t len);
+
+    // Set the window (x1,y1),(x2,y2) of the next fill, send or read
+    void (*window)(int x1, int y1, int x2, int y2);
+    // Write 'len' times the color to the window, may return before the data is sent
+    // 'sync' is set if the caller waits for the fill anyway, the backend may then send it directly
+    void (*fill)(color_t color, uint32_t len, uint8_t sync);
+    // Write 'len' pixels in the display pixel format (TFT_PIXEL_BYTES each) to the window,
+    // may return before the data is sent,
+    // 'pixels' must not change until the fence taken after the call is done
+    void (*send)(const uint8_t *pixels, uint32_t len);
+    // Write 'len' colors to the window, stored with TFT_pixels_store() (color transform, pixel format)
+    // into buffers of the backend, 'colors' is never changed; it must not change until the fence
+    // taken after the call is done, a backend may convert it while earlier chunks are sent
+    void (*send_colors)(const color_t *colors, uint32_t len);
+    // Write the 'w' x 'h' pixels in the display pixel format at 'pixels' to the window, the rows are
+    // 'stride' pixels apart; the pixels are copied into buffers of the backend (they can be in PSRAM),
+    // 'pixels' can change when the call returns
+    void (*send_rect)(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride);
+    // Read 'len' pixels of the window into 'dst', 3 bytes per pixel as sent by the controller,
+    // all earlier transfers are finished first, the data is in 'dst' when the call returns
+    esp_err_t (*read)(uint8_t *dst, uint32_t len);
+
+    // Fences, see TFT_fence_t
+    TFT_fence_t (*fence)(void);
+    void (*wait)(TFT_fence_t fence);
+    uint8_t (*fence_done)(TFT_fence_t fence);
+
+    // Send what the backend buffered to the display, called by TFT_flush(). NULL if it draws directly
+    void (*flush)(void);
+} tft_bus_t;
+
+// ==== Backend used for all display transfers ==================
+// Can be changed before TFT_display_init(), never while drawing
+extern const tft_bus_t *tft_bus;
+
+// ==== Available backends ======================================
+extern const tft_bus_t tft_bus_spi;
+extern const tft_bus_t tft_bus_rec;
+extern const tft_bus_t tft_bus_fb;     // set by TFT_fb_begin(), see tftspi.h
+extern const tft_bus_t tft_bus_band;   // set by TFT_band_begin(), see tftspi.h
+extern const tft_bus_t tft_bus_canvas; // set by TFT_canvas_begin(), see tftspi.h
+
+
+// ==== Frame differ (tft_diff.c) ===============================
+// Called with each rectangle of changed pixels, in the coordinates of the region's buffers
+typedef void (*tft_diff_op_t)(int x1, int y1, int x2, int y2, void *arg);
+
+// Compare the pixels (x1,y1) ~ (x2,y2) of 'fresh' with 'shadow', both in the display pixel format
+// with rows 'stride' pixels apart, call 'op' for the rectangles of changed pixels and copy them to 'shadow'
+// Returns the number of pixels in the rectangles
+//====================================================================================================
+uint32_t tft_diff_region(const uint8_t *fresh, uint8_t *shadow, uint32_t stride,
+                         int x1, int y1, int x2, int y2, tft_diff_op_t op, void *arg);
+
+
+// ==== Recording backend =======================================
+// Counts every operation and the bytes it would put on a 4-wire SPI bus,
+// optionally logs the operations into a caller supplied array.
+// Reads return black pixels, fences are always done.
+
+typedef enum {
+    TFT_BUS_OP_CMD = 0,
+    TFT_BUS_OP_WINDOW,
+    TFT_BUS_OP_FILL,
+    TFT_BUS_OP_SEND,
+    TFT_BUS_OP_READ,
+    TFT_BUS_OP_FENCE,
+    TFT_BUS_OP_WAIT,
+    TFT_BUS_OP_MAX
+} tft_bus_op_t;
+
+typedef struct {
+    uint8_t op;         // tft_bus_op_t
+    uint8_t cmd;        // command (TFT_BUS_OP_CMD)
+    int16_t x1;         // window (TFT_BUS_OP_WINDOW)
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+    color_t color;      // fill color (TFT_BUS_OP_FILL)
+    uint32_t len;       // data bytes (TFT_BUS_OP_CMD) or pixels (fill, send, read)
+} tft_bus_rec_entry_t;
+
+typedef struct {
+    uint32_t ops[TFT_BUS_OP_MAX];   // number of operations of each type
+    uint32_t pixels;                // pixels written
+    uint32_t bytes;                 // bytes on the wire, commands included
+} tft_bus_rec_stats_t;
+
+// ==== Statistics since the last tft_bus_rec_start() ===========
+extern tft_bus_rec_stats_t tft_bus_rec_stats;
+
+// Clear the statistics and start logging into 'log' (can be NULL) which holds 'size' entries
+// When the log is full, only the statistics are updated
+//==================================================================
+void tft_bus_rec_start(tft_bus_rec_entry_t *log, uint32_t size);
+
+// Number of entries in the log
+//==============================
+uint32_t tft_bus_rec_logged();
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ *
+ * RECORDING DISPLAY BUS BACKEND
+ *
+ * Records the display operations without any hardware,
+ * used to count the traffic of the drawing functions.
+ *
+*/
+
+#include <string.h>
+#include "tft_bus.h"
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+// Statistics since the last tft_bus_rec_start()
+tft_bus_rec_stats_t tft_bus_rec_stats = {0};
+
+// ====================================================
+
+static tft_bus_rec_entry_t *rec_log = NULL;
+static uint32_t rec_log_size = 0;
+static uint32_t rec_log_used = 0;
+static TFT_fence_t rec_fence = 0;
+
+// Count the operation and return its log entry, NULL if it is not logged
+//----------------------------------------------------------------------------
+static tft_bus_rec_entry_t *rec_add(tft_bus_op_t op, uint32_t bytes) {
+    tft_bus_rec_stats.ops[op]++;
+    tft_bus_rec_stats.bytes += bytes;
+    if (rec_log_used >= rec_log_size) return NULL;
+
+    tft_bus_rec_entry_t *entry = &rec_log[rec_log_used++];
+    memset(entry, 0, sizeof(tft_bus_rec_entry_t));
+    entry->op = op;
+    return entry;
+}
+
+//==================================================================
+void tft_bus_rec_start(tft_bus_rec_entry_t *log, uint32_t size) {
+    memset(&tft_bus_rec_stats, 0, sizeof(tft_bus_rec_stats));
+    rec_log = log;
+    rec_log_size = (log) ? size : 0;
+    rec_log_used = 0;
+}
+
+//==============================
+uint32_t tft_bus_rec_logged() {
+    return rec_log_used;
+}
+
+//----------------------------------
+static esp_err_t rec_acquire() {
+    return ESP_OK;
+}
+
+//-----------------------
+static void rec_nop() {
+}
+
+//--------------------------------
+static void rec_cmd(uint8_t cmd) {
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_CMD, 1);
+    if (entry) entry->cmd = cmd;
+}
+
+//-------------------------------------------------------------------------
+static void rec_cmd_data(uint8_t cmd, const uint8_t *data, uint32_t len) {
+    if (data == NULL) len = 0;
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_CMD, 1 + len);
+    if (entry) {
+        entry->cmd = cmd;
+        entry->len = len;
+    }
+}
+
+// CASET and PASET with 4 data bytes each
+//--------------------------------------------------------
+static void rec_window(int x1, int y1, int x2, int y2) {
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_WINDOW, 10);
+    if (entry) {
+        entry->x1 = x1;
+        entry->y1 = y1;
+        entry->x2 = x2;
+        entry->y2 = y2;
+    }
+}
+
+// RAMWR and the pixels
+//-------------------------------------------------------------
+static void rec_fill(color_t color, uint32_t len, uint8_t sync) {
+    (void)sync;
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_FILL, 1 + (TFT_PIXEL_BYTES * len));
+    tft_bus_rec_stats.pixels += len;
+    if (entry) {
+        entry->color = color;
+        entry->len = len;
+    }
+}
+
+//---------------------------------------------------------
+static void rec_send(const uint8_t *pixels, uint32_t len) {
+    (void)pixels;
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_SEND, 1 + (TFT_PIXEL_BYTES * len));
+    tft_bus_rec_stats.pixels += len;
+    if (entry) entry->len = len;
+}
+
+// same traffic as rec_send(), the colors are not converted
+//--------------------------------------------------------------
+static void rec_send_colors(const color_t *colors, uint32_t len) {
+    rec_send((const uint8_t *)colors, len);
+}
+
+// same traffic as rec_send()
+//--------------------------------------------------------------------------------------------
+static void rec_send_rect(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    (void)stride;
+    rec_send(pixels, w * h);
+}
+
+// RAMRD and the pixels, all pixels are black
+//------------------------------------------------------
+static esp_err_t rec_read(uint8_t *dst, uint32_t len) {
+    tft_bus_rec_entry_t *entry = rec_add(TFT_BUS_OP_READ, 1 + (3 * len));
+    if (entry) entry->len = len;
+    memset(dst, 0, 3 * len);
+    return ESP_OK;
+}
+
+//-----------------------------
+static TFT_fence_t rec_fence_get() {
+    rec_add(TFT_BUS_OP_FENCE, 0);
+    return ++rec_fence;
+}
+
+//-------------------------------------
+static void rec_wait(TFT_fence_t fence) {
+    (void)fence;
+    rec_add(TFT_BUS_OP_WAIT, 0);
+}
+
+//-----------------------------------------------
+static uint8_t rec_fence_done(TFT_fence_t fence) {
+    (void)fence;
+    return 1;
+}
+
+// ==== Recording backend =====================================
+const tft_bus_t tft_bus_rec = {
+    .name = "recorder",
+    .acquire = rec_acquire,
+    .release = rec_nop,
+    .init = NULL,
+    .invalidate = rec_nop,
+    .cmd = rec_cmd,
+    .cmd_data = rec_cmd_data,
+    .window = rec_window,
+    .fill = rec_fill,
+    .send = rec_send,
+    .send_colors = rec_send_colors,
+    .send_rect = rec_send_rect,
+    .read = rec_read,
+    .fence = rec_fence_get,
+    .wait = rec_wait,
+    .fence_done = rec_fence_done,
+    .flush = NULL,
+};
@@ -0,0 +1,1245 @@
+/*
+ *
+ * SPI_MASTER DISPLAY BUS BACKEND
+ *
+ * Display transfers with the ESP-IDF spi_master driver,
+ * queued DMA transactions for pixel data, polling transactions for commands and short fills.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tft_bus.h"
+#include "tft_trace.h"
+#include "freertos/task.h"
+#include "soc/spi_reg.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "soc/cpu.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/spi_periph.h"
+#include "soc/gpio_struct.h"
+#include "esp32/rom/gpio.h"
+#if CONFIG_TFT_DC_DIRECT_REG
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#endif
+#if CONFIG_TFT_DMA_CHAIN_FILL
+#include "soc/spi_struct.h"
+#include "esp_log.h"
+#include "tft_dma_chain.h"
+#endif
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+// Synchronous fills up to this many pixels are sent with polling transactions,
+// the crossover is measured by TFT_display_init()
+uint32_t tft_short_run_len = 10;
+
+// Spi device handle for the display
+spi_device_handle_t tft_disp_spi = NULL;
+// Spi device for display reads, added by TFT_read_device_init()
+spi_device_handle_t tft_disp_rd_spi = NULL;
+
+// ====================================================
+
+// === transmission callback definitions ==============
+
+// these functions are put into IRAM to speed up transmissions,
+// for efficiency setting CONFIG_SPU_MASTER_IN_IRAM in menuconfig might be desired
+
+// struct for transaction callback information, it is a struct in order to be somewhat easily extensible
+//TODO: check if it is viable to put all instantiations of this into DRAM somehow
+typedef struct {
+    WORD_ALIGNED_ATTR uint32_t dc_level; // Display command/data pin level to set
+} tft_spi_user_t;
+
+static DMA_ATTR tft_spi_user_t tft_spi_user_command = {
+    .dc_level = 0,
+};
+
+static DMA_ATTR tft_spi_user_t tft_spi_user_data = {
+    .dc_level = 1,
+};
+
+// Level the DC pin was last set to, 42 if unknown
+static DRAM_ATTR uint32_t last_DC_state = 42;
+
+// Set the DC pin, nothing is written if the pin already has the level,
+// which is the case for consecutive data transactions
+//----------------------------------------------------------
+static inline void IRAM_ATTR disp_dc_set(uint32_t level) {
+    if (level == last_DC_state) return;
+    last_DC_state = level;
+#if CONFIG_TFT_DC_DIRECT_REG
+#if PIN_NUM_DC < 32
+    REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1u << PIN_NUM_DC);
+#else
+    REG_WRITE(level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, 1u << (PIN_NUM_DC - 32));
+#endif
+#else
+    gpio_set_level(PIN_NUM_DC, level);
+#endif
+}
+
+// Drive the DC pin low and record the level, called by TFT_PinsInit()
+//===================
+void disp_spi_dc_init() {
+    last_DC_state = 42;
+    disp_dc_set(0);
+}
+
+void IRAM_ATTR TFT_transaction_begin_callback(spi_transaction_t* transaction){
+    disp_dc_set(((tft_spi_user_t*)transaction->user)->dc_level);
+}
+
+// Average CPU cycles of one TFT_transaction_begin_callback() call
+//==========================================================
+uint32_t TFT_dc_callback_cycles(uint8_t alternate, uint32_t count) {
+    spi_transaction_t t[2] = {
+        { .user = &tft_spi_user_command },
+        { .user = &tft_spi_user_data },
+    };
+    uint32_t start, cycles;
+
+    if (count == 0) return 0;
+    // the DC pin must not change during a transfer
+    TFT_flush();
+    TFT_transaction_begin_callback(&t[1]);
+    start = esp_cpu_get_ccount();
+    for (uint32_t n = 0; n < count; n++) {
+        TFT_transaction_begin_callback(&t[alternate ? (n & 1) : 1]);
+    }
+    cycles = esp_cpu_get_ccount() - start;
+    return cycles / count;
+}
+
+// ==== Functions =====================
+
+// === Transaction trace ===
+// With CONFIG_TFT_SPI_TRACE every display transaction is recorded when it is started or queued,
+// recording is active between TFT_trace_start() and TFT_trace_stop().
+#if CONFIG_TFT_SPI_TRACE
+static tft_trace_record_t *tft_trace_buf = NULL;
+static uint32_t tft_trace_size = 0;         // records the buffer can hold
+static uint32_t tft_trace_count = 0;        // records in the buffer
+static uint32_t tft_trace_dropped = 0;      // transactions not recorded, the buffer was full
+static uint8_t tft_trace_on = 0;
+static int64_t tft_trace_t0 = 0;
+
+//------------------------------------------------------------------------------
+static void IRAM_ATTR disp_trace_add(uint8_t flags, uint32_t len, uint32_t data) {
+    if (tft_trace_count >= tft_trace_size) {
+        tft_trace_dropped++;
+        return;
+    }
+    tft_trace_record_t *rec = &tft_trace_buf[tft_trace_count++];
+    rec->time = (uint32_t)(esp_timer_get_time() - tft_trace_t0);
+    rec->len_flags = (len & 0x00FFFFFF) | ((uint32_t)flags << 24);
+    rec->data = data;
+}
+#endif
+
+// Record the transaction if tracing is active
+//--------------------------------------------------------------------------------------
+static inline void IRAM_ATTR disp_trace_trans(const spi_transaction_t *t, uint8_t flags) {
+#if CONFIG_TFT_SPI_TRACE
+    if (!tft_trace_on) return;
+
+    uint32_t len, data;
+    if (((tft_spi_user_t *)t->user)->dc_level) flags |= TFT_TRACE_DC;
+    if (flags & TFT_TRACE_READ) {
+        len = t->rxlength / 8;
+        data = t->cmd;
+    }
+    else {
+        len = t->length / 8;
+        if (t->flags & SPI_TRANS_USE_TXDATA) {
+            flags |= TFT_TRACE_INLINE;
+            data = t->tx_data[0] | (t->tx_data[1] << 8) | (t->tx_data[2] << 16) | ((uint32_t)t->tx_data[3] << 24);
+        }
+        else data = (uint32_t)(uintptr_t)t->tx_buffer;
+    }
+    disp_trace_add(flags, len, data);
+#endif
+}
+
+//================================================
+esp_err_t TFT_trace_start(uint32_t records) {
+#if CONFIG_TFT_SPI_TRACE
+    tft_trace_on = 0;
+    if (records != tft_trace_size) {
+        free(tft_trace_buf);
+        tft_trace_buf = NULL;
+        tft_trace_size = 0;
+        if (records == 0) return ESP_OK;
+        tft_trace_buf = malloc(records * sizeof(tft_trace_record_t));
+        if (tft_trace_buf == NULL) return ESP_ERR_NO_MEM;
+        tft_trace_size = records;
+    }
+    if (records == 0) return ESP_OK;
+    tft_trace_count = 0;
+    tft_trace_dropped = 0;
+    tft_trace_t0 = esp_timer_get_time();
+    tft_trace_on = 1;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+//====================
+void TFT_trace_stop() {
+#if CONFIG_TFT_SPI_TRACE
+    tft_trace_on = 0;
+#endif
+}
+
+//==========================
+uint32_t TFT_trace_count() {
+#if CONFIG_TFT_SPI_TRACE
+    return tft_trace_count;
+#else
+    return 0;
+#endif
+}
+
+#if CONFIG_TFT_SPI_TRACE
+//--------------------------------------------------------
+static void disp_trace_header(tft_trace_header_t *hdr) {
+    memset(hdr, 0, sizeof(tft_trace_header_t));
+    hdr->magic = TFT_TRACE_MAGIC;
+    hdr->version = TFT_TRACE_VERSION;
+    hdr->record_size = sizeof(tft_trace_record_t);
+    hdr->spi_clock = DEFAULT_SPI_CLOCK;
+    hdr->rd_clock = tft_max_rdclock;
+    hdr->count = tft_trace_count;
+    hdr->dropped = tft_trace_dropped;
+    hdr->queue_size = TFT_SPI_QUEUE_SIZE;
+    hdr->read_dummy = TFT_READ_DUMMY_BITS;
+    hdr->disp_type = tft_disp_type;
+}
+#endif
+
+//================================================
+esp_err_t TFT_trace_save(const char *path) {
+#if CONFIG_TFT_SPI_TRACE
+    tft_trace_header_t hdr;
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) return ESP_FAIL;
+    disp_trace_header(&hdr);
+    size_t n = fwrite(&hdr, sizeof(hdr), 1, f);
+    if ((n == 1) && (tft_trace_count > 0)) n = fwrite(tft_trace_buf, sizeof(tft_trace_record_t) * tft_trace_count, 1, f);
+    if (fclose(f) != 0) n = 0;
+    return (n == 1) ? ESP_OK : ESP_FAIL;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+#if CONFIG_TFT_SPI_TRACE
+//--------------------------------------------------------------------
+static void disp_trace_print_bytes(const uint8_t *buf, uint32_t len) {
+    while (len > 0) {
+        uint32_t n = (len > 32) ? 32 : len;
+        printf(TFT_TRACE_LINE_TAG " ");
+        for (uint32_t i = 0; i < n; i++) printf("%02x", buf[i]);
+        printf("\n");
+        buf += n;
+        len -= n;
+    }
+}
+#endif
+
+//=====================
+void TFT_trace_print() {
+#if CONFIG_TFT_SPI_TRACE
+    tft_trace_header_t hdr;
+
+    disp_trace_header(&hdr);
+    printf(TFT_TRACE_LINE_TAG " BEGIN\n");
+    disp_trace_print_bytes((const uint8_t *)&hdr, sizeof(hdr));
+    disp_trace_print_bytes((const uint8_t *)tft_trace_buf, sizeof(tft_trace_record_t) * tft_trace_count);
+    printf(TFT_TRACE_LINE_TAG " END\n");
+#endif
+}
+
+// Send the transaction with the display device and wait for it
+//------------------------------------------------------------------------------
+static esp_err_t IRAM_ATTR disp_spi_polling_transmit(const spi_transaction_t *t) {
+    disp_trace_trans(t, 0);
+    return spi_device_polling_transmit(tft_disp_spi, (spi_transaction_t *)t);
+}
+
+// === Transaction ring ===
+// Every queued transaction gets its own descriptor from this ring, so a descriptor
+// is never touched while the spi driver still owns it.
+// Results of one device are returned in queue order, so the running count of queued
+// transactions identifies each of them and serves as the completion fence.
+static DMA_ATTR spi_transaction_t tft_trans_ring[TFT_SPI_QUEUE_SIZE];
+static uint32_t tft_trans_queued = 0;   // number of transactions queued so far
+static uint32_t tft_trans_done = 0;     // number of transaction results collected so far
+
+// Collect the result of the oldest queued transaction
+//-----------------------------------------------
+static void IRAM_ATTR disp_spi_collect_result() {
+    spi_transaction_t* result_transaction;
+    esp_err_t ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
+    ESP_ERROR_CHECK(ret);
+    tft_trans_done++;
+}
+
+// Get a cleared descriptor from the ring, waits for the oldest transaction if all are in use
+//---------------------------------------------------------
+static spi_transaction_t* IRAM_ATTR disp_spi_trans_get() {
+    if ((tft_trans_queued - tft_trans_done) >= TFT_SPI_QUEUE_SIZE) disp_spi_collect_result();
+
+    spi_transaction_t *trans = &tft_trans_ring[tft_trans_queued % TFT_SPI_QUEUE_SIZE];
+    memset(trans, 0, sizeof(spi_transaction_t));
+    return trans;
+}
+
+// Queue up to 4 bytes of command or data, the bytes are copied into the descriptor
+//----------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_queue_txdata(tft_spi_user_t *user, const uint8_t *data, uint8_t len) {
+    spi_transaction_t *trans = disp_spi_trans_get();
+    trans->flags = SPI_TRANS_USE_TXDATA;
+    trans->user = user;
+    trans->length = 8 * len;
+    memcpy(trans->tx_data, data, len);
+    disp_trace_trans(trans, TFT_TRACE_QUEUED);
+
+    esp_err_t ret = spi_device_queue_trans(tft_disp_spi, trans, portMAX_DELAY);
+    ESP_ERROR_CHECK(ret);
+    tft_trans_queued++;
+}
+
+// Queue 'len' bytes of data from 'buf', the buffer is owned by the driver until the transaction is done
+//--------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_queue_buffer(tft_spi_user_t *user, const void *buf, uint32_t len) {
+    spi_transaction_t *trans = disp_spi_trans_get();
+    trans->user = user;
+    trans->length = 8 * len;
+    trans->tx_buffer = buf;
+    disp_trace_trans(trans, TFT_TRACE_QUEUED);
+
+    esp_err_t ret = spi_device_queue_trans(tft_disp_spi, trans, portMAX_DELAY);
+    ESP_ERROR_CHECK(ret);
+    tft_trans_queued++;
+}
+
+//-------------------------------------------
+static TFT_fence_t IRAM_ATTR disp_spi_fence() {
+    return tft_trans_queued;
+}
+
+//---------------------------------------------------
+static void IRAM_ATTR disp_spi_wait(TFT_fence_t fence) {
+    // signed difference keeps working when the counters wrap around
+    while ((int32_t)(fence - tft_trans_done) > 0) disp_spi_collect_result();
+}
+
+//---------------------------------------------------------
+static uint8_t IRAM_ATTR disp_spi_fence_done(TFT_fence_t fence) {
+    spi_transaction_t* result_transaction;
+    while ((int32_t)(fence - tft_trans_done) > 0) {
+        if (spi_device_get_trans_result(tft_disp_spi, &result_transaction, 0) != ESP_OK) return 0;
+        tft_trans_done++;
+    }
+    return 1;
+}
+
+// Wait until all queued transactions are finished, polling transactions may be sent afterwards
+//----------------------------------------
+static void IRAM_ATTR disp_spi_flush() {
+    disp_spi_wait(tft_trans_queued);
+}
+
+// === Address window cache ===
+// The controller keeps the last CASET/PASET ranges until they are overwritten,
+// so only the half of the window that actually changed has to be sent.
+// Anything that may change the window behind our back must invalidate the cache.
+typedef struct {
+    uint16_t x1;
+    uint16_t x2;
+    uint16_t y1;
+    uint16_t y2;
+    uint8_t col_valid;
+    uint8_t row_valid;
+} tft_addrwin_t;
+
+static DRAM_ATTR tft_addrwin_t tft_addrwin = {0};
+
+// Window set by the last window operation, sent with the next fill, send or read
+static tft_addrwin_t tft_spi_window = {0};
+
+//------------------------------------------------------
+static void IRAM_ATTR disp_spi_invalidate_addrwin_cache() {
+    tft_addrwin.col_valid = 0;
+    tft_addrwin.row_valid = 0;
+}
+
+// Invalidate the window cache if 'cmd' changes the window or the address mapping
+//-------------------------------------------------------
+static void IRAM_ATTR disp_spi_addrwin_check_cmd(uint8_t cmd) {
+    if ((cmd == TFT_CASET) || (cmd == TFT_PASET) || (cmd == TFT_MADCTL) || (cmd == TFT_CMD_SWRESET)) {
+        disp_spi_invalidate_addrwin_cache();
+    }
+}
+
+// Returns 1 if the column range has to be sent and updates the cache
+//------------------------------------------------------------------------------
+static inline uint8_t IRAM_ATTR disp_spi_addrwin_col_changed(uint16_t x1, uint16_t x2) {
+    if (tft_addrwin.col_valid && (tft_addrwin.x1 == x1) && (tft_addrwin.x2 == x2)) return 0;
+    tft_addrwin.x1 = x1;
+    tft_addrwin.x2 = x2;
+    tft_addrwin.col_valid = 1;
+    return 1;
+}
+
+// Returns 1 if the row range has to be sent and updates the cache
+//------------------------------------------------------------------------------
+static inline uint8_t IRAM_ATTR disp_spi_addrwin_row_changed(uint16_t y1, uint16_t y2) {
+    if (tft_addrwin.row_valid && (tft_addrwin.y1 == y1) && (tft_addrwin.y2 == y2)) return 0;
+    tft_addrwin.y1 = y1;
+    tft_addrwin.y2 = y2;
+    tft_addrwin.row_valid = 1;
+    return 1;
+}
+
+// 1 while the display device holds the bus
+static uint8_t tft_spi_bus_acquired = 0;
+
+//-------------------------------------------
+static esp_err_t disp_spi_acquire() {
+    esp_err_t ret = tft_sched_acquire(TFT_SCHED_DISPLAY);
+    if (ret == ESP_OK) tft_spi_bus_acquired = 1;
+    return ret;
+}
+
+//------------------------------
+static void disp_spi_release() {
+    // all queued transactions must be finished before the bus is released
+    disp_spi_flush();
+    tft_sched_release(TFT_SCHED_DISPLAY);
+    tft_spi_bus_acquired = 0;
+}
+
+// === Streams of several chunks ===
+// Without an acquired bus the spi driver lets a touch transaction wait until the display queue
+// is empty, which is the end of the stream. When a touch controller shares the bus, a stream
+// therefore holds the bus, so the scheduler can hand it over between the chunks;
+// it is finished before the backend returns.
+//----------------------------------------------
+static uint8_t IRAM_ATTR disp_spi_stream_begin() {
+    if ((tft_spi_bus_acquired) || (tft_ts_spi == NULL)) return 0;
+    return (disp_spi_acquire() == ESP_OK);
+}
+
+//-------------------------------------------------------
+static void IRAM_ATTR disp_spi_stream_end(uint8_t held) {
+    if (held) disp_spi_release();
+}
+
+// Safe point between two chunks of a RAMWR stream: give the bus to the touch controller
+// if the scheduler says so. The controller continues the memory write after CS was high,
+// as it does between the queued transactions anyway.
+//--------------------------------------------
+static void IRAM_ATTR disp_spi_yield_point() {
+    if ((tft_spi_bus_acquired) && (tft_sched_yield_due(TFT_SCHED_DISPLAY))) {
+        disp_spi_flush();
+        tft_sched_yield(TFT_SCHED_DISPLAY);
+    }
+}
+
+// Send 1 byte display command
+//------------------------------------------------
+//Due to this being implemented as a blocking polling transaction,
+//all queued transactions are finished first.
+//As with the other functions, this function may never be called while it has not returned in another context.
+static void IRAM_ATTR disp_spi_cmd(uint8_t cmd) {
+    static spi_transaction_t command_transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .user = &tft_spi_user_command,
+        .length = 8,
+        .tx_data = {0},
+        .rx_buffer = NULL,
+    };
+    command_transaction.tx_data[0] = cmd;
+    disp_spi_addrwin_check_cmd(cmd);
+    disp_spi_flush();
+
+    esp_err_t ret = disp_spi_polling_transmit(&command_transaction);
+    ESP_ERROR_CHECK(ret);
+}
+
+// Send command with data to display
+//----------------------------------------------------------------------------------
+//This is implemented with blocking polling transactions,
+//all queued transactions are finished first.
+static void IRAM_ATTR disp_spi_cmd_data(uint8_t cmd, const uint8_t *data, uint32_t len) {
+    esp_err_t ret;
+
+    disp_spi_flush();
+
+    //Command sending transaction
+    static spi_transaction_t command_transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .user = &tft_spi_user_command,
+        .length = 8,
+        .tx_data = {0},
+        .rx_buffer = NULL,
+    };
+    command_transaction.tx_data[0] = cmd;
+    disp_spi_addrwin_check_cmd(cmd);
+    ret = disp_spi_polling_transmit(&command_transaction);
+    ESP_ERROR_CHECK(ret);
+
+    //Data sending transaction
+    if ((len == 0) || (data == NULL)) return; //skip if no data is to be sent
+    static spi_transaction_t data_transaction = {
+        .flags = 0,
+        .user = &tft_spi_user_data,
+        .rx_buffer = NULL,
+    };
+    data_transaction.length = 8 * len;
+    data_transaction.tx_buffer = data;
+
+    ret = disp_spi_polling_transmit(&data_transaction);
+    ESP_ERROR_CHECK(ret);
+}
+
+// Set the address window for display write & read commands
+//---------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_transfer_addrwin_start(uint16_t x1, uint16_t x2, uint16_t y1, uint16_t y2) {
+    // This function sets the address window by first sending a command to set the collumn range
+    // and then a command to send the row range
+    // separate transactions are used, to be able to set the controllers command pin
+    // through the use of a custom callback
+    // ranges that are already programmed into the controller are skipped
+    uint8_t data[4];
+
+    if (disp_spi_addrwin_col_changed(x1, x2)) {
+        // -- column setting command
+        data[0] = TFT_CASET;
+        disp_spi_queue_txdata(&tft_spi_user_command, data, 1);
+
+        // -- column setting data
+        // Arrange x coordinate window values
+        data[0] = x1 >> 8;
+        data[1] = x1 &  0xff;
+        data[2] = x2 >> 8;
+        data[3] = x2 &  0xff;
+        disp_spi_queue_txdata(&tft_spi_user_data, data, 4);
+    }
+
+    if (disp_spi_addrwin_row_changed(y1, y2)) {
+        // -- row setting command
+        data[0] = TFT_PASET;
+        disp_spi_queue_txdata(&tft_spi_user_command, data, 1);
+
+        // -- row setting data
+        // Arrange y coordinate window values
+        data[0] = y1 >> 8;
+        data[1] = y1 &  0xff;
+        data[2] = y2 >> 8;
+        data[3] = y2 &  0xff;
+        disp_spi_queue_txdata(&tft_spi_user_data, data, 4);
+    }
+}
+
+static void IRAM_ATTR disp_spi_transfer_addrwin_polling(uint16_t x1, uint16_t x2, uint16_t y1, uint16_t y2) {
+    // This function sets the address window by first sending a command to set the collumn range
+    // and then a command to send the row range
+    // separate transactions are used, to be able to set the controllers command pin
+    // through the use of a custom callback
+    // ranges that are already programmed into the controller are skipped
+
+    esp_err_t ret;
+
+    if (disp_spi_addrwin_col_changed(x1, x2)) {
+        // -- column setting command
+
+        static const spi_transaction_t column_setting_command_transaction = {
+            .flags = SPI_TRANS_USE_TXDATA,
+            .user = &tft_spi_user_command,
+            .length = 8,
+            .tx_data = {TFT_CASET, 0, 0, 0},
+            .rx_buffer = NULL,
+        };
+
+        ret = disp_spi_polling_transmit(&column_setting_command_transaction);
+        ESP_ERROR_CHECK(ret);
+
+        // -- column setting data
+        // Arrange x coordinate window values
+        static spi_transaction_t column_setting_data_transaction = {
+            .flags = SPI_TRANS_USE_TXDATA,
+            .user = &tft_spi_user_data,
+            .length = 32,
+            .rx_buffer = NULL,
+        };
+        column_setting_data_transaction.tx_data[0] = x1 >> 8;
+        column_setting_data_transaction.tx_data[1] = x1 &  0xff;
+        column_setting_data_transaction.tx_data[2] = x2 >> 8;
+        column_setting_data_transaction.tx_data[3] = x2 &  0xff;
+
+        ret = disp_spi_polling_transmit(&column_setting_data_transaction);
+        ESP_ERROR_CHECK(ret);
+    }
+
+    if (disp_spi_addrwin_row_changed(y1, y2)) {
+        // -- row setting command
+
+        static const spi_transaction_t row_setting_command_transaction = {
+            .flags = SPI_TRANS_USE_TXDATA,
+            .user = &tft_spi_user_command,
+            .length = 8,
+            .tx_data = {TFT_PASET, 0, 0, 0},
+            .rx_buffer = NULL,
+        };
+
+        ret = disp_spi_polling_transmit(&row_setting_command_transaction);
+        ESP_ERROR_CHECK(ret);
+
+        // -- row setting data
+        // Arrange y coordinate window values
+        static spi_transaction_t row_setting_data_transaction = {
+            .flags = SPI_TRANS_USE_TXDATA,
+            .user = &tft_spi_user_data,
+            .length = 32,
+            .rx_buffer = NULL,
+        };
+        row_setting_data_transaction.tx_data[0] = y1 >> 8;
+        row_setting_data_transaction.tx_data[1] = y1 &  0xff;
+        row_setting_data_transaction.tx_data[2] = y2 >> 8;
+        row_setting_data_transaction.tx_data[3] = y2 &  0xff;
+
+        ret = disp_spi_polling_transmit(&row_setting_data_transaction);
+        ESP_ERROR_CHECK(ret);
+    }
+}
+
+//-------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_window(int x1, int y1, int x2, int y2) {
+    tft_spi_window.x1 = x1;
+    tft_spi_window.y1 = y1;
+    tft_spi_window.x2 = x2;
+    tft_spi_window.y2 = y2;
+}
+
+// === Repeat buffers ===
+// DMA buffers filled with one color each, used for filling areas.
+// UI code usually alternates between few colors (foreground/background),
+// so a small set of buffers is kept and the least recently used one is refilled.
+// The buffers are word arrays, so every buffer is word aligned and can be filled word-wise.
+#define TFT_REPEAT_BUFFER_WORDS ((TFT_REPEAT_BUFFER_SIZE * TFT_PIXEL_BYTES + 3) / 4)
+static DMA_ATTR uint32_t tft_repeat_buffer[TFT_REPEAT_BUFFER_COUNT][TFT_REPEAT_BUFFER_WORDS] = {{0}};
+
+typedef struct {
+    color_t color;
+    uint8_t valid;
+    uint32_t last_use;   // value of tft_repeat_buffer_uses at the last use
+    TFT_fence_t fence;   // the buffer may only be refilled when this fence is done
+} tft_repeat_buffer_info_t;
+
+static tft_repeat_buffer_info_t tft_repeat_buffer_info[TFT_REPEAT_BUFFER_COUNT] = {0};
+static uint32_t tft_repeat_buffer_uses = 0;
+
+// Fill 'words' words of the buffer with the color in the display pixel format,
+// 4 18-bit pixels are exactly 3 words, 2 16-bit pixels one word
+//------------------------------------------------------------------------------------------
+static void IRAM_ATTR repeat_buffer_fill(uint32_t *buf, uint32_t words, color_t color) {
+#if TFT_PIXEL_BYTES == 2
+    uint8_t px[2];
+    TFT_pixel_pack(px, color);
+    uint32_t w = (uint32_t)px[0] | ((uint32_t)px[1] << 8) | ((uint32_t)px[0] << 16) | ((uint32_t)px[1] << 24);
+
+    for (uint32_t i = 0; i < words; i++) buf[i] = w;
+#else
+    uint32_t r = color.r, g = color.g, b = color.b;
+    uint32_t w0 = r | (g << 8) | (b << 16) | (r << 24);
+    uint32_t w1 = g | (b << 8) | (r << 16) | (g << 24);
+    uint32_t w2 = b | (r << 8) | (g << 16) | (b << 24);
+    uint32_t i;
+
+    for (i = 0; (i + 3) <= words; i += 3) {
+        buf[i] = w0;
+        buf[i+1] = w1;
+        buf[i+2] = w2;
+    }
+    if (i < words) buf[i++] = w0;
+    if (i < words) buf[i] = w1;
+#endif
+}
+
+// Get the index of the repeat buffer filled with the color,
+// refills the least recently used buffer if no buffer holds the color
+//-----------------------------------------------------
+static uint8_t IRAM_ATTR repeat_buffer_get(color_t color) {
+    uint8_t idx = 0;
+    tft_repeat_buffer_info_t *info;
+
+    tft_repeat_buffer_uses++;
+    for (uint8_t i = 0; i < TFT_REPEAT_BUFFER_COUNT; i++) {
+        info = &tft_repeat_buffer_info[i];
+        if ((info->valid) && (info->color.r == color.r) && (info->color.g == color.g) && (info->color.b == color.b)) {
+            info->last_use = tft_repeat_buffer_uses;
+            return i;
+        }
+        // unused buffers first, then the least recently used one
+        if (!info->valid) {
+            if (tft_repeat_buffer_info[idx].valid) idx = i;
+        }
+        else if ((tft_repeat_buffer_info[idx].valid) && (info->last_use < tft_repeat_buffer_info[idx].last_use)) idx = i;
+    }
+
+    info = &tft_repeat_buffer_info[idx];
+    // the buffer may still be in use by an earlier fill
+    disp_spi_wait(info->fence);
+    repeat_buffer_fill(tft_repeat_buffer[idx], TFT_REPEAT_BUFFER_WORDS, color);
+    info->color = color;
+    info->valid = 1;
+    info->last_use = tft_repeat_buffer_uses;
+    return idx;
+}
+
+// Queue the window, RAMWR and 'len' times the color
+//------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_queue_color_rep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+    uint8_t cmd = TFT_RAMWR;
+    uint8_t held = (len > TFT_REPEAT_BUFFER_SIZE) ? disp_spi_stream_begin() : 0;
+    disp_spi_transfer_addrwin_start(x1, x2, y1, y2);
+    disp_spi_queue_txdata(&tft_spi_user_command, &cmd, 1);
+
+    if (len == 1) {
+        // a single pixel is sent from the transaction descriptor
+        uint8_t px[TFT_PIXEL_BYTES];
+        TFT_pixel_pack(px, color);
+        disp_spi_queue_txdata(&tft_spi_user_data, px, TFT_PIXEL_BYTES);
+        return;
+    }
+
+    //Select the dma buffer to fill the screen from
+    //if one of the buffers is already filled with the color we want, no refilling is needed
+    uint8_t idx = repeat_buffer_get(color);
+
+    uint32_t still_to_send = len;
+    while (still_to_send >= TFT_REPEAT_BUFFER_SIZE) {
+        still_to_send -= TFT_REPEAT_BUFFER_SIZE;
+        disp_spi_queue_buffer(&tft_spi_user_data, tft_repeat_buffer[idx], TFT_PIXEL_BYTES*TFT_REPEAT_BUFFER_SIZE);
+        disp_spi_yield_point();
+    }
+
+    if (still_to_send > 0) {
+        disp_spi_queue_buffer(&tft_spi_user_data, tft_repeat_buffer[idx], TFT_PIXEL_BYTES*still_to_send);
+    }
+    tft_repeat_buffer_info[idx].fence = tft_trans_queued;
+    disp_spi_stream_end(held);
+}
+
+// === Short runs ===
+// Fills of up to tft_short_run_len pixels are expanded into a small scratch buffer
+// and sent with polling transactions, which is faster than queueing for short runs.
+#define TFT_SHORT_RUN_WORDS ((TFT_SHORT_RUN_BUFFER_SIZE * TFT_PIXEL_BYTES + 3) / 4)
+static DMA_ATTR uint32_t tft_short_run_buffer[TFT_SHORT_RUN_WORDS] = {0};
+
+// Send the window, RAMWR and 'len' times the color with polling transactions
+//---------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_polling_color_rep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+    esp_err_t ret;
+    spi_transaction_t t;
+    static const spi_transaction_t command_transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .user = &tft_spi_user_command,
+        .length = 8,
+        .tx_data = {TFT_RAMWR, 0},
+        .rx_buffer = NULL,
+    };
+
+    disp_spi_flush();
+    disp_spi_transfer_addrwin_polling(x1, x2, y1, y2);
+    ret = disp_spi_polling_transmit(&command_transaction);
+    ESP_ERROR_CHECK(ret);
+    if (len == 0) return;
+
+    memset(&t, 0, sizeof(spi_transaction_t));
+    t.user = &tft_spi_user_data;
+    t.length = len * TFT_PIXEL_BYTES * 8;
+    if (len == 1) {
+        t.flags = SPI_TRANS_USE_TXDATA;
+        TFT_pixel_pack(t.tx_data, color);
+    }
+    else {
+        // the scratch buffer is free again when the polling transaction returns
+        repeat_buffer_fill(tft_short_run_buffer, (len * TFT_PIXEL_BYTES + 3) / 4, color);
+        t.tx_buffer = tft_short_run_buffer;
+    }
+    ret = disp_spi_polling_transmit(&t);
+    ESP_ERROR_CHECK(ret);
+}
+
+#if CONFIG_TFT_DMA_CHAIN_FILL
+// === DMA descriptor chain fill (experimental) ===
+// The spi_master driver builds its DMA descriptors from one contiguous buffer,
+// so a fill has to be split into many transactions.
+// Here one descriptor chain, with all descriptors pointing to the same repeat buffer,
+// is sent as a single transfer by programming the SPI peripheral directly.
+
+#if !CONFIG_IDF_TARGET_ESP32
+#error "CONFIG_TFT_DMA_CHAIN_FILL is only supported on ESP32"
+#endif
+
+// Bytes sent by one descriptor, must be a multiple of the pixel size
+#define TFT_DMA_CHUNK_LEN (((TFT_REPEAT_BUFFER_SIZE * TFT_PIXEL_BYTES) < TFT_DMA_DESC_MAX_LEN) ? (TFT_REPEAT_BUFFER_SIZE * TFT_PIXEL_BYTES) : TFT_DMA_DESC_MAX_LEN)
+// Enough descriptors for a full screen fill
+#define TFT_DMA_CHAIN_LEN (((DEFAULT_TFT_DISPLAY_WIDTH * DEFAULT_TFT_DISPLAY_HEIGHT * TFT_PIXEL_BYTES) + TFT_DMA_CHUNK_LEN - 1) / TFT_DMA_CHUNK_LEN)
+// Maximal length of one SPI transfer in bits
+#define TFT_DMA_MAX_BITS (1 << 24)
+// Time allowed for a transfer: twice its duration at the write clock plus 1 ms, in us
+#define TFT_DMA_CHAIN_TIMEOUT_US(len) ((uint32_t)(((uint64_t)(len) * 16 * 1000000) / DEFAULT_SPI_CLOCK) + 1000)
+
+static DMA_ATTR lldesc_t tft_dma_chain[TFT_DMA_CHAIN_LEN];
+static const char tft_dma_chain_tag[] = "[TFT DMA chain]";
+
+// Send RAMWR and 'len' bytes from the repeat buffer 'buf' to the window with one DMA transfer
+// Returns ESP_ERR_NOT_SUPPORTED if the fill can not be done this way (nothing was sent),
+// ESP_ERR_TIMEOUT if the transfer did not finish in time: it is stopped, the peripheral is left
+// idle for spi_master and the window cache is invalid, the fill has to be sent again
+//--------------------------------------------------------------------------------------------------------
+static esp_err_t IRAM_ATTR disp_dma_chain_fill(int x1, int y1, int x2, int y2, const uint8_t *buf, uint32_t len) {
+    spi_dev_t *hw = (CONFIG_TFT_SPI_HOST == HSPI_HOST) ? &SPI2 : &SPI3;
+    uint8_t acquired = tft_spi_bus_acquired;
+    esp_err_t ret;
+
+    if ((len * 8) > TFT_DMA_MAX_BITS) return ESP_ERR_NOT_SUPPORTED;
+    if (tft_dma_chain_build(tft_dma_chain, TFT_DMA_CHAIN_LEN, buf, TFT_DMA_CHUNK_LEN, len) == 0) return ESP_ERR_NOT_SUPPORTED;
+
+    static const spi_transaction_t command_transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .user = &tft_spi_user_command,
+        .length = 8,
+        .tx_data = {TFT_RAMWR, 0},
+        .rx_buffer = NULL,
+    };
+
+    // Keep the bus, the polling transactions leave the display device configured
+    // and no driver transaction (or its interrupt) is active during the transfer
+    if (!acquired) {
+        ret = disp_spi_acquire();
+        ESP_ERROR_CHECK(ret);
+    }
+    disp_spi_flush();
+    disp_spi_transfer_addrwin_polling(x1, x2, y1, y2);
+    ret = disp_spi_polling_transmit(&command_transaction);
+    ESP_ERROR_CHECK(ret);
+
+    // data phase, keeps the level cache of the transaction callback valid
+    disp_dc_set(1);
+
+    // reset the DMA out link and the FIFO
+    hw->dma_conf.val |= SPI_OUT_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST;
+    hw->dma_conf.val &= ~(SPI_OUT_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST);
+    hw->dma_out_link.start = 0;
+
+    // data phase only
+    hw->user.usr_command = 0;
+    hw->user.usr_addr = 0;
+    hw->user.usr_dummy = 0;
+    hw->user.usr_miso = 0;
+    hw->user.usr_mosi = 1;
+    hw->mosi_dlen.usr_mosi_dbitlen = (len * 8) - 1;
+
+#if CONFIG_TFT_SPI_TRACE
+    if (tft_trace_on) disp_trace_add(TFT_TRACE_DC | TFT_TRACE_DIRECT, len, (uint32_t)buf);
+#endif
+
+    hw->dma_out_link.addr = (uint32_t)tft_dma_chain & 0xFFFFF;
+    hw->dma_out_link.start = 1;
+    hw->cmd.usr = 1;
+
+    ret = ESP_OK;
+    int64_t t_start = esp_timer_get_time();
+    while (hw->cmd.usr) {
+        if ((esp_timer_get_time() - t_start) > TFT_DMA_CHAIN_TIMEOUT_US(len)) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+
+    if (ret == ESP_ERR_TIMEOUT) {
+        // stop the transfer and the DMA, the display gets no more data;
+        // spi_master programs the user registers again for its next transaction
+        hw->cmd.usr = 0;
+        hw->dma_out_link.stop = 1;
+        hw->dma_out_link.start = 0;
+        hw->dma_conf.val |= SPI_OUT_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST;
+        hw->dma_conf.val &= ~(SPI_OUT_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST);
+        hw->dma_out_link.stop = 0;
+        hw->slave.trans_done = 0;
+        // the controller got an unknown part of the window
+        disp_spi_invalidate_addrwin_cache();
+        ESP_LOGW(tft_dma_chain_tag, "fill of %u bytes not finished in %u us, sent again as queued transactions",
+                 (unsigned)len, (unsigned)TFT_DMA_CHAIN_TIMEOUT_US(len));
+    }
+
+    if (!acquired) disp_spi_release();
+    return ret;
+}
+#endif
+
+// Write 'len' times the color to the window
+//-------------------------------------------------------------------------------------------
+// This implementation relies on filling the dma queue with transactions from tft_repeat_buffer
+// if one of the repeat buffers already holds the fill color, the filling of the buffer
+// can be omitted, which speeds up the operation
+// The chunks are streamed through the transaction ring: when TFT_SPI_QUEUE_SIZE transactions
+// are in flight, the oldest one is collected before the next chunk is queued,
+// so the DMA always has work queued while the fill does not depend on the queue size.
+static void IRAM_ATTR disp_spi_fill(color_t color, uint32_t len, uint8_t sync)
+{
+    tft_addrwin_t *win = &tft_spi_window;
+
+    if ((len <= tft_short_run_len) && (len <= TFT_SHORT_RUN_BUFFER_SIZE) && (sync)) {
+        disp_polling_color_rep(win->x1, win->y1, win->x2, win->y2, color, len);
+        return;
+    }
+
+#if CONFIG_TFT_DMA_CHAIN_FILL
+    // a large synchronous fill is sent as one transfer
+    if ((len > TFT_REPEAT_BUFFER_SIZE) && (sync)) {
+        uint8_t idx = repeat_buffer_get(color);
+        esp_err_t ret = disp_dma_chain_fill(win->x1, win->y1, win->x2, win->y2, (const uint8_t *)tft_repeat_buffer[idx], len * TFT_PIXEL_BYTES);
+        if (ret == ESP_OK) return;
+        // not possible or stopped on the timeout, the fill is queued
+    }
+#endif
+
+    disp_queue_color_rep(win->x1, win->y1, win->x2, win->y2, color, len);
+}
+
+// Queue the window, RAMWR and 'len' pixels from 'pixels',
+// in chunks of TFT_SEND_CHUNK_PIXELS which fit into max_transfer_sz of the bus
+//--------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_send(const uint8_t *pixels, uint32_t len) {
+    uint8_t cmd = TFT_RAMWR;
+    uint8_t held = (len > TFT_SEND_CHUNK_PIXELS) ? disp_spi_stream_begin() : 0;
+    disp_spi_transfer_addrwin_start(tft_spi_window.x1, tft_spi_window.x2, tft_spi_window.y1, tft_spi_window.y2);
+    disp_spi_queue_txdata(&tft_spi_user_command, &cmd, 1);
+
+    while (len > 0) {
+        uint32_t chunk = (len < TFT_SEND_CHUNK_PIXELS) ? len : TFT_SEND_CHUNK_PIXELS;
+        disp_spi_queue_buffer(&tft_spi_user_data, pixels, TFT_PIXEL_BYTES * chunk);
+        pixels += TFT_PIXEL_BYTES * chunk;
+        len -= chunk;
+        if (len > 0) disp_spi_yield_point();
+    }
+    disp_spi_stream_end(held);
+}
+
+// === Staging buffers ===
+// Colors are converted into these buffers, so the caller's buffer is never changed.
+// The chunks are queued one after the other after a single RAMWR,
+// while one buffer is on the wire the next chunk is converted into the other one.
+#define TFT_STAGE_WORDS ((TFT_STAGE_BUFFER_SIZE * TFT_PIXEL_BYTES + 3) / 4)
+static DMA_ATTR uint32_t tft_stage_buffer[2][TFT_STAGE_WORDS] = {{0}};
+static TFT_fence_t tft_stage_fence[2] = {0};
+static uint8_t tft_stage_idx = 0;
+
+// Queue the window, RAMWR and 'len' colors from 'colors' converted through the staging buffers
+//-----------------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_send_colors(const color_t *colors, uint32_t len) {
+    uint8_t cmd = TFT_RAMWR;
+    uint8_t held = (len > TFT_STAGE_BUFFER_SIZE) ? disp_spi_stream_begin() : 0;
+    disp_spi_transfer_addrwin_start(tft_spi_window.x1, tft_spi_window.x2, tft_spi_window.y1, tft_spi_window.y2);
+    disp_spi_queue_txdata(&tft_spi_user_command, &cmd, 1);
+
+    while (len > 0) {
+        uint32_t chunk = (len < TFT_STAGE_BUFFER_SIZE) ? len : TFT_STAGE_BUFFER_SIZE;
+        uint8_t *buf = (uint8_t *)tft_stage_buffer[tft_stage_idx];
+
+        // the buffer may still be in use by the previous chunk
+        disp_spi_wait(tft_stage_fence[tft_stage_idx]);
+        TFT_pixels_store(buf, colors, chunk);
+        disp_spi_queue_buffer(&tft_spi_user_data, buf, TFT_PIXEL_BYTES * chunk);
+        tft_stage_fence[tft_stage_idx] = tft_trans_queued;
+        tft_stage_idx ^= 1;
+
+        colors += chunk;
+        len -= chunk;
+        if (len > 0) disp_spi_yield_point();
+    }
+    disp_spi_stream_end(held);
+}
+
+// Queue the window, RAMWR and the 'w' x 'h' pixels at 'pixels' (rows 'stride' pixels apart),
+// copied through the staging buffers: the DMA can't read PSRAM and the rows are not contiguous
+//-----------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_spi_send_rect(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    uint8_t cmd = TFT_RAMWR;
+    uint32_t len = w * h;
+    uint32_t x = 0;     // next pixel of the current row
+    uint8_t held = (len > TFT_STAGE_BUFFER_SIZE) ? disp_spi_stream_begin() : 0;
+    disp_spi_transfer_addrwin_start(tft_spi_window.x1, tft_spi_window.x2, tft_spi_window.y1, tft_spi_window.y2);
+    disp_spi_queue_txdata(&tft_spi_user_command, &cmd, 1);
+
+    while (len > 0) {
+        uint32_t chunk = (len < TFT_STAGE_BUFFER_SIZE) ? len : TFT_STAGE_BUFFER_SIZE;
+        uint8_t *buf = (uint8_t *)tft_stage_buffer[tft_stage_idx];
+
+        disp_spi_wait(tft_stage_fence[tft_stage_idx]);
+        for (uint32_t n = 0; n < chunk; ) {
+            uint32_t run = w - x;
+            if (run > (chunk - n)) run = chunk - n;
+            memcpy(buf + (n * TFT_PIXEL_BYTES), pixels + (x * TFT_PIXEL_BYTES), run * TFT_PIXEL_BYTES);
+            n += run;
+            x += run;
+            if (x == w) {
+                x = 0;
+                pixels += stride * TFT_PIXEL_BYTES;
+            }
+        }
+        disp_spi_queue_buffer(&tft_spi_user_data, buf, TFT_PIXEL_BYTES * chunk);
+        tft_stage_fence[tft_stage_idx] = tft_trans_queued;
+        tft_stage_idx ^= 1;
+
+        len -= chunk;
+        if (len > 0) disp_spi_yield_point();
+    }
+    disp_spi_stream_end(held);
+}
+
+// === Read device ===
+// GRAM reads need a lower clock than writes, the spi_master driver has a fixed clock per device,
+// so reads use their own device on the display bus. It has no CS pin of its own,
+// the display CS pin is switched from the write device to a GPIO for the read.
+static spi_host_device_t tft_rd_host = HSPI_HOST;
+// CS signal of the write device, found by TFT_read_device_init()
+static uint32_t tft_disp_cs_signal = SIG_GPIO_OUT_IDX;
+
+// The CS signal the GPIO matrix routes to the display CS pin, the write device can use any CS slot of the host.
+// If the pin is routed to none of them, it is the native CS0 pin of the host connected through the IO_MUX
+//-------------------------------------------------------------
+static uint32_t disp_cs_signal_find(spi_host_device_t host) {
+    uint32_t sig = GPIO.func_out_sel_cfg[PIN_NUM_CS].func_sel;
+
+    for (size_t i = 0; i < sizeof(spi_periph_signal[host].spics_out); i++) {
+        if (sig == spi_periph_signal[host].spics_out[i]) return sig;
+    }
+    return spi_periph_signal[host].spics_out[0];
+}
+
+// Connect the display CS pin to a GPIO driven low (manual=1)
+// or back to the CS signal of the write device (manual=0)
+//----------------------------------------------
+static void IRAM_ATTR disp_cs_manual(uint8_t manual) {
+    gpio_set_level(PIN_NUM_CS, 1);
+    if (manual) {
+        // an IO_MUX pin only follows the GPIO matrix with the GPIO function selected,
+        // it stays connected through the matrix afterwards
+        gpio_pad_select_gpio(PIN_NUM_CS);
+        gpio_matrix_out(PIN_NUM_CS, SIG_GPIO_OUT_IDX, false, false);
+        gpio_set_level(PIN_NUM_CS, 0);
+    }
+    else gpio_matrix_out(PIN_NUM_CS, tft_disp_cs_signal, false, false);
+}
+
+// Send the transaction with the read device, CS stays active for the whole transaction
+//-----------------------------------------------------------------
+static esp_err_t IRAM_ATTR disp_spi_read_transmit(spi_transaction_t *t) {
+    esp_err_t ret;
+
+    // hand the bus over to the read device, the display has no transaction in flight
+    if (tft_spi_bus_acquired) tft_sched_release(TFT_SCHED_DISPLAY);
+    ret = tft_sched_acquire(TFT_SCHED_DISPLAY_READ);
+    if (ret == ESP_OK) {
+        disp_cs_manual(1);
+        disp_trace_trans(t, TFT_TRACE_READ);
+        ret = spi_device_polling_transmit(tft_disp_rd_spi, t);
+        disp_cs_manual(0);
+        tft_sched_release(TFT_SCHED_DISPLAY_READ);
+    }
+    if (tft_spi_bus_acquired) {
+        esp_err_t res = tft_sched_acquire(TFT_SCHED_DISPLAY);
+        if (ret == ESP_OK) ret = res;
+    }
+    return ret;
+}
+
+// Read 'len' pixels of the window with the read device into 'dst'
+// command, dummy clocks and data are one transaction
+//----------------------------------------------------------------
+static esp_err_t IRAM_ATTR disp_spi_read(uint8_t *dst, uint32_t len) {
+    spi_transaction_t t;
+
+    if (tft_disp_rd_spi == NULL) return ESP_ERR_INVALID_STATE;
+
+    // reads are rare, always send the full window so they never depend on the cache
+    disp_spi_flush();
+    disp_spi_invalidate_addrwin_cache();
+    disp_spi_transfer_addrwin_polling(tft_spi_window.x1, tft_spi_window.x2, tft_spi_window.y1, tft_spi_window.y2);
+
+    memset(&t, 0, sizeof(t));
+    t.cmd       = TFT_RAMRD;
+    t.length    = 0;
+    t.rxlength  = 8 * len * 3;
+    t.rx_buffer = dst;
+    t.user      = &tft_spi_user_command;
+    return disp_spi_read_transmit(&t);
+}
+
+// Add (or replace) the read device with the given clock
+//==========================================================================
+esp_err_t TFT_read_device_init(spi_host_device_t host, uint32_t clock) {
+    esp_err_t ret;
+
+    if (PIN_NUM_MISO < 0) return ESP_ERR_NOT_SUPPORTED;
+
+    spi_device_interface_config_t rdcfg = {
+        .command_bits = 8,                      // RAMRD is the command phase
+        .address_bits = 0,
+        .dummy_bits = TFT_READ_DUMMY_BITS,      // dummy clocks before the first pixel
+        .mode = 0,
+        .clock_speed_hz = clock,
+        .spics_io_num = -1,                     // CS is driven by disp_cs_manual()
+        .flags = SPI_DEVICE_HALFDUPLEX,
+        .queue_size = 1,
+        .pre_cb = &TFT_transaction_begin_callback,
+        .post_cb = NULL,
+    };
+
+    if (tft_disp_rd_spi) {
+        ret = spi_bus_remove_device(tft_disp_rd_spi);
+        if (ret != ESP_OK) return ret;
+        tft_disp_rd_spi = NULL;
+    }
+    ret = spi_bus_add_device(host, &rdcfg, &tft_disp_rd_spi);
+    if (ret != ESP_OK) {
+        tft_disp_rd_spi = NULL;
+        return ret;
+    }
+    tft_rd_host = host;
+    tft_disp_cs_signal = disp_cs_signal_find(host);
+    tft_max_rdclock = clock;
+    return ESP_OK;
+}
+
+// Pattern written by find_rd_speed(), the low 2 bits are not compared (18-bit colors),
+// the low 3 bits of red and blue neither with 16-bit pixels
+#define TFT_RD_PATTERN_LEN 16
+static color_t tft_rd_pattern[TFT_RD_PATTERN_LEN];
+static DMA_ATTR uint8_t tft_rd_pattern_pixels[TFT_RD_PATTERN_LEN * TFT_PIXEL_BYTES];
+#if TFT_PIXEL_BYTES == 2
+static const uint8_t tft_rd_mask[3] = {0xF8, 0xFC, 0xF8};
+#else
+static const uint8_t tft_rd_mask[3] = {0xFC, 0xFC, 0xFC};
+#endif
+
+// Find the highest read clock at which the pattern is read back correctly twice
+// and set tft_max_rdclock to it. Draws to the top left display corner, which is cleared afterwards.
+//======================
+uint32_t find_rd_speed() {
+    uint8_t color_buf[(TFT_RD_PATTERN_LEN * sizeof(color_t)) + 1];
+    int x1 = TFT_STATIC_WIDTH_OFFSET, y1 = TFT_STATIC_HEIGHT_OFFSET;
+    int x2 = x1 + TFT_RD_PATTERN_LEN - 1;
+    uint32_t found = 0;
+
+    if (tft_disp_rd_spi == NULL) return 0;
+
+    for (int n = 0; n < TFT_RD_PATTERN_LEN; n++) {
+        tft_rd_pattern[n].r = n << 4;
+        tft_rd_pattern[n].g = 0xFC - (n << 4);
+        tft_rd_pattern[n].b = (n * 0x94) & 0xFC;
+        // packed without gray scale conversion
+        TFT_pixel_pack(tft_rd_pattern_pixels + (n * TFT_PIXEL_BYTES), tft_rd_pattern[n]);
+    }
+    TFT_wait(send_pixels_start(x1, y1, x2, y1, TFT_RD_PATTERN_LEN, tft_rd_pattern_pixels));
+
+    // the spi clock is 80 MHz divided by an integer
+    for (uint32_t div = 2; (div <= 80) && (found == 0); div++) {
+        uint32_t clock = 80000000 / div;
+        uint8_t ok = 1;
+
+        if (TFT_read_device_init(tft_rd_host, clock) != ESP_OK) break;
+        for (int pass = 0; (pass < 2) && (ok); pass++) {
+            if (read_data(x1, y1, x2, y1, TFT_RD_PATTERN_LEN, color_buf, 1) != ESP_OK) ok = 0;
+            for (int n = 0; (n < (TFT_RD_PATTERN_LEN * 3)) && (ok); n++) {
+                if ((color_buf[n+1] & tft_rd_mask[n % 3]) != (((uint8_t *)tft_rd_pattern)[n] & tft_rd_mask[n % 3])) ok = 0;
+            }
+        }
+        if (ok) found = clock;
+    }
+
+    TFT_pushColorRep(x1, y1, x2, y1, (color_t){0,0,0}, TFT_RD_PATTERN_LEN);
+
+    // if no clock works, the slowest one is used
+    TFT_read_device_init(tft_rd_host, (found) ? found : 1000000);
+    return found;
+}
+
+// Time 'reps' black fills of 'len' pixels at the top left of the display, in us
+//----------------------------------------------------------------------------------
+static int64_t short_run_time(uint32_t len, uint8_t polling, int reps) {
+    int x1 = TFT_STATIC_WIDTH_OFFSET, y1 = TFT_STATIC_HEIGHT_OFFSET;
+    int x2 = x1 + tft_width - 1, y2 = y1 + tft_height - 1;
+    int64_t t_start = esp_timer_get_time();
+
+    for (int n = 0; n < reps; n++) {
+        if (polling) disp_polling_color_rep(x1, y1, x2, y2, (color_t){0,0,0}, len);
+        else {
+            disp_queue_color_rep(x1, y1, x2, y2, (color_t){0,0,0}, len);
+            disp_spi_flush();
+        }
+        // the next fill must send its window again, as it does after drawing something else
+        disp_spi_invalidate_addrwin_cache();
+    }
+    return esp_timer_get_time() - t_start;
+}
+
+// Find the longest fill which is sent faster with polling transactions than queued
+// and set tft_short_run_len to it. Draws to the display, which is cleared afterwards.
+//-------------------------------------
+static void calibrate_short_runs() {
+    const int reps = 8;
+    uint32_t fast = 0, slow = 1;
+
+    // double the length until queueing wins, then bisect between the last two lengths
+    while ((slow <= TFT_SHORT_RUN_BUFFER_SIZE) && (short_run_time(slow, 1, reps) <= short_run_time(slow, 0, reps))) {
+        fast = slow;
+        slow *= 2;
+    }
+    if (slow > TFT_SHORT_RUN_BUFFER_SIZE) slow = TFT_SHORT_RUN_BUFFER_SIZE + 1;
+    while ((slow - fast) > 1) {
+        uint32_t len = (fast + slow) / 2;
+        if (short_run_time(len, 1, reps) <= short_run_time(len, 0, reps)) fast = len;
+        else slow = len;
+    }
+    tft_short_run_len = fast;
+}
+
+// ==== spi_master backend ====================================
+const tft_bus_t tft_bus_spi = {
+    .name = "spi_master",
+    .acquire = disp_spi_acquire,
+    .release = disp_spi_release,
+    .init = calibrate_short_runs,
+    .invalidate = disp_spi_invalidate_addrwin_cache,
+    .cmd = disp_spi_cmd,
+    .cmd_data = disp_spi_cmd_data,
+    .window = disp_spi_window,
+    .fill = disp_spi_fill,
+    .send = disp_spi_send,
+    .send_colors = disp_spi_send_colors,
+    .send_rect = disp_spi_send_rect,
+    .read = disp_spi_read,
+    .fence = disp_spi_fence,
+    .wait = disp_spi_wait,
+    .fence_done = disp_spi_fence_done,
+    .flush = NULL,
+};
@@ -0,0 +1,327 @@
+/*
+ *
+ * CANVAS DISPLAY BUS BACKEND
+ *
+ * While a canvas is selected, 'tft_bus' points to tft_bus_canvas: the windows,
+ * fills and pixel sends of the drawing functions are written into the canvas
+ * memory instead of the display, so every primitive, font and image function
+ * renders into it unchanged. The display window and the display size are those
+ * of the canvas meanwhile.
+ *
+ * TFT_blitCanvas() sends a canvas to the display with one window and RAMWR.
+ * A canvas in DMA capable memory with contiguous rows is sent by the bus straight
+ * from its memory, others are copied through the staging buffers.
+ *
+*/
+
+#include <string.h>
+#include "tft.h"
+#include "tft_bus.h"
+#include "esp_heap_caps.h"
+
+// ====================================================
+
+typedef struct {
+    int16_t x1;
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+} canvas_rect_t;
+
+static const TFT_canvas_t *canvas_cur = NULL;   // selected canvas
+static const tft_bus_t *canvas_target = NULL;   // backend used before the canvas was selected
+static canvas_rect_t canvas_window = {0};        // window of the next write, canvas coordinates
+
+// Drawing state of the display, restored by TFT_canvas_end()
+static dispWin_t canvas_disp_win;
+static int canvas_disp_width;
+static int canvas_disp_height;
+static uint8_t canvas_scroll_active;
+
+// Called with each run of pixels a write or read covers in the canvas,
+// 'first' is the index of the run's first pixel in the transfer
+typedef void (*canvas_run_op_t)(uint8_t *dst, uint32_t first, uint32_t n, void *arg);
+
+// ==== Window access ====
+
+// Call 'op' for the canvas runs of 'len' pixels written to or read from the window,
+// row by row as the controller addresses them; pixels outside of the canvas are skipped
+//---------------------------------------------------------------------------
+static void canvas_window_runs(uint32_t len, canvas_run_op_t op, void *arg) {
+    const TFT_canvas_t *c = canvas_cur;
+    canvas_rect_t *win = &canvas_window;
+    uint32_t w = win->x2 - win->x1 + 1;
+    uint32_t first = 0;
+    int x1 = (win->x1 < 0) ? 0 : win->x1;
+
+    for (int y = win->y1; (len > 0) && (y <= win->y2); y++) {
+        uint32_t n = (len < w) ? len : w;
+        int x2 = win->x1 + n - 1;
+        if (x2 >= c->width) x2 = c->width - 1;
+
+        if ((y >= 0) && (y < c->height) && (x2 >= x1)) {
+            op(c->pixels + (((y * c->stride) + x1) * TFT_PIXEL_BYTES), first + (x1 - win->x1), x2 - x1 + 1, arg);
+        }
+        first += n;
+        len -= n;
+    }
+}
+
+//----------------------------------------------------------------------------------
+static void canvas_fill_run(uint8_t *dst, uint32_t first, uint32_t n, void *arg) {
+    (void)first;
+    // the run is doubled with every copy
+    memcpy(dst, arg, TFT_PIXEL_BYTES);
+    for (uint32_t done = 1; done < n; ) {
+        uint32_t copy = ((n - done) < done) ? (n - done) : done;
+        memcpy(dst + (done * TFT_PIXEL_BYTES), dst, copy * TFT_PIXEL_BYTES);
+        done += copy;
+    }
+}
+
+//----------------------------------------------------------------------------------
+static void canvas_send_run(uint8_t *dst, uint32_t first, uint32_t n, void *arg) {
+    memcpy(dst, (const uint8_t *)arg + (first * TFT_PIXEL_BYTES), n * TFT_PIXEL_BYTES);
+}
+
+//-----------------------------------------------------------------------------------------
+static void canvas_send_colors_run(uint8_t *dst, uint32_t first, uint32_t n, void *arg) {
+    TFT_pixels_store(dst, (const color_t *)arg + first, n);
+}
+
+// 3 bytes per pixel with 6 significant bits, as the controller sends them
+//----------------------------------------------------------------------------------
+static void canvas_read_run(uint8_t *src, uint32_t first, uint32_t n, void *arg) {
+    uint8_t *dst = (uint8_t *)arg + (first * 3);
+    for (uint32_t i = 0; i < n; i++, src += TFT_PIXEL_BYTES, dst += 3) {
+#if TFT_PIXEL_BYTES == 2
+        dst[0] = src[0] & 0xF8;
+        dst[1] = ((src[0] << 5) | (src[1] >> 3)) & 0xFC;
+        dst[2] = (src[1] << 3) & 0xF8;
+#else
+        dst[0] = src[0] & 0xFC;
+        dst[1] = src[1] & 0xFC;
+        dst[2] = src[2] & 0xFC;
+#endif
+    }
+}
+
+// ==== Backend operations ====
+
+//----------------------------------
+static esp_err_t canvas_acquire() {
+    // drawing into memory does not need the bus
+    return ESP_OK;
+}
+
+//--------------------------
+static void canvas_release() {
+}
+
+//-----------------------------
+static void canvas_invalidate() {
+    canvas_target->invalidate();
+}
+
+// Commands go to the display, the canvas is not affected
+//---------------------------------
+static void canvas_cmd(uint8_t cmd) {
+    canvas_target->cmd(cmd);
+}
+
+//-----------------------------------------------------------------------------
+static void canvas_cmd_data(uint8_t cmd, const uint8_t *data, uint32_t len) {
+    canvas_target->cmd_data(cmd, data, len);
+}
+
+//-----------------------------------------------------------
+static void canvas_set_window(int x1, int y1, int x2, int y2) {
+    canvas_window.x1 = x1 - TFT_STATIC_X_OFFSET;
+    canvas_window.y1 = y1 - TFT_STATIC_Y_OFFSET;
+    canvas_window.x2 = x2 - TFT_STATIC_X_OFFSET;
+    canvas_window.y2 = y2 - TFT_STATIC_Y_OFFSET;
+}
+
+//----------------------------------------------------------------
+static void canvas_fill(color_t color, uint32_t len, uint8_t sync) {
+    (void)sync;
+    uint8_t pixel[TFT_PIXEL_BYTES];
+    TFT_pixel_pack(pixel, color);
+    canvas_window_runs(len, canvas_fill_run, pixel);
+}
+
+//------------------------------------------------------------
+static void canvas_send(const uint8_t *pixels, uint32_t len) {
+    canvas_window_runs(len, canvas_send_run, (void *)pixels);
+}
+
+//-----------------------------------------------------------------
+static void canvas_send_colors(const color_t *colors, uint32_t len) {
+    canvas_window_runs(len, canvas_send_colors_run, (void *)colors);
+}
+
+//-----------------------------------------------------------------------------------------------
+static void canvas_send_rect(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    canvas_rect_t win = canvas_window;
+    for (uint32_t y = 0; y < h; y++, pixels += stride * TFT_PIXEL_BYTES) {
+        canvas_window.y1 = win.y1 + y;
+        canvas_window.y2 = canvas_window.y1;
+        canvas_window_runs(w, canvas_send_run, (void *)pixels);
+    }
+    canvas_window = win;
+}
+
+//--------------------------------------------------------
+static esp_err_t canvas_read(uint8_t *dst, uint32_t len) {
+    memset(dst, 0, 3 * len);
+    canvas_window_runs(len, canvas_read_run, dst);
+    return ESP_OK;
+}
+
+// Drawing into memory is finished when the call returns
+//-------------------------------
+static TFT_fence_t canvas_fence() {
+    return 0;
+}
+
+//-----------------------------------------
+static void canvas_wait(TFT_fence_t fence) {
+    (void)fence;
+}
+
+//---------------------------------------------------
+static uint8_t canvas_fence_done(TFT_fence_t fence) {
+    (void)fence;
+    return 1;
+}
+
+// The canvas is sent by TFT_blitCanvas()
+//-----------------------
+static void canvas_flush() {
+}
+
+// ==== Canvas backend ========================================
+const tft_bus_t tft_bus_canvas = {
+    .name = "canvas",
+    .acquire = canvas_acquire,
+    .release = canvas_release,
+    .init = NULL,
+    .invalidate = canvas_invalidate,
+    .cmd = canvas_cmd,
+    .cmd_data = canvas_cmd_data,
+    .window = canvas_set_window,
+    .fill = canvas_fill,
+    .send = canvas_send,
+    .send_colors = canvas_send_colors,
+    .send_rect = canvas_send_rect,
+    .read = canvas_read,
+    .fence = canvas_fence,
+    .wait = canvas_wait,
+    .fence_done = canvas_fence_done,
+    .flush = canvas_flush,
+};
+
+//======================================================================
+esp_err_t TFT_canvas_create(TFT_canvas_t *canvas, int width, int height) {
+    if ((width <= 0) || (height <= 0)) return ESP_ERR_INVALID_ARG;
+
+    size_t size = (size_t)width * height * TFT_PIXEL_BYTES;
+    uint8_t dma = 1;
+    uint8_t *pixels = NULL;
+
+    // small canvases in internal RAM, where the bus can send them without a copy
+    if (size <= TFT_FB_DRAM_MAX) pixels = heap_caps_malloc(size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    if (pixels == NULL) {
+        pixels = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        dma = 0;
+    }
+    if (pixels == NULL) return ESP_ERR_NO_MEM;
+    memset(pixels, 0, size);
+
+    canvas->width = width;
+    canvas->height = height;
+    canvas->stride = width;
+    canvas->format = TFT_CANVAS_DISPLAY_FORMAT;
+    canvas->dma = dma;
+    canvas->pixels = pixels;
+    return ESP_OK;
+}
+
+//==============================================
+void TFT_canvas_delete(TFT_canvas_t *canvas) {
+    if (canvas == canvas_cur) TFT_canvas_end();
+    heap_caps_free(canvas->pixels);
+    canvas->pixels = NULL;
+}
+
+//=====================================================
+esp_err_t TFT_canvas_begin(const TFT_canvas_t *canvas) {
+    if (canvas_cur != NULL) return ESP_ERR_INVALID_STATE;
+    if (canvas->format != TFT_CANVAS_DISPLAY_FORMAT) return ESP_ERR_NOT_SUPPORTED;
+    if ((canvas->pixels == NULL) || (canvas->width <= 0) || (canvas->height <= 0) || (canvas->stride < canvas->width)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // pixels waiting in the coalescer still go to the display
+    TFT_wait(TFT_fence());
+    canvas_target = tft_bus;
+    canvas_cur = canvas;
+    canvas_disp_win = tft_dispWin;
+    canvas_disp_width = tft_width;
+    canvas_disp_height = tft_height;
+    canvas_scroll_active = tft_scroll.active;
+
+    // the canvas is drawn to as if it was the display
+    tft_width = canvas->width;
+    tft_height = canvas->height;
+    TFT_resetclipwin();
+    tft_scroll.active = 0;
+    tft_bus = &tft_bus_canvas;
+    return ESP_OK;
+}
+
+//=====================
+void TFT_canvas_end() {
+    if (canvas_cur == NULL) return;
+
+    // pixels waiting in the coalescer belong to the canvas
+    TFT_fence();
+    tft_bus = canvas_target;
+    tft_width = canvas_disp_width;
+    tft_height = canvas_disp_height;
+    tft_dispWin = canvas_disp_win;
+    tft_scroll.active = canvas_scroll_active;
+    canvas_cur = NULL;
+}
+
+//================================================================
+esp_err_t TFT_blitCanvas(const TFT_canvas_t *canvas, int x, int y) {
+    if (canvas_cur != NULL) return ESP_ERR_INVALID_STATE;
+    if (canvas->format != TFT_CANVAS_DISPLAY_FORMAT) return ESP_ERR_NOT_SUPPORTED;
+
+    int cx = x + tft_dispWin.x1;
+    int cy = y + tft_dispWin.y1;
+    int x1 = cx, y1 = cy;
+    int x2 = cx + canvas->width - 1, y2 = cy + canvas->height - 1;
+
+    // clipping, only the part inside the display window is sent
+    if (x1 < tft_dispWin.x1) x1 = tft_dispWin.x1;
+    if (y1 < tft_dispWin.y1) y1 = tft_dispWin.y1;
+    if (x2 > tft_dispWin.x2) x2 = tft_dispWin.x2;
+    if (y2 > tft_dispWin.y2) y2 = tft_dispWin.y2;
+    if ((x2 < x1) || (y2 < y1)) return ESP_OK;
+
+    uint32_t w = x2 - x1 + 1;
+    uint32_t h = y2 - y1 + 1;
+    const uint8_t *pixels = canvas->pixels + ((((y1 - cy) * canvas->stride) + (x1 - cx)) * TFT_PIXEL_BYTES);
+
+    esp_err_t ret = disp_select();
+    if (ret != ESP_OK) return ret;
+    if ((canvas->dma) && (w == (uint32_t)canvas->stride)) {
+        // contiguous rows are sent straight from the canvas, which must not change until they are
+        TFT_wait(send_pixels_start(x1, y1, x2, y2, w * h, pixels));
+    }
+    else send_rect_pixels(x1, y1, w, h, pixels, canvas->stride);
+    disp_deselect();
+    return ESP_OK;
+}
@@ -0,0 +1,188 @@
+/*
+ *
+ * FRAME DIFFER
+ *
+ * Compares a newly rendered region with a shadow copy of what the display
+ * shows and sends only the pixels that changed. The rows are compared 32 bits
+ * at a time (byte by byte if the two buffers are not aligned alike), an
+ * unchanged row is done after one pass. Equal changed spans of consecutive
+ * rows become one rectangle, so a changed block costs one window setup.
+ * Spans are not joined across unchanged pixels: that seldom lines up with the row
+ * above, the framebuffer merges the rectangles with its rectangle cost instead.
+ *
+*/
+
+#include <string.h>
+#include "tft.h"
+#include "tft_bus.h"
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+tft_diff_stats_t tft_diff_stats = {0};
+
+// ====================================================
+
+// Rectangles which are extended row by row
+#define DIFF_OPEN_RECTS     16
+
+typedef struct {
+    int16_t x1;
+    int16_t x2;
+    int16_t y1;
+    int16_t row;            // last row it was extended to
+} diff_open_t;
+
+typedef struct {
+    diff_open_t open[DIFF_OPEN_RECTS];
+    int n_open;
+    tft_diff_op_t op;
+    void *arg;
+    uint32_t pixels;
+} diff_state_t;
+
+// ==== Row compare ====
+
+// Index of the first byte at or after 'i' which differs, 'n' if there is none
+//----------------------------------------------------------------------------------------------------
+static uint32_t diff_next_change(const uint8_t *f, const uint8_t *s, uint32_t i, uint32_t n, uint8_t words) {
+    if (words) {
+        for (; (i < n) && ((uintptr_t)(f + i) & 3); i++) {
+            if (f[i] != s[i]) return i;
+        }
+        for (; (i + 4) <= n; i += 4) {
+            if (*(const uint32_t *)(f + i) != *(const uint32_t *)(s + i)) break;
+        }
+    }
+    for (; i < n; i++) {
+        if (f[i] != s[i]) return i;
+    }
+    return n;
+}
+
+// Index of the first unchanged word after the changed byte 'i', 'n' if there is none;
+// the bytes up to it count as changed
+//---------------------------------------------------------------------------------------------------
+static uint32_t diff_next_equal(const uint8_t *f, const uint8_t *s, uint32_t i, uint32_t n, uint8_t words) {
+    if (words) {
+        // the word of byte 'i' differs
+        for (i = i - ((uintptr_t)(f + i) & 3) + 4; (i + 4) <= n; i += 4) {
+            if (*(const uint32_t *)(f + i) == *(const uint32_t *)(s + i)) return i;
+        }
+        return n;
+    }
+    for (; i < n; i++) {
+        if (f[i] == s[i]) return i;
+    }
+    return n;
+}
+
+// ==== Rectangles ====
+
+//------------------------------------------------------------------------
+static void diff_emit(diff_state_t *st, int x1, int y1, int x2, int y2) {
+    uint32_t n = (uint32_t)(x2 - x1 + 1) * (uint32_t)(y2 - y1 + 1);
+
+    st->op(x1, y1, x2, y2, st->arg);
+    st->pixels += n;
+    tft_diff_stats.rects++;
+    tft_diff_stats.pixels += n;
+}
+
+// Continue the rectangle which ended with the same span in the row above, or start one
+//-------------------------------------------------------------
+static void diff_span(diff_state_t *st, int y, int x1, int x2) {
+    tft_diff_stats.spans++;
+    for (int i = 0; i < st->n_open; i++) {
+        diff_open_t *r = &st->open[i];
+        if ((r->x1 == x1) && (r->x2 == x2) && (r->row == (y - 1))) {
+            r->row = y;
+            return;
+        }
+    }
+    if (st->n_open < DIFF_OPEN_RECTS) st->open[st->n_open++] = (diff_open_t){ .x1 = x1, .x2 = x2, .y1 = y, .row = y };
+    else diff_emit(st, x1, y, x2, y);
+}
+
+// Send the rectangles which were not extended to row 'y'
+//-----------------------------------------------
+static void diff_row_end(diff_state_t *st, int y) {
+    for (int i = 0; i < st->n_open; i++) {
+        diff_open_t *r = &st->open[i];
+        if (r->row == y) continue;
+        diff_emit(st, r->x1, r->y1, r->x2, r->row);
+        st->open[i--] = st->open[--st->n_open];
+    }
+}
+
+// Find the changed spans of a row of 'w' pixels starting at pixel 'x0', copy them to the shadow
+//-------------------------------------------------------------------------------------------
+static void diff_row(diff_state_t *st, const uint8_t *f, uint8_t *s, int x0, int y, uint32_t w) {
+    uint32_t n = w * TFT_PIXEL_BYTES;
+    uint8_t words = ((((uintptr_t)f) ^ ((uintptr_t)s)) & 3) == 0;
+    uint32_t d = diff_next_change(f, s, 0, n, words);
+
+    tft_diff_stats.rows++;
+    if (d >= n) return;
+    tft_diff_stats.rows_changed++;
+
+    while (d < n) {
+        int px1 = d / TFT_PIXEL_BYTES;
+        uint32_t e = diff_next_equal(f, s, d, n, words);
+        int px2 = (e - 1) / TFT_PIXEL_BYTES;
+        d = (e >= n) ? n : diff_next_change(f, s, (px2 + 1) * TFT_PIXEL_BYTES, n, words);
+        memcpy(s + (px1 * TFT_PIXEL_BYTES), f + (px1 * TFT_PIXEL_BYTES), (px2 - px1 + 1) * TFT_PIXEL_BYTES);
+        diff_span(st, y, x0 + px1, x0 + px2);
+    }
+}
+
+//=====================================================================================================
+uint32_t tft_diff_region(const uint8_t *fresh, uint8_t *shadow, uint32_t stride,
+                         int x1, int y1, int x2, int y2, tft_diff_op_t op, void *arg) {
+    diff_state_t st = { .n_open = 0, .op = op, .arg = arg, .pixels = 0 };
+    uint32_t w = x2 - x1 + 1;
+
+    for (int y = y1; y <= y2; y++) {
+        uint32_t offset = ((y * stride) + x1) * TFT_PIXEL_BYTES;
+        diff_row(&st, fresh + offset, shadow + offset, x1, y, w);
+        diff_row_end(&st, y);
+    }
+    diff_row_end(&st, y2 + 1);
+    tft_diff_stats.compared += w * (y2 - y1 + 1);
+    return st.pixels;
+}
+
+// ==== Sending to the display ====
+
+typedef struct {
+    int x;                  // display position of the buffer origin
+    int y;
+    const uint8_t *pixels;
+    uint32_t stride;
+} diff_send_t;
+
+//----------------------------------------------------------------------
+static void diff_send_op(int x1, int y1, int x2, int y2, void *arg) {
+    diff_send_t *ds = (diff_send_t *)arg;
+    send_rect_pixels(ds->x + x1, ds->y + y1, x2 - x1 + 1, y2 - y1 + 1,
+                     ds->pixels + (((y1 * ds->stride) + x1) * TFT_PIXEL_BYTES), ds->stride);
+}
+
+//=============================================================================================
+uint32_t TFT_diff_send(int x, int y, int w, int h, const uint8_t *pixels, uint8_t *shadow, int stride) {
+    diff_send_t ds = { .x = x + tft_dispWin.x1, .y = y + tft_dispWin.y1, .pixels = pixels, .stride = stride };
+    int x1 = ds.x, y1 = ds.y;
+    int x2 = x1 + w - 1, y2 = y1 + h - 1;
+
+    // clipping, only the part inside the display window is compared
+    if (x1 < tft_dispWin.x1) x1 = tft_dispWin.x1;
+    if (y1 < tft_dispWin.y1) y1 = tft_dispWin.y1;
+    if (x2 > tft_dispWin.x2) x2 = tft_dispWin.x2;
+    if (y2 > tft_dispWin.y2) y2 = tft_dispWin.y2;
+    if ((x2 < x1) || (y2 < y1)) return 0;
+
+    if (disp_select() != ESP_OK) return 0;
+    uint32_t n = tft_diff_region(pixels, shadow, stride, x1 - ds.x, y1 - ds.y, x2 - ds.x, y2 - ds.y, diff_send_op, &ds);
+    disp_deselect();
+    return n;
+}
@@ -0,0 +1,45 @@
+/*
+ *
+ * DMA DESCRIPTOR CHAIN BUILDER
+ *
+ * Used by the DMA chain fill of tft_bus_spi.c (CONFIG_TFT_DMA_CHAIN_FILL, experimental),
+ * does not access any hardware and is tested on the host by tools/tft_emu (tft_dma_chain_test).
+ *
+*/
+
+#ifndef _TFT_DMA_CHAIN_H_
+#define _TFT_DMA_CHAIN_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "esp32/rom/lldesc.h"
+
+// Maximal data length of one DMA descriptor, multiple of the pixel size and of 4
+#define TFT_DMA_DESC_MAX_LEN 4092
+
+// Build a DMA descriptor chain which sends 'len' bytes by repeating the first 'chunk' bytes of 'buf'
+// 'chunk' must be a multiple of the pixel size and not larger than TFT_DMA_DESC_MAX_LEN
+// Returns the number of used descriptors, 0 if 'ndesc' descriptors are not enough
+//----------------------------------------------------------------------------------------------------------
+static inline int tft_dma_chain_build(lldesc_t *desc, int ndesc, const uint8_t *buf, uint32_t chunk, uint32_t len) {
+    int n = 0;
+
+    if ((len == 0) || (chunk == 0) || (chunk > TFT_DMA_DESC_MAX_LEN) || (ndesc <= 0)) return 0;
+    if (((len + chunk - 1) / chunk) > (uint32_t)ndesc) return 0;
+
+    while (len > 0) {
+        uint32_t dlen = (len > chunk) ? chunk : len;
+        memset(&desc[n], 0, sizeof(lldesc_t));
+        desc[n].size = (dlen + 3) & ~3;
+        desc[n].length = dlen;
+        desc[n].owner = 1;
+        desc[n].buf = (uint8_t *)buf;
+        if (n > 0) desc[n-1].qe.stqe_next = &desc[n];
+        len -= dlen;
+        n++;
+    }
+    desc[n-1].eof = 1;
+    return n;
+}
+
+#endif
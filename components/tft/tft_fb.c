@@ -0,0 +1,575 @@
+/*
+ *
+ * FRAMEBUFFER DISPLAY BUS BACKEND
+ *
+ * While the framebuffer is active, 'tft_bus' points to tft_bus_fb: the windows,
+ * fills and pixel sends of the drawing functions are written into memory and
+ * the rectangles they change are recorded. TFT_flush() merges the dirty rectangles
+ * and sends each of them to the display backend with one window and RAMWR.
+ *
+ * The framebuffer holds the display area in the pixel format of the display bus,
+ * in the address space of the current orientation. Windows are mapped to scroll
+ * positions before they reach the backend, so it mirrors the display RAM.
+ *
+ * With double buffering the drawing task never waits for the bus while it draws:
+ * the swap compares the dirty rectangles of the drawn framebuffer with the shown one
+ * (tft_diff.c) and copies the changes over, so both hold the new frame; a flush task
+ * sends the changed spans from the drawn one while the next frame is drawn into
+ * the other.
+ *
+*/
+
+#include <string.h>
+#include "tft.h"
+#include "tft_bus.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+tft_fb_stats_t tft_fb_stats = {0};
+volatile tft_fb_frame_t tft_fb_frame = {0};
+int tft_fb_rect_cost = TFT_FB_RECT_COST;
+
+// ====================================================
+
+// Flush task events
+#define FB_EVT_SEND         0x01
+#define FB_EVT_DONE         0x02
+#define FB_EVT_STOP         0x04
+#define FB_EVT_EXIT         0x08
+
+typedef struct {
+    int16_t x1;
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+} tft_fb_rect_t;
+
+static uint8_t *fb_pixels = NULL;
+static const tft_bus_t *fb_target = NULL;     // backend the framebuffer is sent to
+static tft_fb_rect_t fb_window = {0};          // window of the next write, framebuffer coordinates
+static tft_fb_rect_t fb_dirty[TFT_FB_DIRTY_RECTS];
+static int fb_dirty_count = 0;
+
+// Double buffering
+static uint8_t *fb_shown = NULL;               // framebuffer the display shows, NULL with one framebuffer
+static uint8_t fb_shown_valid = 0;             // fb_shown holds the display content
+static EventGroupHandle_t fb_events = NULL;
+static const uint8_t *fb_send_pixels = NULL;   // framebuffer the flush task sends
+static tft_fb_rect_t fb_send_list[TFT_FB_SEND_RECTS];
+static int fb_send_count = 0;
+static TFT_fence_t fb_frames_queued = 0;       // frames handed to the flush task
+static volatile TFT_fence_t fb_frames_sent = 0;
+static int64_t fb_swap_end = 0;
+
+// Called with each run of pixels a write or read covers in the framebuffer,
+// 'first' is the index of the run's first pixel in the transfer
+typedef void (*fb_run_op_t)(uint8_t *fb, uint32_t first, uint32_t n, void *arg);
+
+// ==== Dirty rectangles ====
+
+//--------------------------------------------
+static inline uint32_t fb_area(const tft_fb_rect_t *r) {
+    return (uint32_t)(r->x2 - r->x1 + 1) * (uint32_t)(r->y2 - r->y1 + 1);
+}
+
+//-------------------------------------------------------------------------
+static inline uint8_t fb_contains(const tft_fb_rect_t *a, const tft_fb_rect_t *b) {
+    return (a->x1 <= b->x1) && (a->y1 <= b->y1) && (a->x2 >= b->x2) && (a->y2 >= b->y2);
+}
+
+//-------------------------------------------------------------------------------------
+static tft_fb_rect_t fb_union(const tft_fb_rect_t *a, const tft_fb_rect_t *b) {
+    tft_fb_rect_t u = *a;
+    if (b->x1 < u.x1) u.x1 = b->x1;
+    if (b->y1 < u.y1) u.y1 = b->y1;
+    if (b->x2 > u.x2) u.x2 = b->x2;
+    if (b->y2 > u.y2) u.y2 = b->y2;
+    return u;
+}
+
+// Pixels sent in addition if 'a' and 'b' are sent as their union, can be negative if they overlap
+//------------------------------------------------------------------------
+static int32_t fb_merge_waste(const tft_fb_rect_t *a, const tft_fb_rect_t *b) {
+    tft_fb_rect_t u = fb_union(a, b);
+    return (int32_t)fb_area(&u) - (int32_t)fb_area(a) - (int32_t)fb_area(b);
+}
+
+// Add the rectangle to the list of 'count' rectangles which holds 'size'
+// It is merged with a rectangle of the list if that costs less than sending both,
+// the union is checked against the list again. If the list is full it is merged
+// with the rectangle it adds the fewest pixels to.
+//---------------------------------------------------------------------------------
+static void fb_rect_add(tft_fb_rect_t *list, int *count, int size, tft_fb_rect_t r) {
+    while (1) {
+        int best = -1;
+        int32_t best_waste = 0;
+
+        for (int i = 0; i < *count; i++) {
+            if (fb_contains(&list[i], &r)) return;
+            if (fb_contains(&r, &list[i])) {
+                list[i--] = list[--(*count)];
+                tft_fb_stats.merges++;
+                continue;
+            }
+            int32_t waste = fb_merge_waste(&list[i], &r);
+            if ((best < 0) || (waste < best_waste)) {
+                best = i;
+                best_waste = waste;
+            }
+        }
+        if ((best < 0) || ((best_waste > tft_fb_rect_cost) && (*count < size))) break;
+
+        r = fb_union(&list[best], &r);
+        list[best] = list[--(*count)];
+        tft_fb_stats.merges++;
+    }
+    list[(*count)++] = r;
+}
+
+// Add the rectangle to the dirty list
+//------------------------------------------------
+static void fb_dirty_add(tft_fb_rect_t r) {
+    fb_rect_add(fb_dirty, &fb_dirty_count, TFT_FB_DIRTY_RECTS, r);
+}
+
+// Send the dirty rectangles to the display, all of them are clean afterwards
+//---------------------------
+static void fb_send_dirty() {
+    if (fb_dirty_count == 0) return;
+
+    esp_err_t ret = fb_target->acquire();
+    if (ret != ESP_OK) return;
+    for (int i = 0; i < fb_dirty_count; i++) {
+        tft_fb_rect_t *r = &fb_dirty[i];
+        uint32_t w = r->x2 - r->x1 + 1;
+        uint32_t h = r->y2 - r->y1 + 1;
+
+        fb_target->window(r->x1 + TFT_STATIC_X_OFFSET, r->y1 + TFT_STATIC_Y_OFFSET,
+                          r->x2 + TFT_STATIC_X_OFFSET, r->y2 + TFT_STATIC_Y_OFFSET);
+        fb_target->send_rect(fb_pixels + (((r->y1 * tft_width) + r->x1) * TFT_PIXEL_BYTES), w, h, tft_width);
+        tft_fb_stats.rects++;
+        tft_fb_stats.pixels += w * h;
+    }
+    tft_fb_stats.flushes++;
+    fb_dirty_count = 0;
+    fb_target->release();
+}
+
+// ==== Double buffering ====
+
+// Send the rectangles of the swapped framebuffer, the drawing task continues meanwhile
+//------------------------------------------
+static void fb_flush_task(void *arg) {
+    (void)arg;
+    while (1) {
+        EventBits_t bits = xEventGroupWaitBits(fb_events, FB_EVT_SEND | FB_EVT_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (bits & FB_EVT_STOP) break;
+
+        int64_t t = esp_timer_get_time();
+        if ((fb_send_count > 0) && (fb_target->acquire() == ESP_OK)) {
+            for (int i = 0; i < fb_send_count; i++) {
+                tft_fb_rect_t *r = &fb_send_list[i];
+                uint32_t w = r->x2 - r->x1 + 1;
+                uint32_t h = r->y2 - r->y1 + 1;
+
+                fb_target->window(r->x1 + TFT_STATIC_X_OFFSET, r->y1 + TFT_STATIC_Y_OFFSET,
+                                  r->x2 + TFT_STATIC_X_OFFSET, r->y2 + TFT_STATIC_Y_OFFSET);
+                fb_target->send_rect(fb_send_pixels + (((r->y1 * tft_width) + r->x1) * TFT_PIXEL_BYTES), w, h, tft_width);
+                tft_fb_stats.rects++;
+                tft_fb_stats.pixels += w * h;
+            }
+            tft_fb_stats.flushes++;
+            // all transfers are finished
+            fb_target->release();
+        }
+        tft_fb_frame.flush_us = (uint32_t)(esp_timer_get_time() - t);
+        fb_frames_sent++;
+        xEventGroupSetBits(fb_events, FB_EVT_DONE);
+    }
+    xEventGroupSetBits(fb_events, FB_EVT_EXIT);
+    vTaskDelete(NULL);
+}
+
+// Wait until the flush task sent the last swapped frame
+//----------------------------
+static void fb_flush_wait() {
+    xEventGroupWaitBits(fb_events, FB_EVT_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+// Changed pixels of a dirty rectangle, they are sent from the drawn framebuffer
+//-------------------------------------------------------------------
+static void fb_diff_op(int x1, int y1, int x2, int y2, void *arg) {
+    (void)arg;
+    tft_fb_rect_t r = { .x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2 };
+    fb_rect_add(fb_send_list, &fb_send_count, TFT_FB_SEND_RECTS, r);
+}
+
+// Hand the drawn framebuffer to the flush task, draw into the other one
+//--------------------
+static void fb_swap() {
+    int64_t t = esp_timer_get_time();
+    tft_fb_frame.draw_us = (uint32_t)(t - fb_swap_end);
+    if (fb_dirty_count == 0) {
+        fb_swap_end = t;
+        return;
+    }
+
+    // the shown framebuffer is not read any more when the last frame is sent
+    fb_flush_wait();
+    int64_t t_diff = esp_timer_get_time();
+    tft_fb_frame.wait_us = (uint32_t)(t_diff - t);
+
+    // the changed spans are copied to the shown framebuffer
+    fb_send_count = 0;
+    for (int i = 0; i < fb_dirty_count; i++) {
+        tft_fb_rect_t *r = &fb_dirty[i];
+        if (fb_shown_valid) {
+            tft_diff_region(fb_pixels, fb_shown, tft_width, r->x1, r->y1, r->x2, r->y2, fb_diff_op, NULL);
+            continue;
+        }
+        // the first frame is sent as drawn
+        for (int y = r->y1; y <= r->y2; y++) {
+            uint32_t offset = ((y * tft_width) + r->x1) * TFT_PIXEL_BYTES;
+            memcpy(fb_shown + offset, fb_pixels + offset, (r->x2 - r->x1 + 1) * TFT_PIXEL_BYTES);
+        }
+        fb_rect_add(fb_send_list, &fb_send_count, TFT_FB_SEND_RECTS, *r);
+    }
+    fb_shown_valid = 1;
+    fb_dirty_count = 0;
+    tft_fb_frame.rects = fb_send_count;
+    tft_fb_frame.pixels = 0;
+    for (int i = 0; i < fb_send_count; i++) tft_fb_frame.pixels += fb_area(&fb_send_list[i]);
+    tft_fb_frame.frame++;
+
+    // both framebuffers hold the frame now, the drawn one is sent
+    uint8_t *drawn = fb_pixels;
+    fb_pixels = fb_shown;
+    fb_shown = drawn;
+    fb_send_pixels = drawn;
+    fb_frames_queued++;
+    tft_fb_frame.diff_us = (uint32_t)(esp_timer_get_time() - t_diff);
+    xEventGroupClearBits(fb_events, FB_EVT_DONE);
+    xEventGroupSetBits(fb_events, FB_EVT_SEND);
+    fb_swap_end = esp_timer_get_time();
+}
+
+// Send the drawing so far, with double buffering the frame is swapped
+//---------------------
+static void fb_flush() {
+    if (fb_events) fb_swap();
+    else fb_send_dirty();
+}
+
+// Everything drawn is sent when it returns
+//--------------------
+static void fb_sync() {
+    if (fb_events) {
+        fb_swap();
+        fb_flush_wait();
+    }
+    else fb_send_dirty();
+}
+
+// ==== Window access ====
+
+// Call 'op' for the framebuffer runs of 'len' pixels written to or read from the window,
+// row by row as the controller addresses them; pixels outside of the framebuffer are skipped.
+// Returns the rectangle covered, x2 < x1 if none
+//-------------------------------------------------------------------------------
+static tft_fb_rect_t fb_window_runs(uint32_t len, fb_run_op_t op, void *arg) {
+    tft_fb_rect_t *win = &fb_window;
+    tft_fb_rect_t covered = { .x1 = 0, .y1 = 0, .x2 = -1, .y2 = -1 };
+    uint32_t w = win->x2 - win->x1 + 1;
+    uint32_t first = 0;
+    int x1 = (win->x1 < 0) ? 0 : win->x1;
+
+    for (int y = win->y1; (len > 0) && (y <= win->y2); y++) {
+        uint32_t n = (len < w) ? len : w;
+        int x2 = win->x1 + n - 1;
+        if (x2 >= tft_width) x2 = tft_width - 1;
+
+        if ((y >= 0) && (y < tft_height) && (x2 >= x1)) {
+            op(fb_pixels + (((y * tft_width) + x1) * TFT_PIXEL_BYTES), first + (x1 - win->x1), x2 - x1 + 1, arg);
+            if (covered.x2 < covered.x1) {
+                covered.x1 = x1;
+                covered.y1 = y;
+                covered.x2 = x2;
+            }
+            else if (x2 > covered.x2) covered.x2 = x2;
+            covered.y2 = y;
+        }
+        first += n;
+        len -= n;
+    }
+    return covered;
+}
+
+// Write 'len' pixels to the window with 'op' and mark them dirty
+//-------------------------------------------------------------------
+static void fb_window_write(uint32_t len, fb_run_op_t op, void *arg) {
+    tft_fb_rect_t covered = fb_window_runs(len, op, arg);
+    if (covered.x2 >= covered.x1) fb_dirty_add(covered);
+}
+
+//------------------------------------------------------------------------------
+static void fb_fill_run(uint8_t *fb, uint32_t first, uint32_t n, void *arg) {
+    (void)first;
+    // the run is doubled with every copy
+    memcpy(fb, arg, TFT_PIXEL_BYTES);
+    for (uint32_t done = 1; done < n; ) {
+        uint32_t copy = ((n - done) < done) ? (n - done) : done;
+        memcpy(fb + (done * TFT_PIXEL_BYTES), fb, copy * TFT_PIXEL_BYTES);
+        done += copy;
+    }
+}
+
+//------------------------------------------------------------------------------
+static void fb_send_run(uint8_t *fb, uint32_t first, uint32_t n, void *arg) {
+    memcpy(fb, (const uint8_t *)arg + (first * TFT_PIXEL_BYTES), n * TFT_PIXEL_BYTES);
+}
+
+//-------------------------------------------------------------------------------------
+static void fb_send_colors_run(uint8_t *fb, uint32_t first, uint32_t n, void *arg) {
+    TFT_pixels_store(fb, (const color_t *)arg + first, n);
+}
+
+// 3 bytes per pixel with 6 significant bits, as the controller sends them
+//------------------------------------------------------------------------------
+static void fb_read_run(uint8_t *fb, uint32_t first, uint32_t n, void *arg) {
+    uint8_t *dst = (uint8_t *)arg + (first * 3);
+    for (uint32_t i = 0; i < n; i++, fb += TFT_PIXEL_BYTES, dst += 3) {
+#if TFT_PIXEL_BYTES == 2
+        dst[0] = fb[0] & 0xF8;
+        dst[1] = ((fb[0] << 5) | (fb[1] >> 3)) & 0xFC;
+        dst[2] = (fb[1] << 3) & 0xF8;
+#else
+        dst[0] = fb[0] & 0xFC;
+        dst[1] = fb[1] & 0xFC;
+        dst[2] = fb[2] & 0xFC;
+#endif
+    }
+}
+
+// ==== Backend operations ====
+
+//----------------------------------
+static esp_err_t fb_acquire() {
+    // drawing into memory does not need the bus
+    return ESP_OK;
+}
+
+//----------------------
+static void fb_release() {
+}
+
+//-------------------------
+static void fb_invalidate() {
+    if (fb_events) fb_flush_wait();
+    fb_target->invalidate();
+}
+
+// Commands are sent after the dirty rectangles, in the order they were drawn
+//------------------------------
+static void fb_cmd(uint8_t cmd) {
+    fb_sync();
+    fb_target->cmd(cmd);
+}
+
+// After a rotation the framebuffer content is in the old address layout: it is sent in full
+// with the next flush and the shown framebuffer is not compared against
+//-------------------------------------------------------------------------
+static void fb_cmd_data(uint8_t cmd, const uint8_t *data, uint32_t len) {
+    fb_sync();
+    fb_target->cmd_data(cmd, data, len);
+    if (cmd == TFT_MADCTL) {
+        fb_shown_valid = 0;
+        fb_dirty_count = 0;
+        fb_dirty[fb_dirty_count++] = (tft_fb_rect_t){ .x1 = 0, .y1 = 0, .x2 = tft_width - 1, .y2 = tft_height - 1 };
+    }
+}
+
+//-------------------------------------------------------
+static void fb_set_window(int x1, int y1, int x2, int y2) {
+    fb_window.x1 = x1 - TFT_STATIC_X_OFFSET;
+    fb_window.y1 = y1 - TFT_STATIC_Y_OFFSET;
+    fb_window.x2 = x2 - TFT_STATIC_X_OFFSET;
+    fb_window.y2 = y2 - TFT_STATIC_Y_OFFSET;
+}
+
+//------------------------------------------------------------
+static void fb_fill(color_t color, uint32_t len, uint8_t sync) {
+    (void)sync;
+    uint8_t pixel[TFT_PIXEL_BYTES];
+    TFT_pixel_pack(pixel, color);
+    fb_window_write(len, fb_fill_run, pixel);
+}
+
+//--------------------------------------------------------
+static void fb_send(const uint8_t *pixels, uint32_t len) {
+    fb_window_write(len, fb_send_run, (void *)pixels);
+}
+
+//-------------------------------------------------------------
+static void fb_send_colors(const color_t *colors, uint32_t len) {
+    fb_window_write(len, fb_send_colors_run, (void *)colors);
+}
+
+//-------------------------------------------------------------------------------------------
+static void fb_send_rect(const uint8_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    tft_fb_rect_t win = fb_window;
+    for (uint32_t y = 0; y < h; y++, pixels += stride * TFT_PIXEL_BYTES) {
+        fb_window.y1 = win.y1 + y;
+        fb_window.y2 = fb_window.y1;
+        fb_window_write(w, fb_send_run, (void *)pixels);
+    }
+    fb_window = win;
+}
+
+//----------------------------------------------------
+static esp_err_t fb_read(uint8_t *dst, uint32_t len) {
+    memset(dst, 0, 3 * len);
+    fb_window_runs(len, fb_read_run, dst);
+    return ESP_OK;
+}
+
+// Transfers of the display backend may still run after a flush,
+// with double buffering the fences count the frames handed to the flush task
+//---------------------------------
+static TFT_fence_t fb_fence() {
+    if (fb_events) return fb_frames_queued;
+    return fb_target->fence();
+}
+
+//-------------------------------------
+static void fb_wait(TFT_fence_t fence) {
+    if (fb_events) {
+        if ((int32_t)(fence - fb_frames_sent) > 0) fb_flush_wait();
+    }
+    else fb_target->wait(fence);
+}
+
+//-----------------------------------------------
+static uint8_t fb_fence_done(TFT_fence_t fence) {
+    if (fb_events) return ((int32_t)(fence - fb_frames_sent) <= 0);
+    return fb_target->fence_done(fence);
+}
+
+// ==== Framebuffer backend ===================================
+const tft_bus_t tft_bus_fb = {
+    .name = "framebuffer",
+    .acquire = fb_acquire,
+    .release = fb_release,
+    .init = NULL,
+    .invalidate = fb_invalidate,
+    .cmd = fb_cmd,
+    .cmd_data = fb_cmd_data,
+    .window = fb_set_window,
+    .fill = fb_fill,
+    .send = fb_send,
+    .send_colors = fb_send_colors,
+    .send_rect = fb_send_rect,
+    .read = fb_read,
+    .fence = fb_fence,
+    .wait = fb_wait,
+    .fence_done = fb_fence_done,
+    .flush = fb_flush,
+};
+
+// Allocate a framebuffer, small ones in internal RAM, larger ones in PSRAM if there is some
+//--------------------------------
+static uint8_t *fb_alloc(size_t size) {
+    uint32_t first = (size <= TFT_FB_DRAM_MAX) ? MALLOC_CAP_INTERNAL : MALLOC_CAP_SPIRAM;
+    uint32_t second = (size <= TFT_FB_DRAM_MAX) ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+
+    uint8_t *fb = heap_caps_malloc(size, first | MALLOC_CAP_8BIT);
+    if (fb == NULL) fb = heap_caps_malloc(size, second | MALLOC_CAP_8BIT);
+    if (fb) memset(fb, 0, size);
+    return fb;
+}
+
+//-----------------------
+static void fb_free() {
+    heap_caps_free(fb_pixels);
+    heap_caps_free(fb_shown);
+    fb_pixels = NULL;
+    fb_shown = NULL;
+    if (fb_events) vEventGroupDelete(fb_events);
+    fb_events = NULL;
+}
+
+//------------------------
+static void fb_start() {
+    // earlier transfers must be finished before the backend changes
+    TFT_flush();
+    fb_target = tft_bus;
+    fb_dirty_count = 0;
+    fb_dirty[fb_dirty_count++] = (tft_fb_rect_t){ .x1 = 0, .y1 = 0, .x2 = tft_width - 1, .y2 = tft_height - 1 };
+    tft_bus = &tft_bus_fb;
+}
+
+//========================
+esp_err_t TFT_fb_begin() {
+    // the display backend must draw directly
+    if ((tft_bus->flush != NULL) || (tft_bus->send_rect == NULL)) return ESP_ERR_INVALID_STATE;
+
+    fb_pixels = fb_alloc((size_t)tft_width * tft_height * TFT_PIXEL_BYTES);
+    if (fb_pixels == NULL) return ESP_ERR_NO_MEM;
+    fb_start();
+    return ESP_OK;
+}
+
+//===============================
+esp_err_t TFT_fb_begin_double() {
+    // the display backend must draw directly
+    if ((tft_bus->flush != NULL) || (tft_bus->send_rect == NULL)) return ESP_ERR_INVALID_STATE;
+
+    size_t size = (size_t)tft_width * tft_height * TFT_PIXEL_BYTES;
+    fb_pixels = fb_alloc(size);
+    fb_shown = fb_alloc(size);
+    fb_events = xEventGroupCreate();
+    if ((fb_pixels == NULL) || (fb_shown == NULL) || (fb_events == NULL)) {
+        fb_free();
+        return ESP_ERR_NO_MEM;
+    }
+    // the flush task mostly waits for the bus, it runs above the drawing task
+    xEventGroupSetBits(fb_events, FB_EVT_DONE);
+    if (xTaskCreatePinnedToCore(fb_flush_task, "tft_fb", TFT_FB_TASK_STACK, NULL, uxTaskPriorityGet(NULL) + 1, NULL,
+                                (TFT_FB_FLUSH_CORE < 0) ? tskNO_AFFINITY : TFT_FB_FLUSH_CORE) != pdPASS) {
+        fb_free();
+        return ESP_ERR_NO_MEM;
+    }
+
+    fb_shown_valid = 0;
+    fb_send_count = 0;
+    fb_frames_queued = 0;
+    fb_frames_sent = 0;
+    memset((void *)&tft_fb_frame, 0, sizeof(tft_fb_frame));
+    fb_start();
+    fb_swap_end = esp_timer_get_time();
+    return ESP_OK;
+}
+
+//=================
+void TFT_fb_swap() {
+    if (tft_bus != &tft_bus_fb) return;
+    if (fb_events) fb_swap();
+    else TFT_flush();
+}
+
+//==================
+void TFT_fb_end() {
+    if (tft_bus != &tft_bus_fb) return;
+
+    TFT_flush();
+    tft_bus = fb_target;
+    if (fb_events) {
+        xEventGroupSetBits(fb_events, FB_EVT_STOP);
+        xEventGroupWaitBits(fb_events, FB_EVT_EXIT, pdTRUE, pdTRUE, portMAX_DELAY);
+    }
+    fb_free();
+}
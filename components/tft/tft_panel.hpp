@@ -0,0 +1,208 @@
+/*
+ * C++ PANEL LAYER, header only
+ *
+ * tft::Panel<Controller, Width, Height, Format, WidthOffset, HeightOffset> describes one display
+ * at compile time: the controller and its init tables, the panel size, the offsets of the visible
+ * area in the controller RAM and the pixel format on the bus. Everything derived from them
+ * (offsets per orientation, clipping bounds, pixel conversion) is constexpr, the drawing
+ * functions of Panel<...>::View<Orientation> are inline and go straight to the C functions
+ * of the library, which do the bus transfers.
+ *
+ *   using Display = tft::Panel<tft::ST7789V, 135, 240, tft::RGB666, 53, 40>;
+ *   using Screen = Display::View<LANDSCAPE>;
+ *
+ *   Display::init();                      // instead of TFT_display_init()
+ *   Display::set_orientation<LANDSCAPE>(); // instead of TFT_setRotation()
+ *   Screen::fill_rect(0, 0, Screen::width, 20, TFT_NAVY);
+ *
+ * tft::ConfiguredPanel is the panel set in menuconfig. The C API can be used together with
+ * the layer, both share the bus and the global state of the library.
+ */
+
+#ifndef _TFT_PANEL_HPP_
+#define _TFT_PANEL_HPP_
+
+#include <stdint.h>
+#include "tft.h"
+
+namespace tft {
+
+// ==== Pixel formats ===========================================
+
+// 18-bit, 3 bytes per pixel (COLMOD 0x66)
+struct RGB666 {
+    static constexpr uint8_t colmod = 0x66;
+    static constexpr uint8_t bytes = 3;
+
+    static inline void store(uint8_t *dst, color_t color) {
+        dst[0] = color.r;
+        dst[1] = color.g;
+        dst[2] = color.b;
+    }
+};
+
+// 16-bit, 2 bytes per pixel, high byte first (COLMOD 0x55)
+struct RGB565 {
+    static constexpr uint8_t colmod = 0x55;
+    static constexpr uint8_t bytes = 2;
+
+    static constexpr uint16_t value(uint8_t r, uint8_t g, uint8_t b) {
+        return (uint16_t)(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+    }
+    static inline void store(uint8_t *dst, color_t color) {
+        uint16_t v = value(color.r, color.g, color.b);
+        dst[0] = v >> 8;
+        dst[1] = v & 0xFF;
+    }
+};
+
+// ==== Controllers =============================================
+// 'commands' sends the init tables of the controller (see tftspi.h)
+
+struct ILI9341 {
+    static constexpr uint8_t type = DISP_TYPE_ILI9341;
+    static constexpr bool has_rgb565 = true;
+    static void commands() { commandList(ILI9341_init); }
+};
+
+struct ILI9488 {
+    static constexpr uint8_t type = DISP_TYPE_ILI9488;
+    static constexpr bool has_rgb565 = false;   // only 18-bit pixels on the SPI interface
+    static void commands() { commandList(ILI9488_init); }
+};
+
+struct ST7789V {
+    static constexpr uint8_t type = DISP_TYPE_ST7789V;
+    static constexpr bool has_rgb565 = true;
+    static void commands() { commandList(ST7789V_init); }
+};
+
+struct ST7735 {
+    static constexpr uint8_t type = DISP_TYPE_ST7735;
+    static constexpr bool has_rgb565 = true;
+    static void commands() { commandList(STP7735_init); }
+};
+
+struct ST7735R {
+    static constexpr uint8_t type = DISP_TYPE_ST7735R;
+    static constexpr bool has_rgb565 = true;
+    static void commands() {
+        commandList(STP7735R_init);
+        commandList(Rcmd2green);
+        commandList(Rcmd3);
+    }
+};
+
+struct ST7735B {
+    static constexpr uint8_t type = DISP_TYPE_ST7735B;
+    static constexpr bool has_rgb565 = true;
+    static void commands() {
+        uint8_t dt = 0xC0;
+        commandList(STP7735R_init);
+        commandList(Rcmd2red);
+        commandList(Rcmd3);
+        disp_spi_transfer_cmd_data(TFT_MADCTL, &dt, 1);
+    }
+};
+
+// ==== Panel ===================================================
+
+template <class Controller, int Width, int Height, class Format = RGB666, int WidthOffset = 0, int HeightOffset = 0>
+struct Panel {
+    // the init tables and the bus buffers are built for the configured pixel format
+    static_assert(Format::colmod == DISP_COLOR_BITS, "the pixel format must match CONFIG_TFT_COLOR_BITS_16");
+    static_assert((Format::bytes == 3) || Controller::has_rgb565, "the controller has no 16-bit pixel format");
+
+    typedef Controller controller;
+    typedef Format format;
+
+    static constexpr int width = Width;         // portrait, the smaller dimension
+    static constexpr int height = Height;
+    static constexpr uint8_t pixel_bytes = Format::bytes;
+
+    // Offsets of the visible area in the controller RAM for the orientation
+    static constexpr int x_offset(uint8_t orientation) { return (orientation & 1) ? HeightOffset : WidthOffset; }
+    static constexpr int y_offset(uint8_t orientation) { return (orientation & 1) ? WidthOffset : HeightOffset; }
+
+    // Store the color in the pixel format of the panel, with the color transform applied
+    static inline void store(uint8_t *dst, color_t color) {
+        Format::store(dst, TFT_color_apply(color));
+    }
+
+    // Drawing in one orientation, coordinates relative to the visible area, clipped to it.
+    // The clip window of the C API (TFT_setclipwin()) is not used.
+    template <uint8_t Orientation>
+    struct View {
+        static constexpr uint8_t orientation = Orientation;
+        static constexpr int width = (Orientation & 1) ? Height : Width;
+        static constexpr int height = (Orientation & 1) ? Width : Height;
+        static constexpr int x0 = x_offset(Orientation);
+        static constexpr int y0 = y_offset(Orientation);
+
+        //-----------------------------------------------------------------
+        static inline void fill_rect(int x, int y, int w, int h, color_t color) {
+            if (x < 0) { w += x; x = 0; }
+            if (y < 0) { h += y; y = 0; }
+            if ((x + w) > width) w = width - x;
+            if ((y + h) > height) h = height - y;
+            if ((w <= 0) || (h <= 0)) return;
+            TFT_pushColorRep(x0 + x, y0 + y, x0 + x + w - 1, y0 + y + h - 1, color, (uint32_t)(w * h));
+        }
+
+        //-------------------------------------
+        static inline void fill(color_t color) {
+            TFT_pushColorRep(x0, y0, x0 + width - 1, y0 + height - 1, color, (uint32_t)(width * height));
+        }
+
+        //-------------------------------------------------------
+        static inline void draw_pixel(int x, int y, color_t color) {
+            if ((x < 0) || (y < 0) || (x >= width) || (y >= height)) return;
+            drawPixel(x0 + x, y0 + y, color);
+        }
+
+        // Queue w*h pixels stored with store(), the rectangle must be inside the view,
+        // 'pixels' must not change until the returned fence is done (see send_pixels_start())
+        //--------------------------------------------------------------------------------------
+        static inline TFT_fence_t push_pixels(int x, int y, int w, int h, const uint8_t *pixels) {
+            return send_pixels_start(x0 + x, y0 + y, x0 + x + w - 1, y0 + y + h - 1, (uint32_t)(w * h), pixels);
+        }
+    };
+
+    // Initialize the display, as TFT_display_init() but only this controller's init tables are used
+    //-----------------------
+    static void init() {
+        tft_disp_type = Controller::type;
+        tft_width = Width;
+        tft_height = Height;
+        TFT_display_init_commands(&Controller::commands);
+    }
+
+    // Set the orientation, as TFT_setRotation() (which also clears the screen)
+    //------------------------------------------
+    template <uint8_t Orientation>
+    static void set_orientation() {
+        static_assert(Orientation <= LANDSCAPE_FLIP, "invalid orientation");
+        TFT_setRotation(Orientation);
+    }
+};
+
+// ==== Panel set in menuconfig =================================
+
+template <uint8_t Type> struct controller_of;
+template <> struct controller_of<DISP_TYPE_ILI9341> { typedef ILI9341 type; };
+template <> struct controller_of<DISP_TYPE_ILI9488> { typedef ILI9488 type; };
+template <> struct controller_of<DISP_TYPE_ST7789V> { typedef ST7789V type; };
+template <> struct controller_of<DISP_TYPE_ST7735> { typedef ST7735 type; };
+template <> struct controller_of<DISP_TYPE_ST7735R> { typedef ST7735R type; };
+template <> struct controller_of<DISP_TYPE_ST7735B> { typedef ST7735B type; };
+
+template <uint8_t Bytes> struct format_of;
+template <> struct format_of<3> { typedef RGB666 type; };
+template <> struct format_of<2> { typedef RGB565 type; };
+
+typedef Panel<controller_of<DEFAULT_DISP_TYPE>::type, DEFAULT_TFT_DISPLAY_WIDTH, DEFAULT_TFT_DISPLAY_HEIGHT,
+              format_of<TFT_PIXEL_BYTES>::type, TFT_STATIC_WIDTH_OFFSET, TFT_STATIC_HEIGHT_OFFSET> ConfiguredPanel;
+
+} // namespace tft
+
+#endif
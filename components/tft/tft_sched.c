@@ -0,0 +1,101 @@
+/*
+ *
+ * SPI BUS SCHEDULER
+ *
+ * The display (with its read device) and the touch controller are devices on the same spi bus.
+ * All get the bus through tft_sched_acquire(), which measures how long
+ * each client waits for the bus and holds it. The holder gives the bus up
+ * at safe points (between the chunks of a fill or a pixel send, between touch
+ * sample sets) when another client waits and either has a higher priority
+ * or the holder used up its time slice.
+ *
+*/
+
+#include <string.h>
+#include "tftspi.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+// ====================================================
+// ==== Global variables, default values ==============
+
+// A touch sample set waits at most for the queued display chunks,
+// a long fill gives the bus to the touch controller at its next chunk
+tft_sched_config_t tft_sched_config[TFT_SCHED_CLIENTS] = {
+    [TFT_SCHED_DISPLAY] = { .priority = 0, .slice_us = 20000, .budget_us = 20000 },
+    [TFT_SCHED_TOUCH]   = { .priority = 1, .slice_us = 2000,  .budget_us = 10000 },
+    [TFT_SCHED_DISPLAY_READ] = { .priority = 0, .slice_us = 0, .budget_us = 20000 },
+};
+
+tft_sched_stats_t tft_sched_stats[TFT_SCHED_CLIENTS] = {0};
+
+// ====================================================
+
+// Each client only writes its own entries, the holder reads the other client's wait start
+static volatile int64_t tft_sched_wait_since[TFT_SCHED_CLIENTS] = {0};   // 0 if not waiting
+static int64_t tft_sched_hold_since[TFT_SCHED_CLIENTS] = {0};
+
+//-------------------------------------------------------------------------
+static spi_device_handle_t IRAM_ATTR sched_device(tft_sched_client_t client) {
+    if (client == TFT_SCHED_DISPLAY) return tft_disp_spi;
+    if (client == TFT_SCHED_DISPLAY_READ) return tft_disp_rd_spi;
+    return tft_ts_spi;
+}
+
+//===================================================================
+esp_err_t IRAM_ATTR tft_sched_acquire(tft_sched_client_t client) {
+    spi_device_handle_t dev = sched_device(client);
+    if (dev == NULL) return ESP_ERR_INVALID_STATE;
+
+    int64_t t = esp_timer_get_time();
+    tft_sched_wait_since[client] = t;
+    esp_err_t ret = spi_device_acquire_bus(dev, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    tft_sched_wait_since[client] = 0;
+    if (ret != ESP_OK) return ret;
+
+    tft_sched_stats_t *stats = &tft_sched_stats[client];
+    uint32_t wait = (uint32_t)(now - t);
+    if (wait > stats->max_wait_us) stats->max_wait_us = wait;
+    if (wait > tft_sched_config[client].budget_us) stats->over_budget++;
+    stats->acquires++;
+    tft_sched_hold_since[client] = now;
+    return ESP_OK;
+}
+
+//=============================================================
+void IRAM_ATTR tft_sched_release(tft_sched_client_t client) {
+    tft_sched_stats_t *stats = &tft_sched_stats[client];
+    uint32_t hold = (uint32_t)(esp_timer_get_time() - tft_sched_hold_since[client]);
+
+    if (hold > stats->max_hold_us) stats->max_hold_us = hold;
+    stats->hold_us += hold;
+    spi_device_release_bus(sched_device(client));
+}
+
+//====================================================================
+uint8_t IRAM_ATTR tft_sched_yield_due(tft_sched_client_t client) {
+    uint8_t waiting = 0;
+
+    for (int other = 0; other < TFT_SCHED_CLIENTS; other++) {
+        if ((other == (int)client) || (tft_sched_wait_since[other] == 0)) continue;
+        if (tft_sched_config[other].priority > tft_sched_config[client].priority) return 1;
+        waiting = 1;
+    }
+    if ((!waiting) || (tft_sched_config[client].slice_us == 0)) return 0;
+    return ((esp_timer_get_time() - tft_sched_hold_since[client]) >= tft_sched_config[client].slice_us);
+}
+
+//===========================================================
+void IRAM_ATTR tft_sched_yield(tft_sched_client_t client) {
+    tft_sched_stats[client].yields++;
+    tft_sched_release(client);
+    // the spi driver hands the bus to the waiting device first
+    esp_err_t ret = tft_sched_acquire(client);
+    ESP_ERROR_CHECK(ret);
+}
+
+//=========================
+void tft_sched_stats_reset() {
+    memset(tft_sched_stats, 0, sizeof(tft_sched_stats));
+}
@@ -0,0 +1,53 @@
+/*
+ *
+ * DISPLAY TRANSACTION TRACE FORMAT
+ *
+ * Written by TFT_trace_save() / TFT_trace_print() (tft_bus_spi.c, CONFIG_TFT_SPI_TRACE),
+ * read by the host replay tool in tools/tft_trace.
+ * A trace is one tft_trace_header_t followed by 'count' tft_trace_record_t, little endian.
+ *
+*/
+
+#ifndef _TFT_TRACE_H_
+#define _TFT_TRACE_H_
+
+#include <stdint.h>
+
+#define TFT_TRACE_MAGIC     0x54544654  // "TFTT"
+#define TFT_TRACE_VERSION   1
+
+// Prefix of the hex lines written by TFT_trace_print()
+#define TFT_TRACE_LINE_TAG  "TFTTRACE"
+
+// ==== Record flags ============================================
+#define TFT_TRACE_DC        0x01    // DC high (data), otherwise command
+#define TFT_TRACE_QUEUED    0x02    // queued transaction, otherwise polling
+#define TFT_TRACE_READ      0x04    // read device transaction: command phase, dummy bits, 'len' bytes received
+#define TFT_TRACE_DIRECT    0x08    // DMA chain transfer, bypasses the spi_master driver
+#define TFT_TRACE_INLINE    0x10    // 'data' holds the bytes sent, otherwise the tx buffer address
+
+typedef struct {
+    uint32_t magic;         // TFT_TRACE_MAGIC
+    uint16_t version;       // TFT_TRACE_VERSION
+    uint16_t record_size;   // sizeof(tft_trace_record_t)
+    uint32_t spi_clock;     // display write clock, DEFAULT_SPI_CLOCK
+    uint32_t rd_clock;      // read device clock, tft_max_rdclock
+    uint32_t count;         // number of records
+    uint32_t dropped;       // transactions not recorded, the buffer was full
+    uint8_t  queue_size;    // TFT_SPI_QUEUE_SIZE
+    uint8_t  read_dummy;    // TFT_READ_DUMMY_BITS
+    uint8_t  disp_type;     // tft_disp_type
+    uint8_t  reserved;
+} tft_trace_header_t;
+
+typedef struct {
+    uint32_t time;          // esp_timer time the transaction was started or queued at, us since TFT_trace_start()
+    uint32_t len_flags;     // bits 0..23: bytes sent (received for reads), bits 24..31: TFT_TRACE_xxx flags
+    uint32_t data;          // up to 4 bytes sent, first byte in the low bits, or the tx buffer address;
+                            // the command byte for reads
+} tft_trace_record_t;
+
+#define TFT_TRACE_LEN(rec)   ((rec)->len_flags & 0x00FFFFFF)
+#define TFT_TRACE_FLAGS(rec) ((rec)->len_flags >> 24)
+
+#endif
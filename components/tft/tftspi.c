@@ -9,9 +9,11 @@
 */
 
 #include <string.h>
+#include <math.h>
 #include "tftspi.h"
+#include "tft_bus.h"
 #include "freertos/task.h"
-#include "soc/spi_reg.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "esp_attr.h"
 
@@ -21,10 +23,16 @@
 // ==== Global variables, default values ==============
 
 // Converts colors to grayscale if set to 1
-uint8_t tft_gray_scale = 0; //TODO: put a macro in place that sets this value to a constant, which will enable many small automatic optimizations
+uint8_t tft_gray_scale = 0; // ignored with CONFIG_TFT_NO_GRAY_SCALE, see TFT_GRAY_SCALE_ACTIVE
+// Channel LUTs of the color transform, set by TFT_setColorTransform()
+uint8_t tft_color_lut_active = 0;
+uint8_t tft_color_lut[3][256];
 // Spi clock for reading data from display memory in Hz
 uint32_t tft_max_rdclock = 8000000;
 
+// Fills and buffer sends only queue their transactions if set to 1
+uint8_t tft_async = 0;
+
 // Default display dimensions
 int tft_width = DEFAULT_TFT_DISPLAY_WIDTH;
 int tft_height = DEFAULT_TFT_DISPLAY_HEIGHT;
@@ -32,506 +40,751 @@ int tft_height = DEFAULT_TFT_DISPLAY_HEIGHT;
 // Display type, DISP_TYPE_ILI9488 or DISP_TYPE_ILI9341
 uint8_t tft_disp_type = DEFAULT_DISP_TYPE;
 
-// Spi device handles for display and touch screen
-spi_device_handle_t tft_disp_spi = NULL;
+// Spi device handle for touch screen
 spi_device_handle_t tft_ts_spi = NULL;
 
+// Backend for all display transfers
+const tft_bus_t *tft_bus = &tft_bus_spi;
+
 // ====================================================
 
 
-static color_t *trans_cline = NULL;
+// RGB to GRAYSCALE constants, in 1/256
+// 0.2989  0.4870  0.2140
+#define GS_FACT_R 77
+#define GS_FACT_G 125
+#define GS_FACT_B 54
 
-// RGB to GRAYSCALE constants
-// 0.2989  0.5870  0.1140
-#define GS_FACT_R 0.2989
-#define GS_FACT_G 0.4870
-#define GS_FACT_B 0.2140
+// ==== Functions =====================
 
-// === transmission callback definitions ==============
+static void disp_pixel_runs_flush();
+static void disp_pixel_add(int16_t x, int16_t y, color_t color);
 
-// these functions are put into IRAM to speed up transmissions,
-// for efficiency setting CONFIG_SPU_MASTER_IN_IRAM in menuconfig might be desired
+//-----------------------------------
+TFT_fence_t IRAM_ATTR TFT_fence() {
+    // pixels waiting in the coalescer are part of the fence
+    disp_pixel_runs_flush();
+    return tft_bus->fence();
+}
 
-// struct for transaction callback information, it is a struct in order to be somewhat easily extensible
-//TODO: check if it is viable to put all instantiations of this into DRAM somehow
-typedef struct {
-    WORD_ALIGNED_ATTR uint32_t dc_level; // Display command/data pin level to set
-} tft_spi_user_t;
+//--------------------------------------------
+void IRAM_ATTR TFT_wait(TFT_fence_t fence) {
+    tft_bus->wait(fence);
+}
 
-static DMA_ATTR tft_spi_user_t tft_spi_user_command = {
-    .dc_level = 0,
-};
+//-----------------------------------------------------
+uint8_t IRAM_ATTR TFT_fence_done(TFT_fence_t fence) {
+    return tft_bus->fence_done(fence);
+}
 
-static DMA_ATTR tft_spi_user_t tft_spi_user_data = {
-    .dc_level = 1,
-};
+//---------------------------
+void IRAM_ATTR TFT_flush() {
+    disp_pixel_runs_flush();
+    // a buffering backend sends its content now
+    if (tft_bus->flush) tft_bus->flush();
+    tft_bus->wait(tft_bus->fence());
+}
 
-static DRAM_ATTR uint32_t last_DC_state = 42;
-void IRAM_ATTR TFT_transaction_begin_callback(spi_transaction_t* transaction){
-    uint32_t state_to_set = ((tft_spi_user_t*)transaction->user)->dc_level;
-    gpio_set_level(PIN_NUM_DC, state_to_set);
+//----------------------------------------
+void IRAM_ATTR disp_spi_invalidate_addrwin() {
+    tft_bus->invalidate();
 }
 
-// ==== Functions =====================
+// select calls of the task which holds the display can be nested, the bus is acquired by the
+// outermost one; another task acquires it too and waits until the holder deselected
+// Both are only written by the holder, while it holds the bus
+static uint8_t tft_select_depth = 0;
+static TaskHandle_t tft_select_owner = NULL;
+
+// The calling task has selected the display
+//----------------------------------------
+static inline uint8_t IRAM_ATTR disp_selected() {
+    return (tft_select_depth > 0) && (tft_select_owner == xTaskGetCurrentTaskHandle());
+}
 
 //-------------------------------
 inline esp_err_t IRAM_ATTR disp_select() {
     //TODO: check necessity for this function
-    return spi_device_acquire_bus(tft_disp_spi, portMAX_DELAY);
+    if (disp_selected()) {
+        tft_select_depth++;
+        return ESP_OK;
+    }
+
+    esp_err_t ret = tft_bus->acquire();
+    if (ret != ESP_OK) return ret;
+    tft_select_owner = xTaskGetCurrentTaskHandle();
+    tft_select_depth = 1;
+    return ESP_OK;
 }
 
 //---------------------------------
 inline esp_err_t IRAM_ATTR disp_deselect() {
     //TODO: check necessity for this function
-    spi_device_release_bus(tft_disp_spi);
+    if (!disp_selected()) return ESP_ERR_INVALID_STATE;
+    if (--tft_select_depth > 0) return ESP_OK;
+
+    // all pending pixels must be sent before the bus is released
+    disp_pixel_runs_flush();
+    tft_select_owner = NULL;
+    tft_bus->release();
     return ESP_OK;
 }
 
 // Send 1 byte display command, display must be selected
 //------------------------------------------------
-//Due to this being implemented as a blocking polling transaction,
-//you must not call this function while any other transaction is still unfinished.
+//The command is sent when the function returns,
+//all queued transactions are finished first.
 //As with the other functions, this function may never be called while it has not returned in another context.
 void IRAM_ATTR disp_spi_transfer_cmd(int8_t cmd) {
-    static spi_transaction_t command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {0},
-        .rx_buffer = NULL,
-    };
-    command_transaction.tx_data[0] = cmd;
-
-    esp_err_t ret = spi_device_polling_transmit(tft_disp_spi, &command_transaction);
-    ESP_ERROR_CHECK(ret);
+    disp_pixel_runs_flush();
+    tft_bus->cmd((uint8_t) cmd);
 }
 
 // Send command with data to display, display must be selected
 //----------------------------------------------------------------------------------
-//This is implemented with blocking polling transactions,
-//as such it may only be called when all prior transactions are finished.
+//The command and data are sent when the function returns,
+//all queued transactions are finished first.
 void IRAM_ATTR disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t len) {
-    esp_err_t ret;
+    disp_pixel_runs_flush();
+    tft_bus->cmd_data((uint8_t) cmd, data, len);
+}
 
-    //Command sending transaction
-    static spi_transaction_t command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {0},
-        .rx_buffer = NULL,
-    };
-    command_transaction.tx_data[0] = (uint8_t) cmd;
-    ret = spi_device_polling_transmit(tft_disp_spi, &command_transaction);
-    ESP_ERROR_CHECK(ret);
+// Convert color to gray scale
+//---------------------------------------
+color_t IRAM_ATTR color2gs(color_t color) {
+    color_t _color;
+    // the factors add up to 256, the result is at most 255
+    uint8_t gs_clr = ((GS_FACT_R * color.r) + (GS_FACT_G * color.g) + (GS_FACT_B * color.b)) >> 8;
 
-    //Data sending transaction
-    if ((len == 0) || (data == NULL)) return; //skip if no data is to be sent
-    static spi_transaction_t data_transaction = {
-        .flags = 0,
-        .user = &tft_spi_user_data,
-        .rx_buffer = NULL,
-    };
-    data_transaction.length = 8 * len;
-    data_transaction.tx_buffer = data;
+    _color.r = gs_clr;
+    _color.g = gs_clr;
+    _color.b = gs_clr;
 
-    ret = spi_device_polling_transmit(tft_disp_spi, &data_transaction);
+    return _color;
 }
 
-// Set the address window for display write & read commands
-//---------------------------------------------------------------------------------------------------
-static void IRAM_ATTR disp_spi_transfer_addrwin_start(uint16_t x1, uint16_t x2, uint16_t y1, uint16_t y2) {
-    // This function sets the address window by first sending a command to set the collumn range
-    // and then a command to send the row range
-    // separate transactions are used, to be able to set the controllers command pin
-    // through the use of a custom callback
+//=============================================================
+esp_err_t TFT_setColorTransform(const TFT_color_transform_t *t) {
+    if (t == NULL) {
+        tft_color_lut_active = 0;
+        return ESP_OK;
+    }
+    if (t->gamma < 0) return ESP_ERR_INVALID_ARG;
+
+    uint32_t brightness = (t->brightness) ? t->brightness : 255;
+    uint8_t gamma = ((t->gamma != 0) && (t->gamma != 1.0f));
+
+    // the LUTs are used by every fill, they must not change under a running one
+    TFT_wait(TFT_fence());
+    for (int v = 0; v < 256; v++) {
+        uint32_t out = v;
+        if (gamma) out = (uint32_t)((powf(v / 255.0f, 1.0f / t->gamma) * 255.0f) + 0.5f);
+        out = ((out * brightness) + 127) / 255;
+        if (t->invert) out = 255 - out;
+        for (int c = 0; c < 3; c++) {
+            tft_color_lut[c][v] = (t->curve[c]) ? t->curve[c][out] : (uint8_t)out;
+        }
+    }
+    tft_color_lut_active = 1;
+    return ESP_OK;
+}
 
-    esp_err_t ret;
+// ==== Hardware scrolling ===============================================================
+// The controller scrolls its GRAM rows in memory order (gate lines), these are the rows
+// of the display in portrait orientations and the columns in landscape orientations.
+// Drawing coordinates are not changed by the scroll position, the windows are mapped
+// to the GRAM lines where they are shown, a window crossing the wrap around line
+// of the scroll area is split.
 
-    // -- column setting command
+tft_scroll_t tft_scroll = {0};
+static uint8_t tft_madctl = 0;  // set by _tft_setRotation()
 
-    static const spi_transaction_t column_setting_command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_CASET, 0, 0, 0},
-        .rx_buffer = NULL,
-    };
+// Number of gate lines of the controller, the size of the scroll definition
+//---------------------------------
+static int disp_gate_lines() {
+    switch (TFT_DISP_TYPE) {
+        case DISP_TYPE_ILI9488:
+            return 480;
+        case DISP_TYPE_ST7735:
+        case DISP_TYPE_ST7735R:
+        case DISP_TYPE_ST7735B:
+            return 162;
+        default:
+            return 320;
+    }
+}
 
-    ret = spi_device_queue_trans(tft_disp_spi, &column_setting_command_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+// Number of lines from 'c' up to 'c2' which are shown on consecutive GRAM lines,
+// '*mc' is set to the GRAM line of 'c'
+//-----------------------------------------------------------------
+static int IRAM_ATTR disp_scroll_run(int c, int c2, int *mc) {
+    int n = c2 - c + 1;
 
-    // -- column setting data
-    // Arrange x coordinate window values
-    static spi_transaction_t column_setting_data_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_data,
-        .length = 32,
-        .rx_buffer = NULL,
-    };
-    column_setting_data_transaction.tx_data[0] = x1 >> 8;
-    column_setting_data_transaction.tx_data[1] = x1 &  0xff;
-    column_setting_data_transaction.tx_data[2] = x2 >> 8;
-    column_setting_data_transaction.tx_data[3] = x2 &  0xff;
-    
-    ret = spi_device_queue_trans(tft_disp_spi, &column_setting_data_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);;
-
-    // -- row setting command
-
-    static const spi_transaction_t row_setting_command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_PASET, 0, 0, 0},
-        .rx_buffer = NULL,
-    };
-
-    ret = spi_device_queue_trans(tft_disp_spi, &row_setting_command_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+    if ((c < tft_scroll.first) || (c > tft_scroll.last)) {
+        *mc = c;
+        if ((c < tft_scroll.first) && (n > (tft_scroll.first - c))) n = tft_scroll.first - c;
+    }
+    else {
+        int k = (c - tft_scroll.first + tft_scroll.offset) % tft_scroll.lines;
+        *mc = tft_scroll.first + k;
+        if (n > (tft_scroll.lines - k)) n = tft_scroll.lines - k;
+        if (n > (tft_scroll.last + 1 - c)) n = tft_scroll.last + 1 - c;
+    }
+    return n;
+}
 
-    // -- row setting data
-    // Arrange x coordinate window values
-    static spi_transaction_t row_setting_data_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_data,
-        .length = 32,
-        .rx_buffer = NULL,
-    };
-    row_setting_data_transaction.tx_data[0] = y1 >> 8;
-    row_setting_data_transaction.tx_data[1] = y1 &  0xff;
-    row_setting_data_transaction.tx_data[2] = y2 >> 8;
-    row_setting_data_transaction.tx_data[3] = y2 &  0xff;
-    
-    ret = spi_device_queue_trans(tft_disp_spi, &row_setting_data_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+// Map one point to the GRAM position where it is shown
+//-----------------------------------------------------------
+static void IRAM_ATTR disp_scroll_point(int16_t *x, int16_t *y) {
+    int mc;
+    int16_t *c = (tft_scroll.cols) ? x : y;
+
+    disp_scroll_run(*c, *c, &mc);
+    *c = mc;
 }
 
-static void IRAM_ATTR disp_spi_transfer_addrwin_polling(uint16_t x1, uint16_t x2, uint16_t y1, uint16_t y2) {
-    // This function sets the address window by first sending a command to set the collumn range
-    // and then a command to send the row range
-    // separate transactions are used, to be able to set the controllers command pin
-    // through the use of a custom callback
+// Operation on a part of a mapped window, 'first' is the index of its first pixel in the window
+typedef void (*tft_scroll_op_t)(int x1, int y1, int x2, int y2, uint32_t first, uint32_t len, void *arg);
+
+// Call 'op' for the parts of the window (x1,y1),(x2,y2) with 'len' pixels as they are mapped
+// to the GRAM, the pixels of every part are consecutive in the window
+//----------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_scroll_windows(int x1, int y1, int x2, int y2, uint32_t len, tft_scroll_op_t op, void *arg) {
+    uint32_t w = x2 - x1 + 1;
+    int mc, n;
+
+    if (!tft_scroll.cols) {
+        for (int y = y1; y <= y2; y += n) {
+            uint32_t first = (y - y1) * w;
+            if (first >= len) break;
+            n = disp_scroll_run(y, y2, &mc);
+            uint32_t part = n * w;
+            if (part > (len - first)) part = len - first;
+            op(x1, mc, x2, mc + n - 1, first, part, arg);
+        }
+        return;
+    }
 
-    esp_err_t ret;
+    n = disp_scroll_run(x1, x2, &mc);
+    if (n == (int)w) {
+        op(mc, y1, mc + n - 1, y2, 0, len, arg);
+        return;
+    }
+    // the columns are split, every row is sent in parts
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x += n) {
+            uint32_t first = ((y - y1) * w) + (x - x1);
+            if (first >= len) return;
+            n = disp_scroll_run(x, x2, &mc);
+            uint32_t part = n;
+            if (part > (len - first)) part = len - first;
+            op(mc, y, mc + n - 1, y, first, part, arg);
+        }
+    }
+}
 
-    // -- column setting command
+typedef struct {
+    color_t color;
+    uint8_t sync;
+} tft_scroll_fill_t;
 
-    static const spi_transaction_t column_setting_command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_CASET, 0, 0, 0},
-        .rx_buffer = NULL,
-    };
+//-------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_fill_op(int x1, int y1, int x2, int y2, uint32_t first, uint32_t len, void *arg) {
+    (void)first;
+    tft_scroll_fill_t *fill = (tft_scroll_fill_t *)arg;
 
-    ret = spi_device_polling_transmit(tft_disp_spi, &column_setting_command_transaction);
-    ESP_ERROR_CHECK(ret);
+    tft_bus->window(x1, y1, x2, y2);
+    tft_bus->fill(fill->color, len, fill->sync);
+}
 
-    // -- column setting data
-    // Arrange x coordinate window values
-    static spi_transaction_t column_setting_data_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_data,
-        .length = 32,
-        .rx_buffer = NULL,
-    };
-    column_setting_data_transaction.tx_data[0] = x1 >> 8;
-    column_setting_data_transaction.tx_data[1] = x1 &  0xff;
-    column_setting_data_transaction.tx_data[2] = x2 >> 8;
-    column_setting_data_transaction.tx_data[3] = x2 &  0xff;
-    
-    ret = spi_device_polling_transmit(tft_disp_spi, &column_setting_data_transaction);
-    ESP_ERROR_CHECK(ret);;
-
-    // -- row setting command
-
-    static const spi_transaction_t row_setting_command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_PASET, 0, 0, 0},
-        .rx_buffer = NULL,
-    };
-
-    ret = spi_device_polling_transmit(tft_disp_spi, &row_setting_command_transaction);
-    ESP_ERROR_CHECK(ret);
+//-------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_send_op(int x1, int y1, int x2, int y2, uint32_t first, uint32_t len, void *arg) {
+    tft_bus->window(x1, y1, x2, y2);
+    tft_bus->send((const uint8_t *)arg + (first * TFT_PIXEL_BYTES), len);
+}
 
-    // -- row setting data
-    // Arrange x coordinate window values
-    static spi_transaction_t row_setting_data_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_data,
-        .length = 32,
-        .rx_buffer = NULL,
-    };
-    row_setting_data_transaction.tx_data[0] = y1 >> 8;
-    row_setting_data_transaction.tx_data[1] = y1 &  0xff;
-    row_setting_data_transaction.tx_data[2] = y2 >> 8;
-    row_setting_data_transaction.tx_data[3] = y2 &  0xff;
-    
-    ret = spi_device_polling_transmit(tft_disp_spi, &row_setting_data_transaction);
-    ESP_ERROR_CHECK(ret);
+//-------------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_send_colors_op(int x1, int y1, int x2, int y2, uint32_t first, uint32_t len, void *arg) {
+    tft_bus->window(x1, y1, x2, y2);
+    tft_bus->send_colors((const color_t *)arg + first, len);
 }
 
-static void IRAM_ATTR disp_spi_transfer_addrwin_finish() {
-    spi_transaction_t* result_transaction;
-    esp_err_t ret;
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+typedef struct {
+    uint8_t *buf;
+    esp_err_t res;
+} tft_scroll_read_t;
+
+//-------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_read_op(int x1, int y1, int x2, int y2, uint32_t first, uint32_t len, void *arg) {
+    tft_scroll_read_t *rd = (tft_scroll_read_t *)arg;
+
+    if (rd->res != ESP_OK) return;
+    tft_bus->window(x1, y1, x2, y2);
+    rd->res = tft_bus->read(rd->buf + (first * 3), len);
 }
 
-// Convert color to gray scale
-//----------------------------------------------
-static color_t IRAM_ATTR color2gs(color_t color) {
-    color_t _color;
-    float gs_clr = GS_FACT_R * color.r + GS_FACT_G * color.g + GS_FACT_B * color.b;
-    if (gs_clr > 255) gs_clr = 255;
+// Fill the window with the color, mapped to the scroll position
+//------------------------------------------------------------------------------------------------------
+static void IRAM_ATTR disp_fill_windows(int x1, int y1, int x2, int y2, color_t color, uint32_t len, uint8_t sync) {
+    if (tft_scroll.active) {
+        tft_scroll_fill_t fill = { .color = color, .sync = sync };
+        disp_scroll_windows(x1, y1, x2, y2, len, disp_fill_op, &fill);
+    }
+    else {
+        tft_bus->window(x1, y1, x2, y2);
+        tft_bus->fill(color, len, sync);
+    }
+}
 
-    _color.r = (uint8_t)gs_clr;
-    _color.g = (uint8_t)gs_clr;
-    _color.b = (uint8_t)gs_clr;
+// The axis of the lines is mirrored against the gate lines (MADCTL MY, or MX with MV)
+//-------------------------------
+static uint8_t disp_gates_mirrored() {
+    return (tft_madctl & ((tft_madctl & MADCTL_MV) ? MADCTL_MX : MADCTL_MY)) != 0;
+}
 
-    return _color;
+// Send the scroll definition and the scroll start address for the current state
+//-----------------------------
+static void disp_scroll_send() {
+    int gates = disp_gate_lines();
+    uint16_t tfa = 0, vsa = gates, vsp = 0;
+
+    if (tft_scroll.active) {
+        vsa = tft_scroll.lines;
+        if (disp_gates_mirrored()) {
+            tfa = gates - 1 - tft_scroll.last;
+            vsp = tfa + ((tft_scroll.lines - tft_scroll.offset) % tft_scroll.lines);
+        }
+        else {
+            tfa = tft_scroll.first;
+            vsp = tfa + tft_scroll.offset;
+        }
+    }
+    uint16_t bfa = gates - tfa - vsa;
+    uint8_t def[6] = { tfa >> 8, tfa & 0xFF, vsa >> 8, vsa & 0xFF, bfa >> 8, bfa & 0xFF };
+    uint8_t start[2] = { vsp >> 8, vsp & 0xFF };
+
+    if (disp_select() == ESP_OK) {
+        disp_spi_transfer_cmd_data(TFT_VSCRDEF, def, 6);
+        disp_spi_transfer_cmd_data(TFT_VSCRSADD, start, 2);
+        disp_deselect();
+    }
+}
+
+// The controller is in partial mode (PTLON sent), also while the display is off or sleeping
+static uint8_t tft_partial_on = 0;
+
+//=======================================================
+esp_err_t disp_scroll_set(int first, int last, int offset) {
+    // open pixel runs are mapped with the old position
+    disp_pixel_runs_flush();
+
+    if ((first > last) || (first < 0) || (last >= disp_gate_lines())) {
+        if (!tft_scroll.active) return ESP_OK;
+        tft_scroll.active = 0;
+    }
+    else {
+        // the controllers leave the scroll mode in partial mode and with NORON
+        if (tft_partial_on) return ESP_ERR_INVALID_STATE;
+        tft_scroll.active = 1;
+        tft_scroll.first = first;
+        tft_scroll.last = last;
+        tft_scroll.lines = last - first + 1;
+        offset %= tft_scroll.lines;
+        tft_scroll.offset = (offset < 0) ? offset + tft_scroll.lines : offset;
+    }
+    disp_scroll_send();
+    return ESP_OK;
+}
+
+// ==== Power states =====================================================================
+
+TFT_power_t tft_power = TFT_POWER_ON;
+uint8_t tft_gram_valid = 0;
+uint32_t tft_resume_us = 0;
+
+static int tft_partial_first = 0;       // partial area, in display coordinates
+static int tft_partial_last = -1;
+static int64_t tft_slpout_time = 0;     // esp_timer time of the last SLPOUT and SLPIN
+static int64_t tft_slpin_time = 0;
+
+// Wait until 'ms' milliseconds have passed since 't'
+//-------------------------------------------------
+static void disp_wait_since(int64_t t, uint32_t ms) {
+    int64_t left = (t + (ms * 1000)) - esp_timer_get_time();
+    if (left > 0) vTaskDelay((left + (portTICK_PERIOD_MS * 1000) - 1) / (portTICK_PERIOD_MS * 1000));
+}
+
+// Time the controller needs after SLPIN or SLPOUT before the next command, in ms
+//----------------------------------
+static uint32_t disp_sleep_delay() {
+    switch (TFT_DISP_TYPE) {
+        case DISP_TYPE_ST7735:
+        case DISP_TYPE_ST7735R:
+        case DISP_TYPE_ST7735B:
+            return 120;
+        default:
+            return 5;
+    }
+}
+
+// Send the partial area in gate lines
+//--------------------------------
+static void disp_partial_send() {
+    int gates = disp_gate_lines();
+    uint16_t sr = tft_partial_first, er = tft_partial_last;
+
+    if (disp_gates_mirrored()) {
+        sr = gates - 1 - tft_partial_last;
+        er = gates - 1 - tft_partial_first;
+    }
+    uint8_t area[4] = { sr >> 8, sr & 0xFF, er >> 8, er & 0xFF };
+    disp_spi_transfer_cmd_data(TFT_PTLAR, area, 4);
+}
+
+//=================================================
+esp_err_t disp_partial_set(int first, int last) {
+    if ((first > last) || (first < 0) || (last >= disp_gate_lines())) return ESP_ERR_INVALID_ARG;
+
+    tft_partial_first = first;
+    tft_partial_last = last;
+    if (tft_power == TFT_POWER_PARTIAL) {
+        if (disp_select() != ESP_OK) return ESP_FAIL;
+        disp_partial_send();
+        disp_deselect();
+    }
+    return ESP_OK;
+}
+
+//=============================================
+esp_err_t TFT_setPower(TFT_power_t state) {
+    esp_err_t ret;
+    TFT_power_t from = tft_power;
+    int64_t t_start = esp_timer_get_time();
+
+    if (state > TFT_POWER_SLEEP) return ESP_ERR_INVALID_ARG;
+    if (state == from) return ESP_OK;
+    if ((state == TFT_POWER_PARTIAL) && ((tft_partial_first > tft_partial_last) || (tft_scroll.active))) return ESP_ERR_INVALID_STATE;
+
+    ret = disp_select();
+    if (ret != ESP_OK) return ret;
+
+    if (from == TFT_POWER_SLEEP) {
+        disp_wait_since(tft_slpin_time, disp_sleep_delay());
+        disp_spi_transfer_cmd(TFT_CMD_SLPOUT);
+        tft_slpout_time = esp_timer_get_time();
+        disp_wait_since(tft_slpout_time, disp_sleep_delay());
+    }
+    // the partial mode is kept in sleep, it is changed only when the display is shown
+    if ((state == TFT_POWER_PARTIAL) && (from != TFT_POWER_PARTIAL)) {
+        disp_partial_send();
+        disp_spi_transfer_cmd(TFT_CMD_PTLON);
+        tft_partial_on = 1;
+    }
+    else if ((state == TFT_POWER_ON) && (tft_partial_on)) {
+        disp_spi_transfer_cmd(TFT_CMD_NORON);
+        tft_partial_on = 0;
+    }
+
+    if ((state == TFT_POWER_ON) || (state == TFT_POWER_PARTIAL)) {
+        if ((from == TFT_POWER_OFF) || (from == TFT_POWER_SLEEP)) disp_spi_transfer_cmd(TFT_DISPON);
+    }
+    else if ((from == TFT_POWER_ON) || (from == TFT_POWER_PARTIAL)) disp_spi_transfer_cmd(TFT_DISPOFF);
+
+    if (state == TFT_POWER_SLEEP) {
+        // SLPIN is not allowed within 120 ms after SLPOUT
+        disp_wait_since(tft_slpout_time, 120);
+        disp_spi_transfer_cmd(TFT_CMD_SLPIN);
+        tft_slpin_time = esp_timer_get_time();
+    }
+
+    disp_deselect();
+    tft_power = state;
+    if ((from == TFT_POWER_SLEEP) || (from == TFT_POWER_OFF)) tft_resume_us = (uint32_t)(esp_timer_get_time() - t_start);
+    return ESP_OK;
+}
+
+//=====================
+void TFT_gramInvalidate() {
+    tft_gram_valid = 0;
 }
 
 // Set display pixel at given coordinates to given color
 //------------------------------------------------------------------------
 //IMPORTANT: this function assumes half duplex operation,
 //           in previous versions this was checked, now it is assumed
-//this function is fairly inefficient, as it resets the operation window every time
+//if the display is selected, the pixel is coalesced with its neighbours (see disp_pixel_add)
+//and sent later, otherwise it is sent at once, which is fairly inefficient
 void IRAM_ATTR drawPixel(int16_t x, int16_t y, color_t color)
 {
-    esp_err_t ret;
-    color_t _color = color;
-    if (tft_gray_scale) _color = color2gs(color);
-    disp_spi_transfer_addrwin_polling(x, x+1, y, y+1);
-    //writing command transaction
-    static const spi_transaction_t command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_RAMWR, 0, 0, 0},
-        .rx_buffer = NULL,
-    };
-
-    ret = spi_device_polling_transmit(tft_disp_spi, &command_transaction);
-    ESP_ERROR_CHECK(ret);
-    
-    //color transaction
-    static spi_transaction_t color_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_data,
-        .length = 24,
-        .rx_buffer = NULL,
-    };
-    color_transaction.tx_data[0] = _color.r;
-    color_transaction.tx_data[1] = _color.g;
-    color_transaction.tx_data[2] = _color.b;
-
-    ret = spi_device_polling_transmit(tft_disp_spi, &color_transaction);
-    ESP_ERROR_CHECK(ret);
+    if (disp_selected()) {
+        disp_pixel_add(x, y, color);
+        return;
+    }
+
+    color_t _color = TFT_color_apply(color);
+    if (tft_scroll.active) disp_scroll_point(&x, &y);
+    tft_bus->window(x, y, x+1, y+1);
+    tft_bus->fill(_color, 1, 1);
+    tft_bus->wait(tft_bus->fence());
 }
 
-//DMA buffer for repeating filling
-#define tft_repeat_buffer_size TFT_REPEAT_BUFFER_SIZE
-static DMA_ATTR color_t tft_repeat_buffer[tft_repeat_buffer_size] = {0};
+// === Pixel coalescer ===
+// While the display is selected, pixels drawn with drawPixel() are collected into single color
+// horizontal or vertical runs, each run is sent as one window + data burst.
+// Open runs never overlap, so they can be sent in any order.
+// The runs are sent before any other display operation and by the outermost disp_deselect().
+#define TFT_PIXEL_RUNS 16
 
-// Write 'len' color data to TFT 'window' (x1,y2),(x2,y2)
-//-------------------------------------------------------------------------------------------
-// This implementation relies on filling the dma queue with transactions from tft_repeat_buffer
-// if two consecutive calls of this function use the same fill color, the filling of the buffer
-// can be omitted, which speeds up the operation
-void IRAM_ATTR TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
-{
-    assert(sizeof(color_t) == 3);
-    esp_err_t ret;
+typedef struct {
+    int16_t x1;
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+    color_t color;
+    uint32_t last_use;   // value of tft_pixel_run_uses at the last use
+} tft_pixel_run_t;
 
-    disp_spi_transfer_addrwin_start(x1, x2, y1, y2);
+static tft_pixel_run_t tft_pixel_runs[TFT_PIXEL_RUNS];
+static uint8_t tft_pixel_runs_open = 0;  // runs 0 ~ tft_pixel_runs_open-1 are open
+static uint32_t tft_pixel_run_uses = 0;
 
-    static const spi_transaction_t command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_RAMWR, 0},
-        .rx_buffer = NULL,
-    };
-    ret = spi_device_queue_trans(tft_disp_spi, &command_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+// Queue the run and close it, the last open run takes its place
+//-----------------------------------------------------
+static void IRAM_ATTR disp_pixel_run_send(uint8_t idx) {
+    tft_pixel_run_t *run = &tft_pixel_runs[idx];
+    color_t _color = TFT_color_apply(run->color);
 
-    color_t _color = color;
-    if(tft_gray_scale) {
-        _color = color2gs(color);
-    }
-    
-    if(len <= 10){
-        static spi_transaction_t color_transaction_single = {
-            .flags = SPI_TRANS_USE_TXDATA,
-            .user = &tft_spi_user_data,
-            .length = 24,
-            .tx_data = {0},
-            .rx_buffer = NULL,
-        };
-        color_transaction_single.tx_data[0] = _color.r;
-        color_transaction_single.tx_data[1] = _color.g;
-        color_transaction_single.tx_data[2] = _color.b;
-
-        disp_spi_transfer_addrwin_finish();
-        spi_transaction_t* result_transaction;
-        ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-        ESP_ERROR_CHECK(ret);
-
-        for(uint32_t count = 0; count < len; count++){
-            ret = spi_device_polling_transmit(tft_disp_spi, &color_transaction_single);
-            ESP_ERROR_CHECK(ret);
-        }
-    } else {
-        //Set up the dma buffer to fill the screen from
-        //if the buffer is already filled with the color we want, we can skip this
-        if(tft_repeat_buffer[0].r != _color.r || tft_repeat_buffer[0].g != _color.g || tft_repeat_buffer[0].b != _color.b){
-            for(size_t i = 0; i < tft_repeat_buffer_size; i++){
-                tft_repeat_buffer[i] = _color;
+    uint32_t len = (run->x2 - run->x1 + 1) * (run->y2 - run->y1 + 1);
+    disp_fill_windows(run->x1, run->y1, run->x2, run->y2, _color, len, 0);
+
+    tft_pixel_runs_open--;
+    if (idx != tft_pixel_runs_open) *run = tft_pixel_runs[tft_pixel_runs_open];
+}
+
+// Queue all open runs
+//-----------------------------------------
+static void IRAM_ATTR disp_pixel_runs_flush() {
+    // the runs belong to the task which selected the display
+    if (!disp_selected()) return;
+    while (tft_pixel_runs_open > 0) disp_pixel_run_send(tft_pixel_runs_open - 1);
+}
+
+// Add the pixel to an open run or start a new one
+//-------------------------------------------------------------------------
+static void IRAM_ATTR disp_pixel_add(int16_t x, int16_t y, color_t color) {
+    int target = -1;
+
+    tft_pixel_run_uses++;
+    // from the last run, so a closed run is replaced by an already checked one
+    for (int i = tft_pixel_runs_open - 1; i >= 0; i--) {
+        tft_pixel_run_t *run = &tft_pixel_runs[i];
+        uint8_t same_color = (run->color.r == color.r) && (run->color.g == color.g) && (run->color.b == color.b);
+
+        if ((x >= run->x1) && (x <= run->x2) && (y >= run->y1) && (y <= run->y2)) {
+            if (same_color) {
+                run->last_use = tft_pixel_run_uses;
+                return;
             }
+            // the new pixel must overwrite this one, send it first
+            if (target == (tft_pixel_runs_open - 1)) target = i;
+            disp_pixel_run_send(i);
+            continue;
         }
-
-        uint32_t queued_transactions = 1; //start off with one, for the command transaction
-        uint32_t still_to_send = len;
-        static const spi_transaction_t color_transaction = {
-            .flags = 0,
-            .user = &tft_spi_user_data,
-            .length = 3*8*tft_repeat_buffer_size,
-            .tx_buffer = &tft_repeat_buffer,
-            .rx_buffer = NULL,
-        };
-        while (still_to_send >= tft_repeat_buffer_size) {
-            still_to_send -= tft_repeat_buffer_size;
-
-            queued_transactions++;
-            ret = spi_device_queue_trans(tft_disp_spi, &color_transaction, portMAX_DELAY);
-            ESP_ERROR_CHECK(ret);
+        if ((target < 0) && (same_color) &&
+            (((run->y1 == run->y2) && (y == run->y1) && ((x == run->x1 - 1) || (x == run->x2 + 1))) ||
+             ((run->x1 == run->x2) && (x == run->x1) && ((y == run->y1 - 1) || (y == run->y2 + 1))))) {
+            target = i;
         }
+    }
 
-        if (still_to_send > 0) {
-            static spi_transaction_t color_transaction_partial = {
-                .flags = 0,
-                .user = &tft_spi_user_data,
-                .tx_buffer = &tft_repeat_buffer,
-                .rx_buffer = NULL,
-            };
-            color_transaction_partial.length = 3*8*still_to_send;
-            queued_transactions++;
-            ret = spi_device_queue_trans(tft_disp_spi, &color_transaction_partial, portMAX_DELAY);
-            ESP_ERROR_CHECK(ret);
-        }
+    if (target >= 0) {
+        tft_pixel_run_t *run = &tft_pixel_runs[target];
+        if (x < run->x1) run->x1 = x;
+        if (x > run->x2) run->x2 = x;
+        if (y < run->y1) run->y1 = y;
+        if (y > run->y2) run->y2 = y;
+        run->last_use = tft_pixel_run_uses;
+        return;
+    }
 
-        disp_spi_transfer_addrwin_finish();
-        while(queued_transactions-- > 0){
-            spi_transaction_t* result_transaction;
-            ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-            ESP_ERROR_CHECK(ret);
+    if (tft_pixel_runs_open >= TFT_PIXEL_RUNS) {
+        // send the least recently used run
+        uint8_t lru = 0;
+        for (uint8_t i = 1; i < tft_pixel_runs_open; i++) {
+            if (tft_pixel_runs[i].last_use < tft_pixel_runs[lru].last_use) lru = i;
         }
+        disp_pixel_run_send(lru);
     }
+
+    tft_pixel_run_t *run = &tft_pixel_runs[tft_pixel_runs_open++];
+    run->x1 = x;
+    run->x2 = x;
+    run->y1 = y;
+    run->y2 = y;
+    run->color = color;
+    run->last_use = tft_pixel_run_uses;
+}
+
+// Write 'len' color data to TFT 'window' (x1,y2),(x2,y2)
+//-------------------------------------------------------------------------------------------
+// The fill is done by the bus backend, in async mode the function returns
+// as soon as the fill is queued
+void IRAM_ATTR TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+    assert(sizeof(color_t) == 3);
+
+    disp_pixel_runs_flush();
+
+    color_t _color = TFT_color_apply(color);
+
+    disp_fill_windows(x1, y1, x2, y2, _color, len, !tft_async);
+
+    if (!tft_async) TFT_wait(TFT_fence());
 }
-#undef tft_repeat_buffer_size
+
+// Fence of the last send_data_start()
+static TFT_fence_t send_data_fence = 0;
 
 // Write 'len' color data to TFT 'window' (x1,y2),(x2,y2) from given buffer
-//-----------------------------------------------------------------------------------
-void IRAM_ATTR send_data_start(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf) {
-    esp_err_t ret;
+//-----------------------------------------------------------------------------------------
+//without a color transform 18-bit colors are sent from the buffer itself,
+//otherwise the bus backend converts them into its staging buffers
+TFT_fence_t IRAM_ATTR send_data_start(int x1, int y1, int x2, int y2, uint32_t len, const color_t *buf) {
+#if TFT_PIXEL_BYTES == 3
+    if (!TFT_COLOR_TRANSFORM_ACTIVE) return send_pixels_start(x1, y1, x2, y2, len, (const uint8_t *)buf);
+#endif
+    disp_pixel_runs_flush();
 
-    disp_spi_transfer_addrwin_start(x1, x2, y1, y2);
+    if (tft_scroll.active) disp_scroll_windows(x1, y1, x2, y2, len, disp_send_colors_op, (void *)buf);
+    else {
+        tft_bus->window(x1, y1, x2, y2);
+        tft_bus->send_colors(buf, len);
+    }
 
-    static const spi_transaction_t command_transaction = {
-        .flags = SPI_TRANS_USE_TXDATA,
-        .user = &tft_spi_user_command,
-        .length = 8,
-        .tx_data = {TFT_RAMWR, 0},
-        .rx_buffer = NULL,
-    };
-    ret = spi_device_queue_trans(tft_disp_spi, &command_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+    send_data_fence = TFT_fence();
+    return send_data_fence;
+}
 
-    static spi_transaction_t data_transaction = {
-        .flags = 0,
-        .user = &tft_spi_user_data,
-        .rx_buffer = NULL,
-    };
-    data_transaction.length = 8 * 3 * len;
-    data_transaction.tx_buffer = (uint8_t*) buf;
-
-    if (tft_gray_scale) {
-        for (int n=0; n<len; n++) {
-            buf[n] = color2gs(buf[n]);
-        }
+// Write 'len' pixels in the display pixel format to TFT 'window' (x1,y2),(x2,y2)
+//-------------------------------------------------------------------------------------------------------
+TFT_fence_t IRAM_ATTR send_pixels_start(int x1, int y1, int x2, int y2, uint32_t len, const uint8_t *pixels) {
+    disp_pixel_runs_flush();
+
+    if (tft_scroll.active) disp_scroll_windows(x1, y1, x2, y2, len, disp_send_op, (void *)pixels);
+    else {
+        tft_bus->window(x1, y1, x2, y2);
+        tft_bus->send(pixels, len);
     }
 
-    ret = spi_device_queue_trans(tft_disp_spi, &data_transaction, portMAX_DELAY);
+    send_data_fence = TFT_fence();
+    return send_data_fence;
 }
 
+//------------------------------------
 void IRAM_ATTR send_data_finish() {
-    disp_spi_transfer_addrwin_finish();
-    esp_err_t ret;
-    spi_transaction_t* result_transaction;
-    //Waiting for the command transaciton
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
-    //waiting for the data transaction
-    ret = spi_device_get_trans_result(tft_disp_spi, &result_transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret);
+    TFT_wait(send_data_fence);
+}
+
+// Write the 'w' x 'h' pixels in the display pixel format at 'pixels', rows 'stride' pixels apart,
+// to the window at (x,y); the pixels can change when it returns
+//----------------------------------------------------------------------------------------------------------
+void IRAM_ATTR send_rect_pixels(int x, int y, uint32_t w, uint32_t h, const uint8_t *pixels, uint32_t stride) {
+    disp_pixel_runs_flush();
+
+    if (tft_scroll.active) {
+        // each row is mapped to the scroll position, it is sent from 'pixels'
+        for (uint32_t row = 0; row < h; row++, pixels += stride * TFT_PIXEL_BYTES) {
+            disp_scroll_windows(x, y + row, x + w - 1, y + row, w, disp_send_op, (void *)pixels);
+        }
+        tft_bus->wait(tft_bus->fence());
+    }
+    else {
+        tft_bus->window(x, y, x + w - 1, y + h - 1);
+        tft_bus->send_rect(pixels, w, h, stride);
+    }
 }
 
 // Reads 'len' pixels/colors from the TFT's GRAM 'window'
 // 'buf' is an array of bytes with 1st byte reserved for reading 1 dummy byte
 // and the rest is actually an array of color_t values
+// 'set_sp' is not used, reads always run at tft_max_rdclock
 //--------------------------------------------------------------------------------------------
 int IRAM_ATTR read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp) {
-    spi_transaction_t t;
-    uint32_t current_clock = 0;
-
-    memset(&t, 0, sizeof(t));  //Zero out the transaction
-    memset(buf, 0, len*sizeof(color_t));
+    (void)set_sp;
+    esp_err_t res;
 
-    //TODO: check if this functionality can be recovered
-    // if (set_sp) {
-    //     if (disp_deselect() != ESP_OK) return -1;
-    //     // Change spi clock if needed
-    //     current_clock = spi_get_speed(tft_disp_spi);
-    //     if (tft_max_rdclock < current_clock) spi_set_speed(tft_disp_spi, tft_max_rdclock);
-    // }
+    memset(buf, 0, (len*sizeof(color_t)) + 1);
 
     if (disp_select() != ESP_OK) {
         return -2;
     }
 
-    // ** Send address window **
-    disp_spi_transfer_addrwin_start(x1, x2, y1, y2);
-    disp_spi_transfer_addrwin_finish();
-
     // ** GET pixels/colors **
-    disp_spi_transfer_cmd(TFT_RAMRD);
+    // the dummy byte is skipped by the backend, buf[0] stays 0
+    TFT_wait(TFT_fence());
+    if (tft_scroll.active) {
+        tft_scroll_read_t rd = { .buf = buf + 1, .res = ESP_OK };
+        disp_scroll_windows(x1, y1, x2, y2, len, disp_read_op, &rd);
+        res = rd.res;
+    }
+    else {
+        tft_bus->window(x1, y1, x2, y2);
+        res = tft_bus->read(buf + 1, len);
+    }
 
-    t.length    = 0;                   //Send nothing
-    t.tx_buffer = NULL;
-    t.rxlength  = 8 * ((len * 3) + 1); //Receive size in bits
-    t.rx_buffer = buf;
-    t.user      = &tft_spi_user_data;
+    disp_deselect();
 
-    esp_err_t res = spi_device_polling_transmit(tft_disp_spi, &t);
-    // esp_err_t res = spi_transfer_data(tft_disp_spi, &t); // Receive using direct mode
+    return res;
+}
 
-    disp_deselect();
+// Reads the GRAM window (x1,y1),(x2,y2) into 'dst' which has 'stride' pixels per row
+// The read is split into chunks of at most TFT_READ_CHUNK_PIXELS pixels,
+// each chunk is received directly into 'dst' and converted there to 8 bits per color component.
+//----------------------------------------------------------------------------------------------
+esp_err_t IRAM_ATTR read_rect(int x1, int y1, int x2, int y2, color_t *dst, int stride) {
+    int w = x2 - x1 + 1;
+    int rows = 1, seg = w;
+    esp_err_t res = ESP_OK;
+
+    if ((w <= 0) || (y2 < y1)) return ESP_OK;
+
+    // whole rows per chunk if they are contiguous in 'dst', otherwise parts of one row
+    if (w > TFT_READ_CHUNK_PIXELS) seg = TFT_READ_CHUNK_PIXELS;
+    else if (stride == w) rows = TFT_READ_CHUNK_PIXELS / w;
+
+    res = disp_select();
+    if (res != ESP_OK) return res;
+    TFT_wait(TFT_fence());
+
+    for (int y = y1; (y <= y2) && (res == ESP_OK); y += rows) {
+        int ye = y + rows - 1;
+        if (ye > y2) ye = y2;
+        for (int x = x1; (x <= x2) && (res == ESP_OK); x += seg) {
+            int xe = x + seg - 1;
+            if (xe > x2) xe = x2;
+            int len = (xe - x + 1) * (ye - y + 1);
+            uint8_t *buf = (uint8_t *)&dst[((y - y1) * stride) + (x - x1)];
+
+            if (tft_scroll.active) {
+                tft_scroll_read_t rd = { .buf = buf, .res = ESP_OK };
+                disp_scroll_windows(x, y, xe, ye, len, disp_read_op, &rd);
+                res = rd.res;
+            }
+            else {
+                tft_bus->window(x, y, xe, ye);
+                res = tft_bus->read(buf, len);
+            }
+            if (res != ESP_OK) break;
 
-    // if (set_sp) {
-    //     // Restore spi clock if needed
-    //     if (tft_max_rdclock < current_clock) spi_set_speed(tft_disp_spi, current_clock);
-    // }
+            // 6 bits per component are read, the low bits are undefined
+            for (int n = 0; n < (len * 3); n++) {
+                uint8_t c = buf[n] & 0xFC;
+                buf[n] = c | (c >> 6);
+            }
+        }
+    }
 
+    disp_deselect();
     return res;
 }
 
@@ -555,7 +808,7 @@ color_t IRAM_ATTR readPixel(int16_t x, int16_t y) {
 // Companion code to the initialization table.
 // Reads and issues a series of LCD commands stored in byte array
 //---------------------------------------------------------------------------
-static void commandList(spi_device_handle_t spi, const uint8_t *addr) {
+void commandList(const uint8_t *addr) {
     uint8_t  numCommands, numArgs, cmd;
     uint16_t ms;
 
@@ -575,7 +828,11 @@ static void commandList(spi_device_handle_t spi, const uint8_t *addr) {
             if(ms == 255) {
                 ms = 500;    // If 255, delay for 500 ms
             }
+            // release the bus during the delay, other devices on it (touch) can be used meanwhile
+            uint8_t held = (tft_select_depth == 1);
+            if (held) disp_deselect();
             vTaskDelay(ms / portTICK_RATE_MS);
+            if (held) disp_select();
         }
     }
 }
@@ -584,7 +841,7 @@ static void commandList(spi_device_handle_t spi, const uint8_t *addr) {
 void _tft_setRotation(uint8_t rot) {
     uint8_t rotation = rot & 3; // can't be higher than 3
     uint8_t send = 1;
-    static uint8_t madctl = 0;
+    uint8_t madctl = 0;
     uint16_t tmp;
 
     if ((rotation & 1)) {
@@ -664,6 +921,12 @@ void _tft_setRotation(uint8_t rot) {
         break;
     }
     #endif
+    // the scroll and partial areas are defined for the old orientation
+    disp_scroll_set(0, -1, 0);
+    if (tft_power == TFT_POWER_PARTIAL) TFT_setPower(TFT_POWER_ON);
+    tft_partial_last = tft_partial_first - 1;
+    tft_madctl = madctl;
+    tft_scroll.cols = (madctl & MADCTL_MV) ? 1 : 0;
     if (send) {
         if (disp_select() == ESP_OK) {
             disp_spi_transfer_cmd_data(TFT_MADCTL, &madctl, 1);
@@ -692,7 +955,7 @@ void TFT_PinsInit() {
     gpio_set_direction(PIN_NUM_MOSI, GPIO_MODE_OUTPUT);
     gpio_set_direction(PIN_NUM_CLK, GPIO_MODE_OUTPUT);
     gpio_set_direction(PIN_NUM_DC, GPIO_MODE_OUTPUT);
-    gpio_set_level(PIN_NUM_DC, 0);
+    disp_spi_dc_init();
 #if USE_TOUCH
     gpio_pad_select_gpio(PIN_NUM_TCS);
     gpio_set_direction(PIN_NUM_TCS, GPIO_MODE_OUTPUT);
@@ -710,11 +973,57 @@ void TFT_PinsInit() {
 #endif
 }
 
-// Initialize the display
-// ====================
-void TFT_display_init() {
+// Send the init commands of the display controller
+// with CONFIG_TFT_FIXED_DISP_TYPE only the configured controller's tables are used
+//--------------------------------
+static void disp_init_commands() {
+    switch (TFT_DISP_TYPE) {
+        case DISP_TYPE_ILI9341:
+            commandList(ILI9341_init);
+            break;
+        case DISP_TYPE_ILI9488:
+            commandList(ILI9488_init);
+            break;
+        case DISP_TYPE_ST7789V:
+            commandList(ST7789V_init);
+            break;
+        case DISP_TYPE_ST7735:
+            commandList(STP7735_init);
+            break;
+        case DISP_TYPE_ST7735R:
+            commandList(STP7735R_init);
+            commandList(Rcmd2green);
+            commandList(Rcmd3);
+            break;
+        case DISP_TYPE_ST7735B: {
+            commandList(STP7735R_init);
+            commandList(Rcmd2red);
+            commandList(Rcmd3);
+            uint8_t dt = 0xC0;
+            disp_spi_transfer_cmd_data(TFT_MADCTL, &dt, 1);
+            break;
+        }
+        default:
+            assert(0);
+    }
+}
+
+// ==== Asynchronous initialization ====
+
+EventGroupHandle_t tft_events = NULL;
+volatile TFT_init_state_t tft_init_state = TFT_INIT_IDLE;
+int64_t tft_ready_time = 0;
+
+static void (*tft_init_commands)(void) = NULL;     // commands of the running init task
+
+// Initialize the display, 'commands' sends the controller init commands
+// =====================================================
+void TFT_display_init_commands(void (*commands)(void)) {
     esp_err_t ret;
 
+    if (tft_events) xEventGroupClearBits(tft_events, TFT_EVT_READY);
+    tft_ready_time = 0;
+    tft_init_state = TFT_INIT_RESET;
 #if PIN_NUM_RST
     //Reset the display
     gpio_set_level(PIN_NUM_RST, 0);
@@ -722,48 +1031,80 @@ void TFT_display_init() {
     gpio_set_level(PIN_NUM_RST, 1);
     vTaskDelay(150 / portTICK_RATE_MS);
 #endif
-
+    // the controller state is unknown after reset
+    tft_bus->invalidate();
+    tft_scroll.active = 0;
+    tft_power = TFT_POWER_ON;
+    tft_partial_on = 0;
+    tft_gram_valid = 0;
+    tft_slpout_time = esp_timer_get_time();
+
+    tft_init_state = TFT_INIT_COMMANDS;
     ret = disp_select();
     ESP_ERROR_CHECK(ret);
     //Send all the initialization commands
-    if (tft_disp_type == DISP_TYPE_ILI9341) {
-        commandList(tft_disp_spi, ILI9341_init);
-    }
-    else if (tft_disp_type == DISP_TYPE_ILI9488) {
-        commandList(tft_disp_spi, ILI9488_init);
-    }
-    else if (tft_disp_type == DISP_TYPE_ST7789V) {
-        commandList(tft_disp_spi, ST7789V_init);
-    }
-    else if (tft_disp_type == DISP_TYPE_ST7735) {
-        commandList(tft_disp_spi, STP7735_init);
-    }
-    else if (tft_disp_type == DISP_TYPE_ST7735R) {
-        commandList(tft_disp_spi, STP7735R_init);
-        commandList(tft_disp_spi, Rcmd2green);
-        commandList(tft_disp_spi, Rcmd3);
-    }
-    else if (tft_disp_type == DISP_TYPE_ST7735B) {
-        commandList(tft_disp_spi, STP7735R_init);
-        commandList(tft_disp_spi, Rcmd2red);
-        commandList(tft_disp_spi, Rcmd3);
-        uint8_t dt = 0xC0;
-        disp_spi_transfer_cmd_data(TFT_MADCTL, &dt, 1);
-    }
-    else assert(0);
+    commands();
 
     ret = disp_deselect();
     ESP_ERROR_CHECK(ret);
 
-    // Clear screen
     _tft_setRotation(PORTRAIT);
+    if (tft_bus->init) tft_bus->init();
 
+    // Clear screen
+    tft_init_state = TFT_INIT_CLEAR;
     TFT_pushColorRep(TFT_STATIC_WIDTH_OFFSET, TFT_STATIC_HEIGHT_OFFSET,
                      tft_width + TFT_STATIC_WIDTH_OFFSET -1, tft_height + TFT_STATIC_HEIGHT_OFFSET -1,
                      (color_t){0,0,0},
                      (uint32_t)(tft_height * tft_width));
+    tft_gram_valid = 1;
     ///Enable backlight
 #if PIN_NUM_BCKL
     gpio_set_level(PIN_NUM_BCKL, PIN_BCKL_ON);
 #endif
+    TFT_flush();
+    tft_ready_time = esp_timer_get_time();
+    tft_init_state = TFT_INIT_READY;
+    if (tft_events) xEventGroupSetBits(tft_events, TFT_EVT_READY);
+}
+
+// Initialize the display
+// ====================
+void TFT_display_init() {
+    TFT_display_init_commands(disp_init_commands);
+}
+
+//------------------------------------
+static void disp_init_task(void *arg) {
+    (void)arg;
+    TFT_display_init_commands(tft_init_commands);
+    vTaskDelete(NULL);
+}
+
+//==========================================================
+esp_err_t TFT_display_init_start(void (*commands)(void)) {
+    if ((tft_init_state != TFT_INIT_IDLE) && (tft_init_state != TFT_INIT_READY)) return ESP_ERR_INVALID_STATE;
+
+    if (tft_events == NULL) {
+        tft_events = xEventGroupCreate();
+        if (tft_events == NULL) return ESP_ERR_NO_MEM;
+    }
+    xEventGroupClearBits(tft_events, TFT_EVT_READY);
+    tft_init_commands = (commands) ? commands : disp_init_commands;
+    // set before the task runs, a second start fails until it is finished
+    tft_init_state = TFT_INIT_RESET;
+    if (xTaskCreate(disp_init_task, "tft_init", TFT_INIT_TASK_STACK, NULL, TFT_INIT_TASK_PRIORITY, NULL) != pdPASS) {
+        tft_init_state = TFT_INIT_IDLE;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+//===================================================
+esp_err_t TFT_display_wait_ready(TickType_t ticks) {
+    if (tft_init_state == TFT_INIT_READY) return ESP_OK;
+    if (tft_events == NULL) return ESP_ERR_INVALID_STATE;
+
+    EventBits_t bits = xEventGroupWaitBits(tft_events, TFT_EVT_READY, pdFALSE, pdTRUE, ticks);
+    return (bits & TFT_EVT_READY) ? ESP_OK : ESP_ERR_TIMEOUT;
 }
@@ -12,6 +12,8 @@
 #include "sdkconfig.h"
 #include "stmpe610.h"
 #include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 
 #define TOUCH_TYPE_NONE		0
 #define TOUCH_TYPE_XPT2046	1
@@ -198,7 +200,6 @@
 //----------------------------------------------------------------------------
 //NOTE: if not used, the MISO Pin should be set to -1
 #define DISP_COLOR_BITS_24	0x66
-//#define DISP_COLOR_BITS_16	0x55  // Do not use!
 
 #define TFT_INVERT_ROTATION 0
 #define TFT_INVERT_ROTATION1 CONFIG_TFT_INVERT_ROTATION1
@@ -258,7 +259,11 @@
 #endif  // CONFIG_PREDEFINED_DISPLAY_TYPE
 
 // Define offset generation, or ignore offsets if none are needed
-#ifdef TFT_STATIC_WIDTH_OFFSET
+// (equal offsets do not depend on the orientation)
+#if defined(TFT_STATIC_WIDTH_OFFSET) && (TFT_STATIC_WIDTH_OFFSET == TFT_STATIC_HEIGHT_OFFSET)
+#define TFT_STATIC_X_OFFSET TFT_STATIC_WIDTH_OFFSET
+#define TFT_STATIC_Y_OFFSET TFT_STATIC_HEIGHT_OFFSET
+#elif defined(TFT_STATIC_WIDTH_OFFSET)
 #define TFT_STATIC_X_OFFSET (tft_orientation & 1 ? TFT_STATIC_HEIGHT_OFFSET : TFT_STATIC_WIDTH_OFFSET)
 #define TFT_STATIC_Y_OFFSET (tft_orientation & 1 ? TFT_STATIC_WIDTH_OFFSET : TFT_STATIC_HEIGHT_OFFSET)
 #else
@@ -269,14 +274,12 @@
 #endif
 
 // === Setting the buffer size for repeated color pushing ===
-// This value is pretty important, as it governs how big the queue size must be
-// but also takes up valuable DRAM space it self.
-// As this is the size in color_t, a value of 1 will take up 3 Bytes of DRAM.
+// The buffer takes up valuable DRAM space,
+// as this is the size in color_t, a value of 1 will take up 3 Bytes of DRAM.
 // This vaue has a surprisingly big impact on drawing performance,
 // play around with it to find the sweetspot for your application.
-// WARNING: If this value is set very small, and the spi transaction queue
-//          is not large enough, the queue will overflow without notice.
-//TODO: actually add this configuration option
+// Fills are streamed through at most TFT_SPI_QUEUE_SIZE transactions,
+// so the value does not depend on the queue size.
 #ifdef CONFIG_TFT_REPEAT_BUFFER_SIZE
     #define TFT_REPEAT_BUFFER_SIZE CONFIG_TFT_REPEAT_BUFFER_SIZE
 #else
@@ -284,26 +287,177 @@
     #define TFT_REPEAT_BUFFER_SIZE 500
 #endif
 
+// === Number of repeat buffers ===
+// Every buffer holds one fill color, alternating fill colors don't need a refill
+// if there is a buffer for each of them.
+// Each buffer takes up TFT_REPEAT_BUFFER_SIZE*3 Bytes of DRAM.
+#ifdef CONFIG_TFT_REPEAT_BUFFER_COUNT
+    #define TFT_REPEAT_BUFFER_COUNT CONFIG_TFT_REPEAT_BUFFER_COUNT
+#else
+    #define TFT_REPEAT_BUFFER_COUNT 3
+#endif
+
+// === Dummy clock cycles between RAMRD and the first pixel read ===
+#ifdef CONFIG_TFT_READ_DUMMY_BITS
+    #define TFT_READ_DUMMY_BITS CONFIG_TFT_READ_DUMMY_BITS
+#else
+    #define TFT_READ_DUMMY_BITS 8
+#endif
+
+// === Maximum number of pixels received in one read transaction ===
+// The repeat buffer size already fits into max_transfer_sz of the bus,
+// a multiple of 4 pixels keeps every chunk a multiple of 4 bytes for DMA.
+#define TFT_READ_CHUNK_PIXELS (TFT_REPEAT_BUFFER_SIZE & ~3)
+
+// === Maximum number of pixels sent from a caller's buffer in one transaction ===
+// Longer sends are queued in chunks after a single RAMWR
+#define TFT_SEND_CHUNK_PIXELS (TFT_REPEAT_BUFFER_SIZE & ~3)
+
+// === Size of the scratch buffer for short fills in pixels ===
+// Synchronous fills up to tft_short_run_len pixels are expanded into this buffer
+// and sent as one polling transaction, tft_short_run_len is never larger than this.
+#ifdef CONFIG_TFT_SHORT_RUN_BUFFER_SIZE
+    #define TFT_SHORT_RUN_BUFFER_SIZE CONFIG_TFT_SHORT_RUN_BUFFER_SIZE
+#else
+    #define TFT_SHORT_RUN_BUFFER_SIZE 64
+#endif
+
+// === Size of the two staging buffers in pixels ===
+// send_data_start() converts colors (color transform, 16-bit pixels) into these buffers,
+// one is converted while the other one is sent.
+#ifdef CONFIG_TFT_STAGE_BUFFER_SIZE
+    #define TFT_STAGE_BUFFER_SIZE CONFIG_TFT_STAGE_BUFFER_SIZE
+#else
+    #define TFT_STAGE_BUFFER_SIZE 256
+#endif
+
+// === Number of display transactions that can be queued at once ===
+// The library never has more than this many transactions in flight,
+// the display spi device must be added with a queue_size of at least this value.
+#ifdef CONFIG_TFT_SPI_QUEUE_SIZE
+    #define TFT_SPI_QUEUE_SIZE CONFIG_TFT_SPI_QUEUE_SIZE
+#else
+    #define TFT_SPI_QUEUE_SIZE 8
+#endif
+
+// === Display init task, see TFT_display_init_start() ===
+#ifdef CONFIG_TFT_INIT_TASK_PRIORITY
+    #define TFT_INIT_TASK_PRIORITY CONFIG_TFT_INIT_TASK_PRIORITY
+#else
+    #define TFT_INIT_TASK_PRIORITY 5
+#endif
+#define TFT_INIT_TASK_STACK 3072
+
+// === Framebuffer, see TFT_fb_begin() ===
+// Framebuffers and canvases up to this size in bytes are allocated in internal RAM, larger ones in PSRAM
+#ifdef CONFIG_TFT_FB_DRAM_MAX
+    #define TFT_FB_DRAM_MAX CONFIG_TFT_FB_DRAM_MAX
+#else
+    #define TFT_FB_DRAM_MAX 65536
+#endif
+// Number of dirty rectangles kept, when all are used the closest ones are merged
+#ifdef CONFIG_TFT_FB_DIRTY_RECTS
+    #define TFT_FB_DIRTY_RECTS CONFIG_TFT_FB_DIRTY_RECTS
+#else
+    #define TFT_FB_DIRTY_RECTS 16
+#endif
+// Cost of sending a rectangle (window, RAMWR, transaction setup) in pixels:
+// two rectangles are merged if their union has at most this many pixels more than both of them
+#ifdef CONFIG_TFT_FB_RECT_COST
+    #define TFT_FB_RECT_COST CONFIG_TFT_FB_RECT_COST
+#else
+    #define TFT_FB_RECT_COST 128
+#endif
+// Core of the flush task of double buffering, -1: any core
+#ifdef CONFIG_TFT_FB_FLUSH_CORE
+    #define TFT_FB_FLUSH_CORE CONFIG_TFT_FB_FLUSH_CORE
+#else
+    #define TFT_FB_FLUSH_CORE -1
+#endif
+#define TFT_FB_TASK_STACK 2048
+// Rectangles the flush task of double buffering sends per frame, when all are used the closest ones are merged
+#define TFT_FB_SEND_RECTS (TFT_FB_DIRTY_RECTS * 4)
+
+// === Band renderer, see TFT_band_begin() ===
+// Default band height in display rows, two band buffers of this many rows are allocated
+#ifdef CONFIG_TFT_BAND_HEIGHT
+    #define TFT_BAND_HEIGHT CONFIG_TFT_BAND_HEIGHT
+#else
+    #define TFT_BAND_HEIGHT 8
+#endif
+// Size of the display list in bytes
+#ifdef CONFIG_TFT_BAND_LIST_SIZE
+    #define TFT_BAND_LIST_SIZE CONFIG_TFT_BAND_LIST_SIZE
+#else
+    #define TFT_BAND_LIST_SIZE 16384
+#endif
+// Core of the raster task, -1: the bands are rasterized by the drawing task
+#ifdef CONFIG_TFT_BAND_RASTER_CORE
+    #define TFT_BAND_RASTER_CORE CONFIG_TFT_BAND_RASTER_CORE
+#else
+    #define TFT_BAND_RASTER_CORE -1
+#endif
+#define TFT_BAND_TASK_STACK 2048
+
+// === Pixel format on the display bus ===
+// 18-bit (COLMOD 0x66): 3 bytes per pixel, the layout of color_t
+// 16-bit (COLMOD 0x55, CONFIG_TFT_COLOR_BITS_16): 2 bytes per pixel, RGB565 high byte first
+// GRAM reads always return 3 bytes per pixel.
+#if CONFIG_TFT_COLOR_BITS_16
+    #if DEFAULT_DISP_TYPE == DISP_TYPE_ILI9488
+    #error "ILI9488 has no 16-bit pixel format on the SPI interface, disable CONFIG_TFT_COLOR_BITS_16"
+    #endif
+    #define DISP_COLOR_BITS 0x55
+    #define TFT_PIXEL_BYTES 2
+#else
+    #define DISP_COLOR_BITS 0x66
+    #define TFT_PIXEL_BYTES 3
+#endif
+
+// === Build constants for runtime settings ===
+// Code tests these instead of the variables, so a fixed setting folds away at compile time
+#if CONFIG_TFT_NO_GRAY_SCALE
+    #define TFT_GRAY_SCALE_ACTIVE 0
+#else
+    #define TFT_GRAY_SCALE_ACTIVE (tft_gray_scale)
+#endif
+#if CONFIG_TFT_FIXED_DISP_TYPE
+    #define TFT_DISP_TYPE DEFAULT_DISP_TYPE
+#else
+    #define TFT_DISP_TYPE (tft_disp_type)
+#endif
+
 // ##############################################################
 // #### Global variables                                     ####
 // ##############################################################
 
 // ==== Converts colors to grayscale if 1 =======================
+// ==== (ignored with CONFIG_TFT_NO_GRAY_SCALE) =================
 extern uint8_t tft_gray_scale;
 
 // ==== Spi clock for reading data from display memory in Hz ====
 extern uint32_t tft_max_rdclock;
 
+// ==== Only queue fills and buffer sends if 1 (see TFT_fence_t) =
+extern uint8_t tft_async;
+
+// ==== Synchronous fills up to this many pixels are sent with ==
+// ==== polling transactions, measured by TFT_display_init() ====
+extern uint32_t tft_short_run_len;
+
 // ==== Display dimensions in pixels ============================
 extern int tft_width;
 extern int tft_height;
 
 // ==== Display type, DISP_TYPE_ILI9488 or DISP_TYPE_ILI9341 ====
+// ==== (ignored with CONFIG_TFT_FIXED_DISP_TYPE) ===============
 extern uint8_t tft_disp_type;
 
 // ==== Spi device handles for display and touch screen =========
 extern spi_device_handle_t tft_disp_spi;
 extern spi_device_handle_t tft_ts_spi;
+// ==== Spi device handle for display reads =====================
+extern spi_device_handle_t tft_disp_rd_spi;
 
 // ##############################################################
 
@@ -315,12 +469,88 @@ typedef struct __attribute__((__packed__)) {
 	uint8_t b;
 } color_t ;
 
+// === Color transform ===
+// Applied to every color when it is stored into a DMA buffer or a fill is started
+// (fills, drawPixel, send_data_start(), glyphs, images), buffers of the caller are never changed:
+// gray scale (tft_gray_scale) first, then the channel LUTs set with TFT_setColorTransform().
+// With no transform active the colors are only tested against two flags.
+
+typedef struct {
+    float gamma;                // software gamma, out = in^(1/gamma); 0 or 1.0 = none
+    uint8_t brightness;         // channels are scaled by brightness/255 after the gamma; 0 = 255
+    uint8_t invert;             // if 1 the channels are inverted after the scaling
+    const uint8_t *curve[3];    // optional calibration LUTs (256 entries) for r, g, b, applied last
+} TFT_color_transform_t;
+
+// ==== Channel LUTs of the color transform, used if tft_color_lut_active is set ====
+extern uint8_t tft_color_lut_active;
+extern uint8_t tft_color_lut[3][256];
+
+#define TFT_COLOR_TRANSFORM_ACTIVE (TFT_GRAY_SCALE_ACTIVE || tft_color_lut_active)
+
+// Convert color to gray scale (integer weights 0.30, 0.49, 0.21)
+color_t color2gs(color_t color);
+
+// Build the channel LUTs from 't' and activate them, NULL removes the transform
+// Returns ESP_ERR_INVALID_ARG for a negative gamma
+//=============================================================
+esp_err_t TFT_setColorTransform(const TFT_color_transform_t *t);
+
+// Apply the color transform to the color
+//-----------------------------------------------------------------
+static inline color_t __attribute__((always_inline)) TFT_color_apply(color_t color) {
+    if (TFT_GRAY_SCALE_ACTIVE) color = color2gs(color);
+    if (tft_color_lut_active) {
+        color.r = tft_color_lut[0][color.r];
+        color.g = tft_color_lut[1][color.g];
+        color.b = tft_color_lut[2][color.b];
+    }
+    return color;
+}
+
+// Store the color at 'dst' in the pixel format of the display bus (TFT_PIXEL_BYTES bytes)
+//-------------------------------------------------------------------
+static inline void __attribute__((always_inline)) TFT_pixel_pack(uint8_t *dst, color_t color) {
+#if TFT_PIXEL_BYTES == 2
+    dst[0] = (color.r & 0xF8) | (color.g >> 5);
+    dst[1] = ((color.g & 0x1C) << 3) | (color.b >> 3);
+#else
+    dst[0] = color.r;
+    dst[1] = color.g;
+    dst[2] = color.b;
+#endif
+}
+
+// Same, with the color transform applied first
+//--------------------------------------------------------------------
+static inline void __attribute__((always_inline)) TFT_pixel_store(uint8_t *dst, color_t color) {
+    TFT_pixel_pack(dst, TFT_color_apply(color));
+}
+
+// Store 'len' colors at 'dst' in the pixel format of the display bus, with the color transform applied
+// the transform is tested once, not per pixel
+//---------------------------------------------------------------------------------------------
+static inline void __attribute__((always_inline)) TFT_pixels_store(uint8_t *dst, const color_t *colors, uint32_t len) {
+    if (TFT_COLOR_TRANSFORM_ACTIVE) {
+        for (uint32_t n = 0; n < len; n++, dst += TFT_PIXEL_BYTES) TFT_pixel_store(dst, colors[n]);
+    }
+    else {
+        for (uint32_t n = 0; n < len; n++, dst += TFT_PIXEL_BYTES) TFT_pixel_pack(dst, colors[n]);
+    }
+}
+
+// Completion fence of queued display transactions
+// A fence is done when all transactions queued up to its creation are finished.
+typedef uint32_t TFT_fence_t;
+
 // ==== Display commands constants ====
 #define TFT_INVOFF     0x20
 #define TFT_INVONN     0x21
 #define TFT_DISPOFF    0x28
 #define TFT_DISPON     0x29
 #define TFT_MADCTL	   0x36
+#define TFT_VSCRDEF	   0x33
+#define TFT_VSCRSADD   0x37
 #define TFT_PTLAR 	   0x30
 #define TFT_ENTRYM 	   0xB7
 
@@ -443,7 +673,7 @@ static const uint8_t ST7789V_init[] = {
   TFT_CMD_GMCTRP1, 14, 0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37, 0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19,
   TFT_CMD_GMCTRN1, 14, 0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D, 0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19,
   TFT_MADCTL, 1, (MADCTL_MX | TFT_RGB_BGR),			// Memory Access Control (tft_orientation)
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,            // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS,            // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
   TFT_CMD_SLPOUT, TFT_CMD_DELAY, 120,				//  Sleep out,	//  120 ms delay
   TFT_DISPON, TFT_CMD_DELAY, 120,
 };
@@ -472,7 +702,7 @@ static const uint8_t ILI9341_init[] = {
   TFT_MADCTL, 1,									// Memory Access Control (tft_orientation)
   (MADCTL_MX | TFT_RGB_BGR),
   // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS,
   TFT_INVOFF, 0,
   TFT_CMD_FRMCTR1, 2, 0x00, 0x18,
   TFT_CMD_DFUNCTR, 4, 0x08, 0x82, 0x27, 0x00,		// Display Function Control
@@ -519,7 +749,7 @@ static const uint8_t ILI9488_init[] = {
 #endif
 
   // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit;
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS,
 
   0xB0, 1,   // Interface Mode Control
 	0x00,    // 0x80: SDO NOT USE; 0x00 USE SDO
@@ -568,7 +798,7 @@ static const uint8_t STP7735_init[] = {
   255,			           			//     255 = 500 ms delay
 #endif
   TFT_CMD_PIXFMT, 1+TFT_CMD_DELAY,	//  3: Set color mode, 1 arg + delay:
-  0x06, 							//     18-bit color 6-6-6 color format
+  DISP_COLOR_BITS & 0x0F, 			//     0x06: 18-bit color 6-6-6, 0x05: 16-bit color 5-6-5
   10,	          					//     10 ms delay
   ST7735_FRMCTR1, 3+TFT_CMD_DELAY,	//  4: Frame rate control, 3 args + delay:
   0x00,						//     fastest refresh
@@ -662,7 +892,7 @@ static const uint8_t  STP7735R_init[] = {
   TFT_MADCTL , 1      ,		// 14: Memory access control (directions), 1 arg:
   0xC0,						//     row addr/col addr, bottom to top refresh, RGB order
   TFT_CMD_PIXFMT , 1+TFT_CMD_DELAY,	//  15: Set color mode, 1 arg + delay:
-  0x06,								//      18-bit color 6-6-6 color format
+  DISP_COLOR_BITS & 0x0F,			//      0x06: 18-bit color 6-6-6, 0x05: 16-bit color 5-6-5
   10						//     10 ms delay
 };
 
@@ -716,23 +946,122 @@ static const uint8_t Rcmd3[] = {
 // == Low level functions; usually not used directly ==
 void disp_spi_transfer_cmd(int8_t cmd);
 void disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t len);
+// Forget the cached address window, the next write sends full CASET/PASET
+// Must be called if the controller window is changed without the functions above
+void disp_spi_invalidate_addrwin();
 void drawPixel_start(int16_t x, int16_t y, color_t color);
 void drawPixel_finish();
 void drawPixel(int16_t x, int16_t y, color_t color);
-void send_data_start(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf);
+// Queue 'len' colors from 'buf' to the 'window' (x1,y1),(x2,y2) and return its fence
+// 'buf' belongs to the spi driver until the fence is done,
+// it must not be changed or freed before TFT_wait(fence) or send_data_finish()
+// 'buf' is never changed: with a color transform or 16-bit pixels the colors are converted
+// into staging buffers of the bus backend, otherwise 'buf' itself is sent
+TFT_fence_t send_data_start(int x1, int y1, int x2, int y2, uint32_t len, const color_t *buf);
+// Same for 'len' pixels already in the display format (see TFT_pixel_store()), nothing is converted
+TFT_fence_t send_pixels_start(int x1, int y1, int x2, int y2, uint32_t len, const uint8_t *pixels);
+// Wait for the last send_data_start() / send_pixels_start()
 void send_data_finish();
-void FORCE_INLINE_ATTR send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf){
+// Write the 'w' x 'h' pixels in the display format at 'pixels', with rows 'stride' pixels apart, to the window
+// at (x,y); the bus backend copies them, 'pixels' can be changed (and be in PSRAM) when it returns
+void send_rect_pixels(int x, int y, uint32_t w, uint32_t h, const uint8_t *pixels, uint32_t stride);
+FORCE_INLINE_ATTR void send_data(int x1, int y1, int x2, int y2, uint32_t len, const color_t *buf){
     send_data_start(x1, y1, x2, y2, len, buf);
     send_data_finish();
 }
+FORCE_INLINE_ATTR void send_pixels(int x1, int y1, int x2, int y2, uint32_t len, const uint8_t *pixels){
+    send_pixels_start(x1, y1, x2, y2, len, pixels);
+    send_data_finish();
+}
 void TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t data, uint32_t len);
+// Reads 'len' pixels of the GRAM window (x1,y1),(x2,y2) into buf+1, buf[0] is set to 0
+// 'set_sp' is kept for compatibility, the read device clock tft_max_rdclock is always used
+// Returns ESP_ERR_INVALID_STATE if the read device is not added
 int read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp);
 color_t readPixel(int16_t x, int16_t y);
+
+// Reads the GRAM window (x1,y1),(x2,y2) with the read device into 'dst', which has 'stride' pixels per row
+// Returns ESP_ERR_INVALID_STATE if the read device is not added
+//--------------------------------------------------------------------------------
+esp_err_t read_rect(int x1, int y1, int x2, int y2, color_t *dst, int stride);
+
+// Add the spi device used for display reads to the display bus, or replace it, with the given clock
+// The display device must be the first device added to the bus, the read device shares its CS pin.
+// Returns ESP_ERR_NOT_SUPPORTED if MISO is not used
+//==========================================================================
+esp_err_t TFT_read_device_init(spi_host_device_t host, uint32_t clock);
+
+// Find the highest spi clock at which a written test pattern is read back correctly,
+// sets tft_max_rdclock and the read device clock to it.
+// The pattern is drawn at the top left corner of the display and cleared afterwards.
+// Returns the clock, 0 if the read device is not added or no clock works
+//======================
+uint32_t find_rd_speed();
 //int touch_get_data(uint8_t type);
 
+// ==== Transaction trace (CONFIG_TFT_SPI_TRACE) ====
+// Every display transaction is recorded with its DC level, length, data or buffer address
+// and esp_timer time (see tft_trace.h). tools/tft_trace replays a trace on the host.
+// Without CONFIG_TFT_SPI_TRACE the functions return ESP_ERR_NOT_SUPPORTED or do nothing.
+
+// Start recording into a buffer of 'records' transactions, a previous trace is discarded.
+// Recording stops when the buffer is full, 'records' = 0 frees the buffer
+//============================================
+esp_err_t TFT_trace_start(uint32_t records);
+
+// Stop recording, the trace is kept
+//====================
+void TFT_trace_stop();
+
+// Number of recorded transactions
+//==========================
+uint32_t TFT_trace_count();
+
+// Write the trace to a file, e.g. on SPIFFS
+//============================================
+esp_err_t TFT_trace_save(const char *path);
+
+// Print the trace to stdout (UART) as hex lines starting with TFTTRACE
+//=====================
+void TFT_trace_print();
+
+// ==== Asynchronous drawing ====
+// If 'tft_async' is set, TFT_pushColorRep() and the fills using it return as soon as their
+// transactions are queued, send_data_start() never waits.
+// The CPU can prepare the next content while the previous one is still on the wire.
+// Functions using polling transactions (pixels, commands, reads) first finish all queued ones.
+// The drawing functions must be called from one task only.
+
+// Fence for all transactions queued so far
+//======================
+TFT_fence_t TFT_fence();
+
+// Wait until all transactions of the fence are finished
+//==================================
+void TFT_wait(TFT_fence_t fence);
+
+// Returns 1 if all transactions of the fence are finished, never blocks
+//========================================
+uint8_t TFT_fence_done(TFT_fence_t fence);
+
+// Wait until all queued transactions are finished
+// With a framebuffer active (TFT_fb_begin()), its dirty rectangles are sent first,
+// with the band renderer (TFT_band_begin()) its display list
+//================
+void TFT_flush();
+
 // Declaration of Callback for the user SPI initialization to include
 void TFT_transaction_begin_callback(spi_transaction_t*);
 
+// Drive the DC pin low through the cached level of the transaction callback, the pin must be an output
+//=====================
+void disp_spi_dc_init();
+
+// Average CPU cycles of one transaction callback call, measured over 'count' calls
+// If 'alternate' is set, every call changes the DC pin level, otherwise the level is kept
+//=========================================================
+uint32_t TFT_dc_callback_cycles(uint8_t alternate, uint32_t count);
+
 // deselect the display spi device
 //========================
 // in previous versions this was mandatory, now it is suggested for sending many consecutive transactions
@@ -741,14 +1070,285 @@ esp_err_t disp_deselect();
 // select the display spi device
 //======================
 // in previous versions this was mandatory, now it is suggested for sending many consecutive transactions
+// calls of the task which selected the display can be nested, other tasks acquire the bus and wait
 esp_err_t disp_select();
 
 
 // Change the screen rotation.
 // Input: m new rotation value (0 to 3)
+// Hardware scrolling is turned off
 //=================================
 void _tft_setRotation(uint8_t rot);
 
+// ==== Hardware scrolling, see TFT_setScrollArea() ====
+// The controller scrolls along its gate lines: the rows of the display in portrait
+// orientations, the columns in landscape orientations ('cols' is set).
+typedef struct {
+    uint8_t active;
+    uint8_t cols;   // the scrolled lines are columns, set for the current orientation
+    int first;      // first and last line of the scroll area, in display coordinates (as tft_dispWin)
+    int last;
+    int lines;      // last - first + 1
+    int offset;     // line of the area shown at its first line, 0 ~ lines-1
+} tft_scroll_t;
+
+extern tft_scroll_t tft_scroll;
+
+// Scroll the lines 'first' ~ 'last' so that line first+offset is shown at 'first'
+// Windows drawn in the area are mapped to where they are shown.
+// 'first' > 'last' turns scrolling off.
+// Returns ESP_ERR_INVALID_STATE in partial mode (TFT_POWER_PARTIAL), also while the display is
+// off or sleeping after partial mode, until TFT_setPower(TFT_POWER_ON) has left it
+//==========================================================
+esp_err_t disp_scroll_set(int first, int last, int offset);
+
+// ==== Power states, see TFT_setPower() ====
+typedef enum {
+    TFT_POWER_ON = 0,       // normal mode, the whole display is shown
+    TFT_POWER_PARTIAL,      // partial mode, only the lines of the partial area are shown (TFT_setPartialArea())
+    TFT_POWER_OFF,          // display off, the controller keeps running
+    TFT_POWER_SLEEP,        // sleep mode, oscillator and panel driving stopped, lowest power
+} TFT_power_t;
+
+extern TFT_power_t tft_power;   // current power state
+extern uint8_t tft_gram_valid;  // the GRAM holds what was drawn, the screen need not be repainted
+extern uint32_t tft_resume_us;  // duration of the last TFT_setPower() from TFT_POWER_OFF or TFT_POWER_SLEEP
+
+// Change the power state, the GRAM content is kept in all states
+// and drawing functions can be used in all of them.
+// Waking from TFT_POWER_SLEEP waits for the controller (5 ms, 120 ms on ST7735),
+// sleep is entered at the earliest 120 ms after the last wake.
+// The controller stays in partial mode while off or sleeping, TFT_POWER_ON always leaves it.
+// Returns ESP_ERR_INVALID_STATE for TFT_POWER_PARTIAL without a partial area or with hardware scrolling
+//=============================================
+esp_err_t TFT_setPower(TFT_power_t state);
+
+// Set the partial area to the lines 'first' ~ 'last' in display coordinates (as tft_scroll),
+// rows in portrait orientations, columns in landscape orientations
+//=================================================
+esp_err_t disp_partial_set(int first, int last);
+
+// The GRAM content was lost (e.g. the display power was removed), tft_gram_valid is cleared.
+// It is set again by TFT_display_init().
+//=====================
+void TFT_gramInvalidate();
+
+// ==== Bus scheduler (tft_sched.c) ====
+// The display and the touch controller share the spi bus, both get it through the scheduler.
+// The holder gives the bus up at safe points (between the chunks of fills and pixel sends,
+// between touch sample sets) when another client waits and has a higher priority,
+// or when the holder had the bus for 'slice_us'. How long each client waited for the bus
+// and held it is measured, waits longer than 'budget_us' are counted.
+// GRAM reads hand the bus from the display device to the read device, which is a client of its own.
+typedef enum {
+    TFT_SCHED_DISPLAY = 0,      // tft_disp_spi
+    TFT_SCHED_TOUCH,            // tft_ts_spi
+    TFT_SCHED_DISPLAY_READ,     // tft_disp_rd_spi, one transaction per read, never yields
+    TFT_SCHED_CLIENTS
+} tft_sched_client_t;
+
+typedef struct {
+    uint8_t priority;       // a waiting client with a higher priority gets the bus at the next safe point
+    uint32_t slice_us;      // the bus is given up at a safe point after this time if the other client waits, 0: never
+    uint32_t budget_us;     // acceptable wait for the bus
+} tft_sched_config_t;
+
+typedef struct {
+    uint32_t acquires;      // times the bus was acquired
+    uint32_t yields;        // times the bus was given up at a safe point
+    uint32_t max_wait_us;   // longest wait for the bus
+    uint32_t over_budget;   // waits longer than 'budget_us'
+    uint32_t max_hold_us;   // longest time the bus was held at once
+    uint64_t hold_us;       // total time the bus was held
+} tft_sched_stats_t;
+
+extern tft_sched_config_t tft_sched_config[TFT_SCHED_CLIENTS];   // can be changed while the bus is not used
+extern tft_sched_stats_t tft_sched_stats[TFT_SCHED_CLIENTS];
+
+// Wait for the bus and acquire it for the client's device
+// Returns ESP_ERR_INVALID_STATE if the device is not added
+//==========================================================
+esp_err_t tft_sched_acquire(tft_sched_client_t client);
+
+// Release the bus, the client's transactions must be finished
+//=================================================
+void tft_sched_release(tft_sched_client_t client);
+
+// Returns 1 if the holder should give the bus up at this safe point
+//======================================================
+uint8_t tft_sched_yield_due(tft_sched_client_t client);
+
+// Give the bus to the waiting client and acquire it again,
+// the holder's transactions must be finished
+//===============================================
+void tft_sched_yield(tft_sched_client_t client);
+
+// Clear tft_sched_stats
+//==========================
+void tft_sched_stats_reset();
+
+// ==== Framebuffer (tft_fb.c) ====
+// Between TFT_fb_begin() and TFT_fb_end() all drawing functions render into a framebuffer
+// of the display size and record the rectangles they change. TFT_flush() merges these rectangles
+// and sends each of them as one window and RAMWR burst. Reads are served from the framebuffer.
+// Commands (rotation, scrolling, power states) send the dirty rectangles first.
+// After a rotation the whole framebuffer is sent with the next flush, its content is in the
+// old address layout until it is drawn again (TFT_setRotation() clears the screen).
+//
+// With TFT_fb_begin_double() there are two framebuffers: TFT_fb_swap() compares the dirty rectangles
+// of the drawn framebuffer with the one shown (see TFT_diff_send()), copies the differences over and
+// hands the drawn one to a flush task, which sends the changed spans while the next frame is drawn
+// into the other one.
+typedef struct {
+    uint32_t flushes;       // flushes which sent something
+    uint32_t rects;         // rectangles sent
+    uint32_t pixels;        // pixels sent
+    uint32_t merges;        // rectangles merged into others
+} tft_fb_stats_t;
+
+// Timings of the last frame of double buffering, in us
+typedef struct {
+    uint32_t frame;         // frames swapped
+    uint32_t draw_us;       // from the end of the previous swap to this swap
+    uint32_t wait_us;       // the swap waited for the flush of the previous frame
+    uint32_t diff_us;       // comparing and copying the dirty rectangles
+    uint32_t flush_us;      // the flush task sent the last frame it finished
+    uint32_t rects;         // rectangles of the frame which differ
+    uint32_t pixels;        // pixels in them
+} tft_fb_frame_t;
+
+extern tft_fb_stats_t tft_fb_stats;
+extern volatile tft_fb_frame_t tft_fb_frame;
+// Rectangles are merged if their union has at most this many pixels more, default TFT_FB_RECT_COST
+extern int tft_fb_rect_cost;
+
+// Allocate the framebuffer and draw into it, call after the display is initialized, outside of disp_select()
+// The framebuffer starts black and is sent in full by the first TFT_flush()
+// Returns ESP_ERR_INVALID_STATE if it or the band renderer is already active or a canvas is selected, ESP_ERR_NO_MEM
+//=======================
+esp_err_t TFT_fb_begin();
+
+// Send the dirty rectangles, free the framebuffer(s) and draw to the display again
+//=================
+void TFT_fb_end();
+
+// Allocate two framebuffers and start the flush task, otherwise as TFT_fb_begin()
+// TFT_flush() swaps and waits until the frame is sent, TFT_fb_swap() only waits for the previous frame
+// Returns ESP_ERR_INVALID_STATE if a framebuffer or the band renderer is already active or a canvas is selected, ESP_ERR_NO_MEM
+//==============================
+esp_err_t TFT_fb_begin_double();
+
+// Hand the drawn frame to the flush task and continue drawing in the other framebuffer,
+// which holds the same content; with one framebuffer the dirty rectangles are sent
+//=================
+void TFT_fb_swap();
+
+// ==== Frame differ (tft_diff.c) ====
+// Compares a newly rendered region with a shadow copy of what the display shows, 32 bits at a time,
+// a row without changes costs one compare pass. Equal changed spans of consecutive rows are sent
+// as one rectangle, and copied to the shadow. The double framebuffer (TFT_fb_begin_double()) sends
+// its frames with it, merging the rectangles with tft_fb_rect_cost.
+typedef struct {
+    uint32_t compared;      // pixels compared
+    uint32_t rows;          // rows compared
+    uint32_t rows_changed;  // rows with a change
+    uint32_t spans;         // changed spans
+    uint32_t rects;         // rectangles sent
+    uint32_t pixels;        // pixels sent
+} tft_diff_stats_t;
+
+extern tft_diff_stats_t tft_diff_stats;
+
+// Send the pixels of the 'w' x 'h' region at 'pixels' (display pixel format, see TFT_pixel_pack(),
+// rows 'stride' pixels apart) which differ from 'shadow', to (x,y) relative to the display window,
+// and update 'shadow'. 'shadow' has the layout of 'pixels' and holds what the display shows there.
+// The region is clipped to the display window. Returns the number of pixels sent
+//=============================================================================================
+uint32_t TFT_diff_send(int x, int y, int w, int h, const uint8_t *pixels, uint8_t *shadow, int stride);
+
+// ==== Band renderer (tft_band.c) ====
+// Between TFT_band_begin() and TFT_band_end() the drawing functions are recorded into a display list
+// of TFT_BAND_LIST_SIZE bytes. TFT_flush() replays the list into a band buffer of a few display rows,
+// band after band; while one band is sent the next one is rasterized into the second buffer
+// (by a task on the other core if TFT_BAND_RASTER_CORE is set). A band whose pixels were all drawn
+// is sent with one transfer, otherwise the rectangles of drawn pixels are sent.
+// A full list is replayed at once. Reads and commands replay the list first.
+typedef struct {
+    uint32_t flushes;       // replays of the list
+    uint32_t list_full;     // replays because the list was full
+    uint32_t list_max;      // most bytes used in the list
+    uint32_t bands;         // bands sent with one transfer
+    uint32_t rects;         // rectangles sent from partly drawn bands
+    uint32_t pixels;        // pixels sent
+} tft_band_stats_t;
+
+extern tft_band_stats_t tft_band_stats;
+
+// Allocate the display list and two band buffers of 'height' rows (0: TFT_BAND_HEIGHT) in internal RAM
+// and record the drawing, call after the display is initialized, outside of disp_select()
+// Returns ESP_ERR_INVALID_STATE if a framebuffer, the band renderer or a canvas is active, ESP_ERR_NO_MEM
+//================================
+esp_err_t TFT_band_begin(int height);
+
+// Replay the list, free the buffers and draw to the display again
+//===================
+void TFT_band_end();
+
+// ==== Canvas (tft_canvas.c) ====
+// A canvas is a memory surface in the display pixel format. Between TFT_canvas_begin() and TFT_canvas_end()
+// all drawing functions (primitives, fonts, images) render into it as if it was the display: tft_dispWin,
+// tft_width and tft_height are those of the canvas, reads are served from it. TFT_blitCanvas() sends it
+// to the display with one window and RAMWR, so a widget composed off-screen appears at once.
+// Commands still go to the display; the rotation and the scroll area must not change while a canvas is selected.
+
+// Pixel formats of a canvas, the value is the number of bytes per pixel
+typedef enum {
+    TFT_CANVAS_RGB565 = 2,  // 16-bit, high byte first
+    TFT_CANVAS_RGB666 = 3,  // 18-bit, the layout of color_t
+} TFT_canvas_format_t;
+
+// Only canvases in the display pixel format are supported, a blit is a copy
+#if TFT_PIXEL_BYTES == 2
+    #define TFT_CANVAS_DISPLAY_FORMAT TFT_CANVAS_RGB565
+#else
+    #define TFT_CANVAS_DISPLAY_FORMAT TFT_CANVAS_RGB666
+#endif
+
+// The fields can also be set for memory of the application, e.g. to draw into a part of a larger canvas
+typedef struct {
+    int width;
+    int height;
+    int stride;             // pixels from the start of a row to the next one, at least 'width'
+    uint8_t format;         // TFT_canvas_format_t
+    uint8_t dma;            // 'pixels' is in DMA capable memory, a blit of contiguous rows needs no copy
+    uint8_t *pixels;
+} TFT_canvas_t;
+
+// Allocate a black 'width' x 'height' canvas, in DMA capable RAM up to TFT_FB_DRAM_MAX bytes, larger ones in PSRAM
+// Returns ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM
+//=====================================================================
+esp_err_t TFT_canvas_create(TFT_canvas_t *canvas, int width, int height);
+
+// Free the pixels of a canvas allocated by TFT_canvas_create(), it is deselected first
+//=============================================
+void TFT_canvas_delete(TFT_canvas_t *canvas);
+
+// Draw into the canvas, call outside of disp_select(); the clip window is the whole canvas
+// Returns ESP_ERR_INVALID_STATE if a canvas is already selected, ESP_ERR_NOT_SUPPORTED for another pixel format,
+// ESP_ERR_INVALID_ARG
+//====================================================
+esp_err_t TFT_canvas_begin(const TFT_canvas_t *canvas);
+
+// Draw to the display (or the framebuffer, the band renderer) again, the clip window is restored
+//====================
+void TFT_canvas_end();
+
+// Send the canvas to (x,y) relative to the display window, clipped to it; the canvas can be drawn to
+// again when it returns. Returns ESP_ERR_INVALID_STATE if a canvas is selected, ESP_ERR_NOT_SUPPORTED
+// For a canvas which is drawn again every cycle, TFT_diff_send() sends only the pixels that changed
+//===============================================================
+esp_err_t TFT_blitCanvas(const TFT_canvas_t *canvas, int x, int y);
+
 // Initialize all pins used by display driver
 // ** MUST be executed before SPI interface initialization
 //=================
@@ -762,12 +1362,52 @@ void TFT_PinsInit();
 //======================
 void TFT_display_init();
 
+// Same, 'commands' sends the init commands of the controller instead of the tables of 'tft_disp_type'
+// (used by the C++ panel layer, tft_panel.hpp)
+//=====================================================
+void TFT_display_init_commands(void (*commands)(void));
+
+// ==== Asynchronous initialization ====
+typedef enum {
+    TFT_INIT_IDLE = 0,      // not initialized
+    TFT_INIT_RESET,         // reset pulse and the delay after it
+    TFT_INIT_COMMANDS,      // sending the init tables with their delays
+    TFT_INIT_CLEAR,         // clearing the screen
+    TFT_INIT_READY,         // initialized, the screen is cleared and the backlight on
+} TFT_init_state_t;
+
+#define TFT_EVT_READY   (1 << 0)        // tft_events bit, set in TFT_INIT_READY
+
+extern EventGroupHandle_t tft_events;           // created by TFT_display_init_start()
+extern volatile TFT_init_state_t tft_init_state;
+extern int64_t tft_ready_time;                  // esp_timer time (us after boot) the display got ready, 0 before
+
+// Start the display initialization in its own task and return immediately.
+// The task waits in vTaskDelay() during the reset pulse and the controller delays (up to 500 ms),
+// so other boot work (file system, Wi-Fi) runs meanwhile; the display bus is released during the delays.
+// The display must not be used until TFT_EVT_READY is set in tft_events (TFT_display_wait_ready()).
+// 'commands' as in TFT_display_init_commands(), NULL sends the tables of 'tft_disp_type'
+// Returns ESP_ERR_INVALID_STATE if an initialization is running, ESP_ERR_NO_MEM if the task could not be created
+//==========================================================
+esp_err_t TFT_display_init_start(void (*commands)(void));
+
+// Wait at most 'ticks' for the display initialization to finish
+// Returns ESP_ERR_TIMEOUT if it did not, ESP_ERR_INVALID_STATE if it was never started
+//===================================================
+esp_err_t TFT_display_wait_ready(TickType_t ticks);
+
+// Send a display init table (see the tables above): number of commands,
+// then per command: command, number of arguments (| TFT_CMD_DELAY), arguments, delay in ms if TFT_CMD_DELAY
+//=========================================
+void commandList(const uint8_t *addr);
+
 //TODO: re enable this functionality, but i don't have a boart to test this on
 //===================
 //void stmpe610_Init();
 
+// Called by TFT_read_touch(), the implementation has to be re-enabled with the rest
 //============================================================
-//int stmpe610_get_touch(uint16_t *x, uint16_t *y, uint16_t *z);
+int stmpe610_get_touch(uint16_t *x, uint16_t *y, uint16_t *z);
 
 //========================
 //uint32_t stmpe610_getID();
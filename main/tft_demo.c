@@ -171,20 +171,17 @@ static void test_times() {
         sprintf(tmp_buff, "Clear screen: %u ms", t1);
         TFT_print(tmp_buff, 0, 140);
 
-        color_t *color_line = heap_caps_malloc((tft_width*3), MALLOC_CAP_DMA);
-        color_t *gsline = NULL;
-        if (tft_gray_scale) gsline = malloc(tft_width*3);
+        // the line is built once in the display pixel format, send_pixels() does not change it
+        uint8_t *color_line = heap_caps_malloc((tft_width*TFT_PIXEL_BYTES), MALLOC_CAP_DMA);
         if (color_line) {
             float hue_inc = (float)((10.0 / (float)(tft_height-1) * 360.0));
             for (int x=0; x<tft_width; x++) {
-                color_line[x] = HSBtoRGB(hue_inc, 1.0, (float)x / (float)tft_width);
-                if (gsline) gsline[x] = color_line[x];
+                TFT_pixel_store(color_line + (x*TFT_PIXEL_BYTES), HSBtoRGB(hue_inc, 1.0, (float)x / (float)tft_width));
             }
             disp_select();
             tstart = clock();
             for (int n=0; n<1000; n++) {
-                if (gsline) memcpy(color_line, gsline, tft_width*3);
-                send_data(0 + TFT_STATIC_X_OFFSET, 40+(n&63) + TFT_STATIC_Y_OFFSET, tft_dispWin.x2-tft_dispWin.x1 + TFT_STATIC_X_OFFSET , 40+(n&63) + TFT_STATIC_Y_OFFSET, (uint32_t)(tft_dispWin.x2-tft_dispWin.x1+1), color_line);
+                send_pixels(0 + TFT_STATIC_X_OFFSET, 40+(n&63) + TFT_STATIC_Y_OFFSET, tft_dispWin.x2-tft_dispWin.x1 + TFT_STATIC_X_OFFSET , 40+(n&63) + TFT_STATIC_Y_OFFSET, (uint32_t)(tft_dispWin.x2-tft_dispWin.x1+1), color_line);
             }
             t2 = clock() - tstart;
             disp_deselect();
@@ -195,6 +192,30 @@ static void test_times() {
             sprintf(tmp_buff, "   Send line: %u us", t2);
             TFT_print(tmp_buff, 0, 144+TFT_getfontheight());
         }
+
+        // ** 7-segment redraw timing, fills alternate between fg, bg and outline color
+        color_t fg_bkp = tft_fg;
+        TFT_setFont(FONT_7SEG, NULL);
+        set_7seg_font_atrib(12, 2, 1, TFT_DARKGREY);
+        tstart = clock();
+        for (int n=0; n<20; n++) {
+            tft_fg = (n & 1) ? TFT_YELLOW : TFT_GREEN;
+            TFT_print("88:88", 0, 4);
+        }
+        t2 = clock() - tstart;
+        tft_fg = fg_bkp;
+        printf("  7-seg redraw time: %u ms (20 redraws)\r\n", t2);
+
+        TFT_setFont(SMALL_FONT, NULL);
+        sprintf(tmp_buff, "7-seg x20: %u ms", t2);
+        TFT_print(tmp_buff, 0, 148+(TFT_getfontheight()*2));
+
+        // ** Cycles of the transaction callback setting the DC pin
+        t1 = TFT_dc_callback_cycles(1, 1000);
+        t2 = TFT_dc_callback_cycles(0, 1000);
+        printf("     DC callback time: %u cycles (level change), %u cycles (same level)\r\n", t1, t2);
+        sprintf(tmp_buff, "DC callback: %u / %u cycles", t1, t2);
+        TFT_print(tmp_buff, 0, 152+(TFT_getfontheight()*3));
         Wait(GDEMO_INFO_TIME);
     }
 }
@@ -777,41 +798,83 @@ static void poly_demo() {
     Wait(-GDEMO_INFO_TIME);
 }
 
-static void eur_mxn_demo() {
-    color_t fg_bkp = tft_fg;
+// ==== Currency screen ====
+// The labels are drawn once, a price is drawn again only when it has changed.
+// After a resume with the GRAM kept (tft_gram_valid) nothing has to be repainted.
+typedef struct {
+    const char *label;
+    float (*get)();
+    int y;          // top of the widget, relative to the clip window
+    int h;          // height of the widget
+    float shown;    // price on the screen, < 0 if none
+} currency_widget_t;
+
+static currency_widget_t widgets[2] = {
+    { "USD/BTC", get_btc_usd, 0, 0, -1 },
+    { "MXN/EUR", get_eur_mxn, 0, 0, -1 },
+};
+static int currency_seg_len = 6;    // 7-segment length of the prices
+
+//-----------------------------
+static void currency_screen() {
     printf("Demo: %s\r\n", __func__);
-    disp_header("MXN/EUR");
-    tft_fg = TFT_BLUE;
-    TFT_setFont(FONT_7SEG, NULL);
-    set_7seg_font_atrib(23, 2, 1, TFT_BLUE);
-    char msg[30];
-    memset(msg, 0, 30);
-    float mxn_eur = get_eur_mxn();
-    printf("MXN/EUR: %f\n", mxn_eur);
-    sprintf(msg, "%.2f", mxn_eur);
-    TFT_print(msg, 0, 2);
-    tft_fg = fg_bkp;
-    update_header(NULL, NULL);
-    Wait(-GDEMO_INFO_TIME);
+    disp_header("Currency track");
+
+    int win_w = tft_dispWin.x2 - tft_dispWin.x1 + 1;
+    int win_h = tft_dispWin.y2 - tft_dispWin.y1 + 1;
+    TFT_setFont(DEFAULT_FONT, NULL);
+    int label_h = TFT_getfontheight() + 2;
+
+    // a price is 8 characters, with segment width 2 a character is 'length'+12 wide and 2*'length'+15 high
+    currency_seg_len = ((win_h / 2) - label_h - 15) / 2;
+    if (currency_seg_len > ((win_w / 8) - 12)) currency_seg_len = (win_w / 8) - 12;
+    if (currency_seg_len > 23) currency_seg_len = 23;
+    if (currency_seg_len < 6) currency_seg_len = 6;
+
+    tft_fg = TFT_CYAN;
+    for (int i = 0; i < 2; i++) {
+        widgets[i].y = i * (win_h / 2);
+        widgets[i].h = win_h / 2;
+        widgets[i].shown = -1;
+        TFT_print((char *)widgets[i].label, 0, widgets[i].y);
+    }
 }
 
-static void btc_usd_demo() {
+// Draw the prices of the first 'n' widgets which have changed
+//-----------------------------------
+static void currency_update(int n) {
     color_t fg_bkp = tft_fg;
-    color_t bg_bkp = tft_bg;
-    printf("Demo: %s\r\n", __func__);
-    disp_header("USD/BTC");
-    tft_fg = TFT_YELLOW;
-    TFT_setFont(FONT_7SEG, NULL);
-    set_7seg_font_atrib(23, 2, 1, TFT_YELLOW);
     char msg[30];
-    memset(msg, 0, 30);
-    float usd_btc = get_btc_usd();
-    printf("USD/BTC: %f\n", usd_btc);
-    sprintf(msg, "%.2f", usd_btc);
-    TFT_print(msg, 0, 2);
-    update_header(NULL, NULL);
+
+    TFT_setFont(DEFAULT_FONT, NULL);
+    int label_h = TFT_getfontheight() + 2;
+    TFT_setFont(FONT_7SEG, NULL);
+    for (int i = 0; i < n; i++) {
+        float price = widgets[i].get();
+        if (price == widgets[i].shown) continue;
+
+        color_t color = (i == 0) ? TFT_YELLOW : TFT_BLUE;
+        printf("%s: %f\n", widgets[i].label, price);
+        set_7seg_font_atrib(currency_seg_len, 2, 1, color);
+        tft_fg = color;
+        TFT_fillRect(0, widgets[i].y + label_h, tft_dispWin.x2 - tft_dispWin.x1 + 1, widgets[i].h - label_h, tft_bg);
+        sprintf(msg, "%.2f", price);
+        TFT_print(msg, 0, widgets[i].y + label_h);
+        widgets[i].shown = price;
+    }
     tft_fg = fg_bkp;
-    Wait(-GDEMO_INFO_TIME);
+}
+
+// Show only the first price line, the rest of the display is off
+// Partial areas are rows of the display in portrait orientations only (CONFIG_ESP_EXAMPLE_PORTRAIT)
+//---------------------------------
+static esp_err_t currency_partial() {
+    if (tft_scroll.cols) return ESP_ERR_NOT_SUPPORTED;
+
+    int top = tft_dispWin.y1 - TFT_STATIC_Y_OFFSET + widgets[0].y;
+    esp_err_t ret = TFT_setPartialArea(top, top + widgets[0].h - 1);
+    if (ret == ESP_OK) ret = TFT_setPower(TFT_POWER_PARTIAL);
+    return ret;
 }
 
 //===============
@@ -855,7 +918,12 @@ void tft_demo() {
             sprintf(dtype, "Unknown");
     }
     
+#ifdef CONFIG_ESP_EXAMPLE_PORTRAIT
+    // the first price line is shown in partial mode while the display is off
+    const uint8_t disp_rot = PORTRAIT;
+#else
     const uint8_t disp_rot = LANDSCAPE_FLIP;
+#endif
     _demo_pass = 0;
     tft_gray_scale = 0;
     doprint = 1;
@@ -876,6 +944,9 @@ void tft_demo() {
     TFT_print(tmp_buff, CENTER, LASTY+tempy);
 
     Wait(4000);
+#ifdef CONFIG_ESP_EXAMPLE_SHOW_TIMINGS
+    test_times();
+#endif
 
     if (doprint) {
         if (disp_rot == PORTRAIT) sprintf(tmp_buff, "PORTRAIT");
@@ -886,37 +957,38 @@ void tft_demo() {
                 dtype, tmp_buff, tft_width, tft_height, ((tft_gray_scale) ? "Gray" : "Color"));
     }
     uint32_t fsm_state = STATE_TFT_ON;
+    currency_screen();
     while (1) {
         fsm_state = fsm_calc_next(fsm_state);
         switch (fsm_state)
         {
         case STATE_TFT_OFF:
+            // in partial mode the first price line is still shown
+            if (tft_power == TFT_POWER_PARTIAL) currency_update(1);
             Wait(5 * 1000);
             break;
         case TRANSITION_OFF_TO_ON:
-            disp_spi_transfer_cmd(TFT_DISPON);
-            Wait(5);
+            TFT_setPower(TFT_POWER_ON);
+            printf("Display resumed in %u us, GRAM %s\n", tft_resume_us, (tft_gram_valid) ? "kept" : "lost");
             // poweron backlight
             // disp_spi_transfer_cmd_data(0x53, &backlight_on, 1);
-            Wait(5);
             // Set display brightness
             // disp_spi_transfer_cmd_data(0x51, &brigthness_on, 1);
-            Wait(15);
+            if (!tft_gram_valid) currency_screen();
+            currency_update(2);
             break;
         case TRANSITION_ON_TO_OFF:
-            disp_spi_transfer_cmd(TFT_DISPOFF);
-            Wait(5);
             // Shutdown backlight
             // disp_spi_transfer_cmd_data(0x53, &backlight_off, 1);
-            Wait(5);
             // Set display brightness
             // disp_spi_transfer_cmd_data(0x51, &brigthness_off, 1);
-            Wait(15);
+            if (currency_partial() != ESP_OK) TFT_setPower(TFT_POWER_SLEEP);
             break;
         default:
         case STATE_TFT_ON:
-            btc_usd_demo();
-            eur_mxn_demo();
+            currency_update(2);
+            update_header(NULL, NULL);
+            Wait(-GDEMO_INFO_TIME);
             break;
         }
 
@@ -959,7 +1031,7 @@ void app_main() {
     // ===================================================
     // ==== Set maximum spi clock for display read    ====
     //      operations, function 'find_rd_speed()'    ====
-    //      can be used after display initialization  ====
+    //      sets it after display initialization      ====
     tft_max_rdclock = 8000000;
     // ===================================================
 
@@ -995,14 +1067,9 @@ void app_main() {
         .spics_io_num=PIN_NUM_CS,               // external CS pin
         //TODO: check if .input_delay_ns is needed
         .flags=SPI_DEVICE_HALFDUPLEX,           // ALWAYS SET  to HALF DUPLEX MODE!! for display spi
-        .queue_size = (                            // transmission queue size
-            (DEFAULT_TFT_DISPLAY_HEIGHT
-             *DEFAULT_TFT_DISPLAY_WIDTH)
-             /TFT_REPEAT_BUFFER_SIZE)
-             + 10, //just a bit more for good measure
-        //the queue size has to be large enougth to fit at least
-        //((resolution_h*resolution_v)/tft_repeat_buffer_size)
-        //transmissions
+        .queue_size = TFT_SPI_QUEUE_SIZE,       // transmission queue size
+        //the library never queues more than TFT_SPI_QUEUE_SIZE transactions,
+        //fills of any size are streamed through them
         .pre_cb = &TFT_transaction_begin_callback,
         .post_cb = NULL,
     };
@@ -1032,7 +1099,6 @@ void app_main() {
     // ====================================================================================================================
 
 
-    vTaskDelay(500 / portTICK_RATE_MS);
     printf("\r\n==============================\r\n");
     printf("TFT display DEMO, LoBo 11/2017\r\n");
     printf("==============================\r\n");
@@ -1065,15 +1131,56 @@ void app_main() {
     printf("SPI: attached TS device, speed=%u\r\n", spi_get_speed(tsspi));
 #endif
 
-    // ================================
-    // ==== Initialize the Display ====
+    // ==============================================================
+    // ==== Start the display initialization in its own task,   ====
+    // ==== the boot work below runs during the controller delays ====
 
-    printf("SPI: display init...\r\n");
-    TFT_display_init();
+    printf("SPI: display init started\r\n");
+    ret = TFT_display_init_start(NULL);
+    ESP_ERROR_CHECK(ret);
+
+#ifdef CONFIG_ESP_EXAMPLE_USE_WIFI
+    int wifi_started = 0;
+    ESP_ERROR_CHECK( nvs_flash_init() );
+    // ===== Set time zone ======
+    setenv("TZ", "CET-1CEST", 0);
+    tzset();
+    // ==========================
+    time(&time_now);
+    tm_info = localtime(&time_now);
+    // Is time set? If not, tm_year will be (1970 - 1900).
+    if (tm_info->tm_year < (2016 - 1900)) {
+        initialise_wifi();
+        wifi_started = 1;
+    }
+#endif
+
+    // ==== Initialize the file system ====
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = SPIFFS_BASE_PATH,
+        .partition_label = "storage",
+        .max_files = 20,
+        .format_if_mount_failed = false
+    };
+    esp_err_t spiffs_ret = esp_vfs_spiffs_register(&conf);
+    spiffs_is_mounted = spiffs_ret == ESP_OK;
+    printf("\r\n\nSpiffs mount status: %s\n", esp_err_to_name(spiffs_ret));
+
+    ret = TFT_display_wait_ready(portMAX_DELAY);
+    ESP_ERROR_CHECK(ret);
+    printf("SPI: display ready %u ms after boot\r\n", (uint32_t)(tft_ready_time / 1000));
 #ifdef TFT_START_COLORS_INVERTED
     TFT_invertDisplay(1);
 #endif
-    printf("OK\r\n");
+    printf("OK, fills up to %u pixels are sent polled\r\n", (unsigned int)tft_short_run_len);
+
+    // ==== Add the read device and find the highest read clock ====
+    ret = TFT_read_device_init(SPI_BUS, tft_max_rdclock);
+    if (ret == ESP_OK) {
+        if (find_rd_speed()) printf("SPI: display read speed %u Hz\r\n", tft_max_rdclock);
+        else printf("SPI: display reads failed, read speed set to %u Hz\r\n", tft_max_rdclock);
+    }
+    else printf("SPI: display reads not available (%s)\r\n", esp_err_to_name(ret));
     #if USE_TOUCH == TOUCH_TYPE_STMPE610
     stmpe610_Init();
     vTaskDelay(10 / portTICK_RATE_MS);
@@ -1097,21 +1204,11 @@ void app_main() {
 
 #ifdef CONFIG_ESP_EXAMPLE_USE_WIFI
 
-    ESP_ERROR_CHECK( nvs_flash_init() );
-
     ESP_LOGI(tag, "-------------------------------------- NTP.");
-    // ===== Set time zone ======
-    setenv("TZ", "CET-1CEST", 0);
-    tzset();
-    // ==========================
-
     disp_header("GET NTP TIME");
 
-    time(&time_now);
-    tm_info = localtime(&time_now);
-
-    // Is time set? If not, tm_year will be (1970 - 1900).
-    if (tm_info->tm_year < (2016 - 1900)) {
+    // Wi-Fi was started if the time is not set
+    if (wifi_started) {
         ESP_LOGI(tag, "Time is not set yet. Connecting to WiFi and getting time over NTP.");
         tft_fg = TFT_CYAN;
         TFT_print("Time is not set yet", CENTER, CENTER);
@@ -1136,16 +1233,6 @@ void app_main() {
     disp_header("File system INIT");
     tft_fg = TFT_CYAN;
     TFT_print("Initializing SPIFFS...", CENTER, CENTER);
-    // ==== Initialize the file system ====
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = SPIFFS_BASE_PATH,
-        .partition_label = "storage",
-        .max_files = 20,
-        .format_if_mount_failed = false
-    };
-    esp_err_t spiffs_ret = esp_vfs_spiffs_register(&conf);
-    spiffs_is_mounted = spiffs_ret == ESP_OK;
-    printf("\r\n\nSpiffs mount status: %s\n", esp_err_to_name(spiffs_ret));
     if (!spiffs_is_mounted) {
         tft_fg = TFT_RED;
         TFT_print("SPIFFS not mounted !", CENTER, LASTY+TFT_getfontheight()+2);
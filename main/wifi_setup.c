@@ -91,6 +91,11 @@ void initialise_wifi(void) {
     ESP_ERROR_CHECK( esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) );
     ESP_ERROR_CHECK( esp_wifi_start() );
     ESP_LOGI(tag, "wifi_init_sta finished.");
+}
+
+// Wait for the connection started by initialise_wifi(), returns 1 if connected
+//-------------------------------
+static int wait_wifi() {
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
     EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
@@ -110,6 +115,7 @@ void initialise_wifi(void) {
     } else {
         ESP_LOGE(tag, "UNEXPECTED EVENT");
     }
+    return (bits & WIFI_CONNECTED_BIT) != 0;
 }
 
 //-------------------------------
@@ -123,8 +129,9 @@ void initialize_sntp() {
 //--------------------------
 int obtain_time() {
     int res = 1;
-    initialise_wifi();
-    xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
+    // the connection may already be started during the display initialization
+    if (wifi_event_group == NULL) initialise_wifi();
+    if (!wait_wifi()) return 0;
 
     initialize_sntp();
 
@@ -12,6 +12,7 @@
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data);
+// Start the connection to the access point, obtain_time() waits for it
 void initialise_wifi();
 void initialize_sntp();
 int obtain_time();
@@ -0,0 +1,27 @@
+/*
+ * HOST EMULATOR, C++ panel layer
+ * Steps of the test scene drawn through tft::ConfiguredPanel (tft_emu -p),
+ * the result must be the same as with the C functions.
+ */
+
+#include "tft_panel.hpp"
+#include "emu_cxx.h"
+
+typedef tft::ConfiguredPanel Display;
+typedef Display::View<LANDSCAPE> Screen;
+
+//-----------------------
+void emu_cxx_init(void) {
+    Display::init();
+}
+
+//-------------------------------
+void emu_cxx_landscape(void) {
+    Display::set_orientation<LANDSCAPE>();
+}
+
+//----------------------------------------------------------------
+void emu_cxx_fill_rect(int x, int y, int w, int h, color_t color) {
+    if ((w == Screen::width) && (h == Screen::height)) Screen::fill(color);
+    else Screen::fill_rect(x, y, w, h, color);
+}
@@ -0,0 +1,21 @@
+/*
+ * HOST EMULATOR, C++ panel layer steps, see emu_cxx.cpp
+ */
+#pragma once
+
+#include "tftspi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Display::init() instead of TFT_display_init()
+void emu_cxx_init(void);
+// Display::set_orientation<LANDSCAPE>() instead of TFT_setRotation(LANDSCAPE)
+void emu_cxx_landscape(void);
+// Display::View<LANDSCAPE> fills instead of TFT_fillScreen() / TFT_fillRect()
+void emu_cxx_fill_rect(int x, int y, int w, int h, color_t color);
+
+#ifdef __cplusplus
+}
+#endif
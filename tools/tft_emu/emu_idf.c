@@ -0,0 +1,629 @@
+/*
+ *
+ * HOST EMULATOR, ESP-IDF STAND-INS
+ *
+ * Queued transactions are executed when their result is collected,
+ * the order on the bus is the same as with the real driver.
+ * Driver misuse which the real driver rejects or which breaks the transfer
+ * (polling while transactions are queued, releasing the bus with queued transactions,
+ * changing a queued tx buffer) aborts the emulator.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/spi_periph.h"
+#include "soc/gpio_struct.h"
+#include "esp32/rom/gpio.h"
+#include "tftspi.h"
+#include "emu_panel.h"
+#include "emu_idf.h"
+
+#define EMU_SPI_DEVICES 6
+#define EMU_SPI_QUEUE   64
+#define EMU_GPIO_PINS   40
+
+emu_spi_stats_t emu_spi_stats = {0};
+uint32_t emu_max_read_clock = 10000000;
+
+static uint64_t emu_time_ns = 0;
+
+static void emu_task_switch(uint8_t preempt);
+static void emu_touch_transfer(const uint8_t *tx, uint8_t *rx, size_t len);
+
+struct spi_device_t {
+    uint8_t used;
+    spi_host_device_t host;
+    spi_device_interface_config_t cfg;
+    spi_transaction_t *queue[EMU_SPI_QUEUE];
+    uint32_t hash[EMU_SPI_QUEUE];       // tx data of the queued transaction
+    int head;
+    int count;
+    int cs_slot;                        // CS signal of the host used by the device, -1 without CS pin
+};
+
+static struct spi_device_t emu_devices[EMU_SPI_DEVICES];
+
+static uint8_t gpio_level[EMU_GPIO_PINS];
+static uint8_t gpio_is_gpio[EMU_GPIO_PINS];    // output routed to the GPIO register, not to a peripheral
+gpio_dev_t GPIO;
+
+const spi_signal_conn_t spi_periph_signal[3] = {
+    { .spics_out = {5, 6, 7} },
+    { .spics_out = {68, 69, 70} },
+    { .spics_out = {71, 72, 73} },
+};
+
+//===========================
+void emu_spi_stats_reset() {
+    memset(&emu_spi_stats, 0, sizeof(emu_spi_stats));
+}
+
+//======================
+uint64_t emu_clock_ns() {
+    return emu_time_ns;
+}
+
+//=====================================
+int64_t esp_timer_get_time(void) {
+    return emu_time_ns / 1000;
+}
+
+// ==== Tasks ===================================================
+// Tasks are coroutines on the virtual clock, only one runs at a time and the result is deterministic.
+// The runnable task with the highest priority runs (app_main has priority 1), a task runs until it
+// blocks (vTaskDelay(), event group wait, bus held by another device) or a task of higher priority
+// gets runnable, which is checked after every transaction. When no task is runnable the clock
+// advances to the next wake up.
+
+#define EMU_TASKS       4                   // created tasks, the main task is emu_tasks[0]
+#define EMU_TASK_STACK  (256 * 1024)
+
+typedef enum {
+    EMU_RUNNING = 0,
+    EMU_DELAYED,        // until 'wake_ns'
+    EMU_EVENT,          // until 'bits' are set in 'group', or 'wake_ns' if it is not 0
+    EMU_BUS,            // until the bus is released
+    EMU_DELETED,
+} emu_task_state_t;
+
+typedef struct {
+    uint8_t used;
+    emu_task_state_t state;
+    UBaseType_t priority;
+    ucontext_t ctx;
+    void *stack;
+    TaskFunction_t fn;
+    void *arg;
+    uint64_t wake_ns;
+    EventGroupHandle_t group;
+    EventBits_t bits;
+    BaseType_t all;
+} emu_task_t;
+
+struct emu_event_group {
+    EventBits_t bits;
+};
+
+static emu_task_t emu_tasks[EMU_TASKS + 1] = { [0] = { .used = 1, .priority = 1 } };
+static int emu_current = 0;
+static spi_device_handle_t emu_bus_owner = NULL;
+static int emu_bus_task = 0;            // task which acquired the bus for emu_bus_owner
+
+//------------------------------------------------------------
+static uint8_t event_set(EventGroupHandle_t group, EventBits_t bits, BaseType_t all) {
+    return (all) ? ((group->bits & bits) == bits) : ((group->bits & bits) != 0);
+}
+
+//--------------------------------------------
+static uint8_t task_runnable(emu_task_t *task) {
+    if (!task->used) return 0;
+    switch (task->state) {
+        case EMU_RUNNING: return 1;
+        case EMU_DELAYED: return emu_time_ns >= task->wake_ns;
+        case EMU_EVENT: return event_set(task->group, task->bits, task->all) || ((task->wake_ns) && (emu_time_ns >= task->wake_ns));
+        case EMU_BUS: return emu_bus_owner == NULL;
+        default: return 0;
+    }
+}
+
+// Run the task the FreeRTOS scheduler would run now,
+// 'preempt': the current task is running, it is only switched for a task of higher priority
+//---------------------------------------------
+static void emu_task_switch(uint8_t preempt) {
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i <= EMU_TASKS; i++) {
+            if ((task_runnable(&emu_tasks[i])) && ((next < 0) || (emu_tasks[i].priority > emu_tasks[next].priority))) next = i;
+        }
+        if ((next >= 0) && (task_runnable(&emu_tasks[emu_current])) && (emu_tasks[next].priority <= emu_tasks[emu_current].priority)) {
+            next = emu_current;
+        }
+        if (next >= 0) {
+            if (next == emu_current) {
+                emu_tasks[next].state = EMU_RUNNING;
+                return;
+            }
+            int prev = emu_current;
+            emu_current = next;
+            emu_tasks[next].state = EMU_RUNNING;
+            swapcontext(&emu_tasks[prev].ctx, &emu_tasks[next].ctx);
+            return;
+        }
+        if (preempt) return;
+
+        // nothing can run, advance the clock to the next wake up
+        uint64_t wake = UINT64_MAX;
+        for (int i = 0; i <= EMU_TASKS; i++) {
+            emu_task_t *task = &emu_tasks[i];
+            if ((task->used) && ((task->state == EMU_DELAYED) || ((task->state == EMU_EVENT) && (task->wake_ns))) && (task->wake_ns < wake)) {
+                wake = task->wake_ns;
+            }
+        }
+        if (wake == UINT64_MAX) {
+            fprintf(stderr, "tft_emu: all tasks wait forever (event group or bus)\n");
+            abort();
+        }
+        emu_time_ns = wake;
+    }
+}
+
+//----------------------------------------
+static void task_entry(int idx) {
+    emu_tasks[idx].fn(emu_tasks[idx].arg);
+    vTaskDelete(NULL);
+}
+
+//==================================
+void vTaskDelay(TickType_t ticks) {
+    emu_spi_stats.delay_ns += (uint64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    emu_tasks[emu_current].state = EMU_DELAYED;
+    emu_tasks[emu_current].wake_ns = emu_time_ns + ((uint64_t)ticks * portTICK_PERIOD_MS * 1000000);
+    emu_task_switch(0);
+}
+
+//===================================
+TickType_t xTaskGetTickCount(void) {
+    return emu_time_ns / (portTICK_PERIOD_MS * 1000000);
+}
+
+//=====================================================================================================================
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    (void)name;
+    (void)stack;
+    for (int i = 1; i <= EMU_TASKS; i++) {
+        emu_task_t *t = &emu_tasks[i];
+        if ((t->used) && (t->state != EMU_DELETED)) continue;
+        // the stack of a deleted task is freed when its slot is used again
+        free(t->stack);
+        memset(t, 0, sizeof(emu_task_t));
+        t->stack = malloc(EMU_TASK_STACK);
+        if (t->stack == NULL) return pdFAIL;
+        t->used = 1;
+        t->priority = priority;
+        t->fn = task;
+        t->arg = arg;
+        getcontext(&t->ctx);
+        t->ctx.uc_stack.ss_sp = t->stack;
+        t->ctx.uc_stack.ss_size = EMU_TASK_STACK;
+        t->ctx.uc_link = NULL;
+        makecontext(&t->ctx, (void (*)(void))task_entry, 1, i);
+        if (handle) *handle = t;
+        // a task of higher priority runs at once
+        emu_task_switch(1);
+        return pdPASS;
+    }
+    return pdFAIL;
+}
+
+//==============================
+void vTaskDelete(TaskHandle_t task) {
+    emu_task_t *t = (task) ? (emu_task_t *)task : &emu_tasks[emu_current];
+    if (t == &emu_tasks[0]) {
+        fprintf(stderr, "tft_emu: the main task is deleted\n");
+        abort();
+    }
+    t->state = EMU_DELETED;
+    if (t == &emu_tasks[emu_current]) emu_task_switch(0);
+}
+
+//==============================================
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    emu_task_t *t = (task) ? (emu_task_t *)task : &emu_tasks[emu_current];
+    return t->priority;
+}
+
+//=========================================
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return &emu_tasks[emu_current];
+}
+
+// ==== Event groups ============================================
+
+//=======================================
+EventGroupHandle_t xEventGroupCreate(void) {
+    return calloc(1, sizeof(struct emu_event_group));
+}
+
+//============================================
+void vEventGroupDelete(EventGroupHandle_t group) {
+    free(group);
+}
+
+//==============================================================================
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    EventBits_t set = group->bits;
+    emu_task_switch(1);
+    return set;
+}
+
+//================================================================================
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t old = group->bits;
+    group->bits &= ~bits;
+    return old;
+}
+
+//=================================================================================================================================
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks) {
+    emu_task_t *task = &emu_tasks[emu_current];
+    uint64_t timeout = (ticks == portMAX_DELAY) ? 0 : emu_time_ns + ((uint64_t)ticks * portTICK_PERIOD_MS * 1000000);
+
+    while ((!event_set(group, bits, all)) && (ticks)) {
+        if ((timeout) && (emu_time_ns >= timeout)) break;
+        task->state = EMU_EVENT;
+        task->group = group;
+        task->bits = bits;
+        task->all = all;
+        task->wake_ns = timeout;
+        emu_task_switch(0);
+    }
+    EventBits_t set = group->bits;
+    if ((clear) && (event_set(group, bits, all))) group->bits &= ~bits;
+    return set;
+}
+
+//=========================================
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    }
+    return "UNKNOWN ERROR";
+}
+
+// ==== GPIO ====================================================
+
+// The display CS pin went high, a running read command ends
+//--------------------------------------------------
+static void gpio_changed(int pin, uint8_t old_level) {
+    if ((pin == PIN_NUM_CS) && (old_level == 0) && (gpio_level[pin]) && (gpio_is_gpio[pin])) emu_panel_deselect();
+#if PIN_NUM_RST
+    if ((pin == PIN_NUM_RST) && (old_level == 0) && (gpio_level[pin])) emu_panel_reset();
+#endif
+}
+
+//==================================================
+esp_err_t gpio_set_level(int gpio_num, uint32_t level) {
+    if ((gpio_num < 0) || (gpio_num >= EMU_GPIO_PINS)) return ESP_ERR_INVALID_ARG;
+    uint8_t old = gpio_level[gpio_num];
+    gpio_level[gpio_num] = (level) ? 1 : 0;
+    if (gpio_num == PIN_NUM_DC) emu_spi_stats.dc_writes++;
+    gpio_changed(gpio_num, old);
+    return ESP_OK;
+}
+
+//=============================
+int gpio_get_level(int gpio_num) {
+    if ((gpio_num < 0) || (gpio_num >= EMU_GPIO_PINS)) return 0;
+    return gpio_level[gpio_num];
+}
+
+// GPIO output set/clear registers
+//=================================================
+void emu_reg_write(uint32_t reg, uint32_t value) {
+    int base = ((reg == GPIO_OUT1_W1TS_REG) || (reg == GPIO_OUT1_W1TC_REG)) ? 32 : 0;
+    uint8_t set = (reg == GPIO_OUT_W1TS_REG) || (reg == GPIO_OUT1_W1TS_REG);
+
+    if ((reg != GPIO_OUT_W1TS_REG) && (reg != GPIO_OUT_W1TC_REG) && (reg != GPIO_OUT1_W1TS_REG) && (reg != GPIO_OUT1_W1TC_REG)) {
+        fprintf(stderr, "tft_emu: write to unknown register 0x%08x\n", reg);
+        abort();
+    }
+    for (int bit = 0; bit < 32; bit++) {
+        int pin = base + bit;
+        if ((value & (1u << bit)) && (pin < EMU_GPIO_PINS)) {
+            uint8_t old = gpio_level[pin];
+            gpio_level[pin] = set;
+            if (pin == PIN_NUM_DC) emu_spi_stats.dc_writes++;
+            gpio_changed(pin, old);
+        }
+    }
+}
+
+//=========================================================================================
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv) {
+    (void)out_inv;
+    (void)oen_inv;
+    if (gpio >= EMU_GPIO_PINS) return;
+    if ((signal_idx != SIG_GPIO_OUT_IDX) && (gpio_is_gpio[gpio]) && (gpio == PIN_NUM_CS)) {
+        // the CS line goes back to the idle (high) peripheral output
+        if (gpio_level[gpio] == 0) emu_panel_deselect();
+    }
+    gpio_is_gpio[gpio] = (signal_idx == SIG_GPIO_OUT_IDX);
+    GPIO.func_out_sel_cfg[gpio].func_sel = signal_idx;
+}
+
+// ==== spi_master ==============================================
+
+//-------------------------------------------------------------
+static uint32_t tx_hash(const spi_transaction_t *t) {
+    const uint8_t *p = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : t->tx_buffer;
+    uint32_t h = 2166136261u;
+
+    if (p == NULL) return 0;
+    for (size_t i = 0; i < (t->length + 7) / 8; i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// Is the display controller selected during a transaction of the device
+//------------------------------------------------------------
+static uint8_t panel_selected(struct spi_device_t *dev) {
+    // the CS pin must be routed to the CS signal of this device
+    if (dev->cfg.spics_io_num >= 0) return (dev->cfg.spics_io_num == PIN_NUM_CS) &&
+        (GPIO.func_out_sel_cfg[PIN_NUM_CS].func_sel == spi_periph_signal[dev->host].spics_out[dev->cs_slot]);
+    return (gpio_is_gpio[PIN_NUM_CS]) && (gpio_level[PIN_NUM_CS] == 0);
+}
+
+// Send the transaction to the controller and advance the virtual clock
+//-----------------------------------------------------------------------------------------
+static void spi_execute(struct spi_device_t *dev, spi_transaction_t *t, uint8_t polling) {
+    const uint8_t *tx = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : t->tx_buffer;
+    uint8_t *rx = (t->flags & SPI_TRANS_USE_RXDATA) ? t->rx_data : t->rx_buffer;
+    size_t rxlength = t->rxlength;
+    uint64_t bits;
+
+    if ((!(dev->cfg.flags & SPI_DEVICE_HALFDUPLEX)) && (rxlength == 0) && (rx)) rxlength = t->length;
+    if ((t->length) && (tx == NULL)) {
+        fprintf(stderr, "tft_emu: transaction with %u tx bits and no tx buffer\n", (unsigned)t->length);
+        abort();
+    }
+
+    if (dev->cfg.pre_cb) dev->cfg.pre_cb(t);
+
+    uint8_t selected = panel_selected(dev);
+    uint8_t dc = gpio_level[PIN_NUM_DC];
+    if ((!selected) && (dev->cfg.spics_io_num == -1)) emu_spi_stats.unselected++;
+
+    if (selected) {
+        if (dev->cfg.command_bits) {
+            uint8_t cmd = t->cmd & 0xFF;
+            emu_panel_write(dc, &cmd, 1);
+        }
+        if (t->length) emu_panel_write(dc, tx, t->length / 8);
+    }
+    if ((rxlength) && (dev->cfg.spics_io_num == PIN_NUM_TCS) && (PIN_NUM_TCS >= 0)) {
+        emu_touch_transfer(tx, rx, rxlength / 8);
+    }
+    else if (rxlength) {
+        if (selected) {
+            emu_panel_read(dev->cfg.dummy_bits, rx, rxlength / 8);
+            if ((uint32_t)dev->cfg.clock_speed_hz > emu_max_read_clock) {
+                // sampled too early, every other byte has a wrong top bit
+                for (size_t i = 1; i < rxlength / 8; i += 2) rx[i] ^= 0x80;
+            }
+        }
+        else memset(rx, 0, rxlength / 8);
+    }
+    // a device with its own CS pin releases it after every transaction
+    if ((selected) && (dev->cfg.spics_io_num >= 0)) emu_panel_deselect();
+
+    bits = dev->cfg.command_bits + dev->cfg.address_bits + t->length + ((rxlength) ? dev->cfg.dummy_bits + rxlength : 0);
+    emu_spi_stats.bytes += bits / 8;
+    emu_spi_stats.bus_ns += (bits * 1000000000ULL) / dev->cfg.clock_speed_hz;
+    emu_time_ns += (bits * 1000000000ULL) / dev->cfg.clock_speed_hz;
+    emu_time_ns += (polling) ? EMU_POLLING_OVERHEAD_NS : EMU_QUEUED_OVERHEAD_NS;
+    if (polling) emu_spi_stats.polling++;
+    else emu_spi_stats.queued++;
+
+    if (dev->cfg.post_cb) dev->cfg.post_cb(t);
+    // a task of higher priority may be due
+    emu_task_switch(1);
+}
+
+//======================================================================================================
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, int dma_chan) {
+    (void)host;
+    (void)bus_config;
+    (void)dma_chan;
+    return ESP_OK;
+}
+
+//=============================================
+esp_err_t spi_bus_free(spi_host_device_t host) {
+    (void)host;
+    return ESP_OK;
+}
+
+// Lowest CS signal of the host no device uses, -1 if all are used
+//-------------------------------------------------
+static int spi_cs_slot_free(spi_host_device_t host) {
+    for (int slot = 0; slot < 3; slot++) {
+        int used = 0;
+        for (int i = 0; i < EMU_SPI_DEVICES; i++) {
+            if ((emu_devices[i].used) && (emu_devices[i].host == host) && (emu_devices[i].cs_slot == slot)) used = 1;
+        }
+        if (!used) return slot;
+    }
+    return -1;
+}
+
+//=====================================================================================================================================
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle) {
+    if ((dev_config->queue_size < 1) || (dev_config->queue_size > EMU_SPI_QUEUE)) return ESP_ERR_INVALID_ARG;
+    if (dev_config->clock_speed_hz <= 0) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < EMU_SPI_DEVICES; i++) {
+        if (emu_devices[i].used) continue;
+        memset(&emu_devices[i], 0, sizeof(struct spi_device_t));
+        emu_devices[i].used = 1;
+        emu_devices[i].host = host;
+        emu_devices[i].cfg = *dev_config;
+        emu_devices[i].cs_slot = -1;
+        if ((dev_config->spics_io_num >= 0) && (dev_config->spics_io_num < EMU_GPIO_PINS)) {
+            // the driver gives the device the lowest free CS signal of the host
+            emu_devices[i].cs_slot = spi_cs_slot_free(host);
+            if (emu_devices[i].cs_slot < 0) {
+                emu_devices[i].used = 0;
+                return ESP_ERR_NOT_FOUND;
+            }
+            gpio_is_gpio[dev_config->spics_io_num] = 0;
+            GPIO.func_out_sel_cfg[dev_config->spics_io_num].func_sel = spi_periph_signal[host].spics_out[emu_devices[i].cs_slot];
+        }
+        *handle = &emu_devices[i];
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+//=========================================================
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+    if (handle->count) return ESP_ERR_INVALID_STATE;
+    handle->used = 0;
+    return ESP_OK;
+}
+
+//=========================================================================================================
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    if (handle->count >= handle->cfg.queue_size) {
+        // the real driver would block forever, nobody collects the results while the caller waits
+        fprintf(stderr, "tft_emu: spi_device_queue_trans() with a full queue (%d)\n", handle->cfg.queue_size);
+        abort();
+    }
+    int idx = (handle->head + handle->count) % EMU_SPI_QUEUE;
+    handle->queue[idx] = trans_desc;
+    handle->hash[idx] = tx_hash(trans_desc);
+    handle->count++;
+    if ((uint32_t)handle->count > emu_spi_stats.max_queued) emu_spi_stats.max_queued = handle->count;
+    return ESP_OK;
+}
+
+//================================================================================================================
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans_desc, TickType_t ticks_to_wait) {
+    if (handle->count == 0) {
+        if (ticks_to_wait == 0) return ESP_ERR_TIMEOUT;
+        fprintf(stderr, "tft_emu: spi_device_get_trans_result() without queued transactions would block forever\n");
+        abort();
+    }
+    spi_transaction_t *t = handle->queue[handle->head];
+    if (tx_hash(t) != handle->hash[handle->head]) {
+        fprintf(stderr, "tft_emu: tx data of a queued transaction changed before it was sent\n");
+        abort();
+    }
+    spi_execute(handle, t, 0);
+    handle->head = (handle->head + 1) % EMU_SPI_QUEUE;
+    handle->count--;
+    *trans_desc = t;
+    return ESP_OK;
+}
+
+//=========================================================================================
+esp_err_t spi_device_polling_start(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    if (handle->count) {
+        fprintf(stderr, "tft_emu: polling transaction with %d queued transactions\n", handle->count);
+        abort();
+    }
+    spi_execute(handle, trans_desc, 1);
+    return ESP_OK;
+}
+
+//=====================================================================
+esp_err_t spi_device_polling_end(spi_device_handle_t handle, TickType_t ticks_to_wait) {
+    (void)handle;
+    (void)ticks_to_wait;
+    return ESP_OK;
+}
+
+//====================================================================================
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc) {
+    return spi_device_polling_start(handle, trans_desc, portMAX_DELAY);
+}
+
+//============================================================================
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc) {
+    spi_transaction_t *done;
+    esp_err_t ret = spi_device_queue_trans(handle, trans_desc, portMAX_DELAY);
+    if (ret != ESP_OK) return ret;
+    return spi_device_get_trans_result(handle, &done, portMAX_DELAY);
+}
+
+//======================================================================
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait) {
+    (void)wait;
+    // another task using the same device waits as well
+    while ((emu_bus_owner) && ((emu_bus_owner != device) || (emu_bus_task != emu_current))) {
+        emu_tasks[emu_current].state = EMU_BUS;
+        emu_task_switch(0);
+    }
+    emu_bus_owner = device;
+    emu_bus_task = emu_current;
+    return ESP_OK;
+}
+
+//=================================================
+void spi_device_release_bus(spi_device_handle_t dev) {
+    if (dev->count) {
+        fprintf(stderr, "tft_emu: spi_device_release_bus() with %d queued transactions\n", dev->count);
+        abort();
+    }
+    if (emu_bus_owner == dev) emu_bus_owner = NULL;
+    // a task waiting for the bus may have a higher priority
+    emu_task_switch(1);
+}
+
+// ==== Touch controller ====
+emu_touch_t emu_touch = { .pressed = 1, .x = 1000, .y = 3000 };
+
+// XPT2046 on the touch device: the control byte is followed by the 12-bit conversion,
+// MSB first, starting with the second byte
+//---------------------------------------------------------------------------
+static void emu_touch_transfer(const uint8_t *tx, uint8_t *rx, size_t len) {
+    uint16_t val = 0;
+
+    switch ((tx) ? tx[0] & 0xF0 : 0) {
+        case 0xB0: val = (emu_touch.pressed) ? 1200 : 0; break;    // Z1, pressure
+        case 0xD0: val = (emu_touch.pressed) ? emu_touch.x : 0; break;
+        case 0x90: val = (emu_touch.pressed) ? emu_touch.y : 0; break;
+    }
+    memset(rx, 0, len);
+    if (len >= 3) {
+        rx[1] = (val << 3) >> 8;
+        rx[2] = (val << 3) & 0xFF;
+    }
+}
+
+// tft.c calls the STMPE610 reader, which the component only declares (tftspi.h);
+// the emulated STMPE610 panel is never touched.
+//===============================================================
+int stmpe610_get_touch(uint16_t *x, uint16_t *y, uint16_t *z) {
+    (void)x;
+    (void)y;
+    (void)z;
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ *
+ * HOST EMULATOR, ESP-IDF STAND-INS
+ *
+ * spi_master, gpio, FreeRTOS and esp_timer functions used by the library.
+ * Tasks are coroutines on the virtual clock, see "Tasks" in emu_idf.c.
+ * Transactions are executed in order on the controller model (emu_panel.c),
+ * a virtual clock advances by the modelled bus time of every transaction.
+ *
+*/
+
+#ifndef _EMU_IDF_H_
+#define _EMU_IDF_H_
+
+#include <stdint.h>
+
+// ==== Bus timing model ========================================
+// Per transaction CPU/driver overhead on an ESP32 at 240 MHz, approximate values
+#define EMU_POLLING_OVERHEAD_NS  8000   // spi_device_polling_transmit()
+#define EMU_QUEUED_OVERHEAD_NS  12000   // spi_device_queue_trans() + interrupt + get_trans_result()
+
+// ==== Statistics ==============================================
+typedef struct {
+    uint64_t polling;           // polling transactions
+    uint64_t queued;            // queued transactions
+    uint64_t bytes;             // bytes sent and received, command and dummy phases included
+    uint64_t bus_ns;            // modelled bus time
+    uint64_t delay_ns;          // time waited in vTaskDelay(), free for other tasks on the ESP32
+    uint32_t max_queued;        // most transactions in a device queue at once
+    uint32_t unselected;        // transactions sent while the display CS was not active
+    uint32_t dc_writes;         // writes to the DC pin
+} emu_spi_stats_t;
+
+extern emu_spi_stats_t emu_spi_stats;
+
+// Highest read clock of the controller, reads with a faster clock return corrupted data
+extern uint32_t emu_max_read_clock;
+
+// XPT2046 touch controller on the touch device (tft_ts_spi), 12-bit raw values
+typedef struct {
+    uint8_t pressed;
+    uint16_t x;
+    uint16_t y;
+} emu_touch_t;
+
+extern emu_touch_t emu_touch;
+
+// Clear the statistics
+//=========================
+void emu_spi_stats_reset();
+
+// Virtual clock in ns
+//=========================
+uint64_t emu_clock_ns();
+
+#endif
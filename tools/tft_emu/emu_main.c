@@ -0,0 +1,1008 @@
+/*
+ *
+ * HOST EMULATOR, TEST SCENE
+ *
+ * Initializes the library as main/tft_demo.c does, draws a scene with the common
+ * drawing functions and reports the bus traffic of every step.
+ *
+ * Usage: tft_emu [-o frame.ppm] [-g gram.ppm] [-t trace] [-a] [-p] [-c] [-s] [-w] [-b] [-f] [-d] [-k] [-r read_clock_hz]
+ *   -o  write the visible display area to a PPM file
+ *   -g  write the whole GRAM in memory order to a PPM file
+ *   -t  record the transactions of the test scene, see tools/tft_trace
+ *   -a  asynchronous drawing (tft_async = 1)
+ *   -p  initialize and draw the first steps through the C++ panel layer (tft_panel.hpp)
+ *   -c  draw the test scene with a color transform (gamma 2.2, brightness 224)
+ *       and check that send_data() leaves the caller's buffer unchanged
+ *   -s  end the test scene with a text log in a hardware scroll area (portrait)
+ *   -w  sleep and resume after the test scene, check that the GRAM is kept, then partial mode,
+ *       check that waking from sleep after partial mode leaves it
+ *   -b  draw from a second task while the display is selected; read the touch controller while
+ *       the display is filled, without and with the bus scheduler
+ *   -f  draw the tft_demo screens directly, through the framebuffer, the band renderer and
+ *       the double framebuffer, compare the traffic; print the double framebuffer frame timings;
+ *       rotate while a framebuffer is active
+ *   -d  draw screens that are regenerated every cycle through the frame differ, compare the bytes sent
+ *   -k  draw a widget directly and into a canvas which is blitted, compare the traffic
+ *   -r  highest read clock of the emulated controller, default 10 MHz
+ *
+ * Exits with 1 when the controller model reported protocol errors, a screen drawn through
+ * a framebuffer differs from the one drawn directly or a second drawing task did not wait
+ * for the selected display.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tft.h"
+#include "tftspi.h"
+#include "freertos/task.h"
+#include "emu_panel.h"
+#include "emu_idf.h"
+#include "emu_cxx.h"
+
+// GRAM size of the controllers, in memory order
+//-----------------------------------------------------
+static emu_panel_config_t panel_config(uint8_t disp_type) {
+    emu_panel_config_t cfg = {
+        .gram_width = 240,
+        .gram_height = 320,
+        .glass_bgr = (TFT_RGB_BGR) ? 1 : 0,
+#ifdef TFT_START_COLORS_INVERTED
+        .glass_inverted = 1,
+#else
+        .glass_inverted = 0,
+#endif
+        .sleep_delay_ms = 5,
+    };
+
+    if (disp_type == DISP_TYPE_ILI9488) {
+        cfg.gram_width = 320;
+        cfg.gram_height = 480;
+    }
+    else if ((disp_type == DISP_TYPE_ST7735) || (disp_type == DISP_TYPE_ST7735R) || (disp_type == DISP_TYPE_ST7735B)) {
+        cfg.gram_width = 132;
+        cfg.gram_height = 162;
+        cfg.sleep_delay_ms = 120;
+    }
+    return cfg;
+}
+
+static uint64_t step_start_ns = 0;
+static int checks_failed = 0;           // checks of the tests which failed
+
+// Print the traffic since the last report and clear the statistics
+//--------------------------------
+static void report(const char *what) {
+    TFT_flush();
+    printf("%-22s trans=%6llu (polled %6llu) bytes=%8llu caset=%5u paset=%5u ramwr=%5u bus=%8.1f us time=%8.1f us\n",
+           what,
+           (unsigned long long)(emu_spi_stats.polling + emu_spi_stats.queued),
+           (unsigned long long)emu_spi_stats.polling,
+           (unsigned long long)emu_spi_stats.bytes,
+           emu_panel_stats.cmds[TFT_CASET], emu_panel_stats.cmds[TFT_PASET], emu_panel_stats.cmds[TFT_RAMWR],
+           emu_spi_stats.bus_ns / 1000.0,
+           (emu_clock_ns() - step_start_ns) / 1000.0);
+    emu_spi_stats_reset();
+    emu_panel_stats_reset();
+    step_start_ns = emu_clock_ns();
+}
+
+// 24-bit bmp image with a color pattern
+//---------------------------------------------------------
+static uint8_t *make_bmp(int w, int h, int *size) {
+    int row = (w * 3 + 3) & ~3;
+    uint8_t *bmp = calloc(1, 54 + (row * h));
+
+    *size = 54 + (row * h);
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    memcpy(&bmp[2], size, 4);
+    bmp[10] = 54;
+    bmp[14] = 40;
+    memcpy(&bmp[18], &w, 4);
+    memcpy(&bmp[22], &h, 4);
+    bmp[26] = 1;
+    bmp[28] = 24;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &bmp[54 + (y * row) + (x * 3)];
+            p[0] = x * 6;
+            p[1] = y * 8;
+            p[2] = (x ^ y) * 4;
+        }
+    }
+    return bmp;
+}
+
+// Read back a rectangle and compare it with the GRAM
+//---------------------------------------------
+static void read_back_test(const char *from) {
+    int w = 40, h = 20, bad = 0;
+    color_t *buf = malloc(w * h * sizeof(color_t));
+
+    int n = TFT_readRect(0, 0, w, h, buf);
+    for (int y = 0; (y < h) && (n > 0); y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *g = emu_panel_pixel(EMU_VIEW_SCREEN, tft_dispWin.x1 + x, tft_dispWin.y1 + y);
+            uint8_t *p = (uint8_t *)&buf[(y * w) + x];
+            for (int k = 0; k < 3; k++) {
+                uint8_t c = g[k] & 0xFC;
+                if (p[k] != (c | (c >> 6))) bad++;
+            }
+        }
+    }
+    printf("read back %d pixels from %s, %d wrong bytes\n", n, from, bad);
+    free(buf);
+}
+
+// Send a color gradient with send_data() and check that the buffer is unchanged
+//-----------------------------
+static void send_data_test() {
+    int w = 32, h = 24, changed = 0;
+    color_t *buf = malloc(w * h * sizeof(color_t));
+    color_t *copy = malloc(w * h * sizeof(color_t));
+
+    for (int n = 0; n < (w * h); n++) {
+        buf[n].r = (n % w) * 8;
+        buf[n].g = (n / w) * 10;
+        buf[n].b = 255 - ((n % w) * 8);
+    }
+    memcpy(copy, buf, w * h * sizeof(color_t));
+    send_data(tft_dispWin.x1 + 200, tft_dispWin.y1 + 60, tft_dispWin.x1 + 200 + w - 1, tft_dispWin.y1 + 60 + h - 1, w * h, buf);
+    for (int n = 0; n < (w * h); n++) {
+        if (memcmp(&buf[n], &copy[n], sizeof(color_t)) != 0) changed++;
+    }
+    printf("send_data %d pixels, %d colors of the caller's buffer changed\n", w * h, changed);
+    free(copy);
+    free(buf);
+}
+
+// Compare the screen with 'ref' (NULL: take it), returns the number of different pixels
+//------------------------------------------
+static int screen_compare(uint8_t **ref) {
+    int diff = 0;
+
+    if (*ref == NULL) *ref = malloc(tft_width * tft_height * 3);
+    for (int y = 0; y < tft_height; y++) {
+        for (int x = 0; x < tft_width; x++) {
+            uint8_t *p = emu_panel_pixel(EMU_VIEW_SCREEN, TFT_STATIC_X_OFFSET + x, TFT_STATIC_Y_OFFSET + y);
+            uint8_t *r = *ref + (((y * tft_width) + x) * 3);
+            if (memcmp(r, p, 3) != 0) diff++;
+            memcpy(r, p, 3);
+        }
+    }
+    return diff;
+}
+
+// Sleep and resume without a repaint, then show a strip in partial mode
+//-------------------------
+static void power_test() {
+    uint8_t *screen = NULL;
+
+    screen_compare(&screen);
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_SLEEP));
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    report("sleep 1 s");
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_ON));
+    report("resume");
+    printf("resumed in %u us, GRAM %s, %d pixels changed\n", tft_resume_us, (tft_gram_valid) ? "valid" : "lost", screen_compare(&screen));
+
+    // only the lines of the price strip are shown, it is updated in partial mode
+    ESP_ERROR_CHECK(TFT_setPartialArea(20, 59));
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_PARTIAL));
+    report("partial on");
+    TFT_fillRect(20, 20, 40, 40, TFT_PURPLE);
+    report("partial update");
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_ON));
+    report("partial off");
+
+    // partial mode survives sleep, waking to TFT_POWER_ON must leave it
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_PARTIAL));
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_SLEEP));
+    ESP_ERROR_CHECK(TFT_setPower(TFT_POWER_ON));
+    report("partial, sleep, on");
+    if (emu_panel_partial()) emu_panel_error("partial mode kept after waking to TFT_POWER_ON");
+    free(screen);
+}
+
+// Text log in a hardware scroll area between a fixed header and footer
+//--------------------------
+static void scroll_test() {
+    char line[32];
+
+    TFT_setRotation(PORTRAIT);
+    report("setRotation portrait");
+    TFT_fillRect(0, 0, tft_width, 16, TFT_NAVY);
+    TFT_fillRect(0, tft_height - 16, tft_width, 16, TFT_MAROON);
+    TFT_setScrollArea(16, tft_height - 17);
+    TFT_setclipwin(0, 16, tft_width - 1, tft_height - 17);
+    TFT_setFont(DEFAULT_FONT, NULL);
+    TFT_print("", 0, 0);
+    report("setScrollArea");
+    for (int i = 1; i <= 30; i++) {
+        sprintf(line, "log line %d\n", i);
+        TFT_print(line, 0, LASTY);
+    }
+    report("print log 30 lines");
+    TFT_print("log line 31\n", 0, LASTY);
+    report("print log 1 line");
+    TFT_resetclipwin();
+}
+
+// ==== Framebuffer ====
+// The screens of main/tft_demo.c, drawn directly, through the framebuffer, the band renderer
+// and the double framebuffer
+
+//---------------------------------------
+static void demo_header(const char *info) {
+    TFT_fillScreen(TFT_BLACK);
+    TFT_resetclipwin();
+    tft_fg = TFT_DARKCYAN;
+    tft_bg = TFT_BLACK;
+    TFT_setFont((tft_width < 240) ? DEF_SMALL_FONT : DEJAVU24_FONT, NULL);
+    int fh = TFT_getfontheight();
+    TFT_fillRect(0, 0, tft_width-1, fh+8, tft_bg);
+    TFT_drawRect(0, 0, tft_width-1, fh+8, TFT_BLACK);
+    TFT_fillRect(0, tft_height-fh-9, tft_width-1, fh+8, tft_bg);
+    TFT_drawRect(0, tft_height-fh-9, tft_width-1, fh+8, TFT_BLACK);
+    TFT_print((char *)info, CENTER, 4);
+    TFT_print("12:34:56", CENTER, tft_height-fh-5);
+    TFT_setclipwin(0, fh+9, tft_width-1, tft_height-fh-10);
+}
+
+// Start screen of tft_demo()
+//----------------------------
+static void demo_title_screen() {
+    demo_header("Currency track");
+    TFT_setFont(COMIC24_FONT, NULL);
+    int tempy = TFT_getfontheight() + 4;
+    tft_fg = TFT_ORANGE;
+    TFT_print("USD/BTC-MXN/EUR", CENTER, (tft_dispWin.y2-tft_dispWin.y1)/2 - tempy);
+    TFT_setFont(UBUNTU16_FONT, NULL);
+    tft_fg = TFT_CYAN;
+    TFT_print("******", CENTER, LASTY+tempy);
+    tempy = TFT_getfontheight() + 4;
+    TFT_setFont(DEFAULT_FONT, NULL);
+    tft_fg = TFT_GREEN;
+    TFT_print("Read speed: 10.00 MHz", CENTER, LASTY+tempy);
+}
+
+// Price of the currency screen, as currency_update() draws it
+//------------------------------------------------------
+static void demo_price(int i, const char *price) {
+    int win_w = tft_dispWin.x2 - tft_dispWin.x1 + 1;
+    int win_h = tft_dispWin.y2 - tft_dispWin.y1 + 1;
+    TFT_setFont(DEFAULT_FONT, NULL);
+    int label_h = TFT_getfontheight() + 2;
+    int seg_len = ((win_h / 2) - label_h - 15) / 2;
+    if (seg_len > ((win_w / 8) - 12)) seg_len = (win_w / 8) - 12;
+    if (seg_len > 23) seg_len = 23;
+    if (seg_len < 6) seg_len = 6;
+
+    color_t color = (i == 0) ? TFT_YELLOW : TFT_BLUE;
+    TFT_setFont(FONT_7SEG, NULL);
+    set_7seg_font_atrib(seg_len, 2, 1, color);
+    tft_fg = color;
+    TFT_fillRect(0, (i * (win_h / 2)) + label_h, win_w, (win_h / 2) - label_h, tft_bg);
+    TFT_print((char *)price, 0, (i * (win_h / 2)) + label_h);
+}
+
+// currency_screen() and currency_update() with the BTC price
+//----------------------------------------------------
+static void demo_currency_screen_price(const char *price) {
+    static const char *labels[2] = { "USD/BTC", "MXN/EUR" };
+    int win_h = tft_dispWin.y2 - tft_dispWin.y1 + 1;
+
+    demo_header("Currency track");
+    TFT_setFont(DEFAULT_FONT, NULL);
+    tft_fg = TFT_CYAN;
+    for (int i = 0; i < 2; i++) TFT_print((char *)labels[i], 0, i * (win_h / 2));
+    demo_price(0, price);
+    demo_price(1, "19.83");
+}
+
+// currency_screen() and the first currency_update()
+//-------------------------------
+static void demo_currency_screen() {
+    demo_currency_screen_price("43125.50");
+}
+
+// The clock in the footer
+//------------------------------------------
+static void demo_clock(const char *time) {
+    TFT_saveClipWin();
+    TFT_resetclipwin();
+    tft_fg = TFT_YELLOW;
+    tft_bg = (color_t){ 64, 64, 64 };
+    TFT_setFont((tft_width < 240) ? DEF_SMALL_FONT : DEJAVU24_FONT, NULL);
+    TFT_fillRect(1, tft_height-TFT_getfontheight()-8, tft_width-3, TFT_getfontheight()+6, tft_bg);
+    TFT_print((char *)time, CENTER, tft_height-TFT_getfontheight()-5);
+    tft_bg = TFT_BLACK;
+    TFT_restoreClipWin();
+}
+
+// A new BTC price and the clock in the footer
+//-------------------------------
+static void demo_currency_update() {
+    demo_price(0, "43127.25");
+    demo_clock("12:34:57");
+}
+
+#define FB_TEST_SCREENS 3
+#define FB_TEST_MODES 4
+#define FB_TEST_FRAMES 8
+
+typedef struct {
+    uint64_t trans;
+    uint64_t bytes;
+    uint64_t bus_ns;
+    uint64_t time_ns;
+} fb_test_traffic_t;
+
+//--------------------------------------------------------------------------
+static void fb_test_step(const char *what, fb_test_traffic_t *traffic) {
+    TFT_flush();
+    traffic->trans = emu_spi_stats.polling + emu_spi_stats.queued;
+    traffic->bytes = emu_spi_stats.bytes;
+    traffic->bus_ns = emu_spi_stats.bus_ns;
+    traffic->time_ns = emu_clock_ns() - step_start_ns;
+    report(what);
+}
+
+// Rotate while the framebuffer is active, the screen drawn in the new orientation
+// must be the same as drawn directly
+//------------------------------
+static void fb_rotate_test() {
+    uint8_t *ref = NULL;
+    int diff[FB_TEST_MODES] = {0};
+
+    for (int m = 0; m < FB_TEST_MODES; m++) {
+        if (m == 2) continue;
+        TFT_setRotation(LANDSCAPE_FLIP);
+        if (m == 1) ESP_ERROR_CHECK(TFT_fb_begin());
+        if (m == 3) ESP_ERROR_CHECK(TFT_fb_begin_double());
+        // the title screen is still in the framebuffer when the rotation changes
+        demo_title_screen();
+        TFT_setRotation(PORTRAIT);
+        demo_currency_screen();
+        TFT_flush();
+        diff[m] = screen_compare(&ref);
+        if (m == 1) read_back_test("the framebuffer after the rotation");
+        TFT_fb_end();
+        TFT_resetclipwin();
+    }
+    report("fb rotation");
+    printf("pixels differing from direct drawing after the rotation: fb %d, fb x2 %d\n", diff[1], diff[3]);
+    if (diff[1] || diff[3]) checks_failed++;
+    free(ref);
+}
+
+// Draw the demo screens directly, through the framebuffer, the band renderer and the double
+// framebuffer and compare the traffic and the screens
+//-----------------------
+static void fb_test() {
+    static const char *names[FB_TEST_SCREENS] = { "title", "currency", "price update" };
+    static const char *modes[FB_TEST_MODES] = { "direct", "fb", "band", "fb x2" };
+    void (*screens[FB_TEST_SCREENS])(void) = { demo_title_screen, demo_currency_screen, demo_currency_update };
+    fb_test_traffic_t traffic[FB_TEST_MODES][FB_TEST_SCREENS];
+    uint8_t *ref[FB_TEST_SCREENS] = {NULL};
+    int diff[FB_TEST_MODES] = {0};
+    char what[32];
+
+    TFT_setRotation(LANDSCAPE_FLIP);
+    report("setRotation flip");
+    memset(&tft_fb_stats, 0, sizeof(tft_fb_stats));
+    memset(&tft_band_stats, 0, sizeof(tft_band_stats));
+    for (int m = 0; m < FB_TEST_MODES; m++) {
+        if (m == 1) ESP_ERROR_CHECK(TFT_fb_begin());
+        if (m == 2) ESP_ERROR_CHECK(TFT_band_begin(0));
+        if (m == 3) ESP_ERROR_CHECK(TFT_fb_begin_double());
+        for (int i = 0; i < FB_TEST_SCREENS; i++) {
+            screens[i]();
+            sprintf(what, "%s demo %s", modes[m], names[i]);
+            fb_test_step(what, &traffic[m][i]);
+            diff[m] += screen_compare(&ref[i]);
+        }
+        if (m == 1) {
+            // reads are served from the framebuffer, no MISO needed
+            read_back_test("the framebuffer");
+            printf("framebuffer: %u rects, %u pixels sent, %u merges\n",
+                   tft_fb_stats.rects, tft_fb_stats.pixels, tft_fb_stats.merges);
+            TFT_fb_end();
+        }
+        if (m == 2) {
+            read_back_test("the band renderer");
+            printf("band renderer: %d rows, %u list flushes (%u full, %u bytes max), %u bands, %u rects, %u pixels sent\n",
+                   TFT_BAND_HEIGHT, tft_band_stats.flushes, tft_band_stats.list_full, tft_band_stats.list_max,
+                   tft_band_stats.bands, tft_band_stats.rects, tft_band_stats.pixels);
+            TFT_band_end();
+        }
+    }
+
+    // The dashboard is drawn again every frame, the flush task sends what changed
+    printf("double framebuffer, dashboard redrawn every frame:\n");
+    for (int n = 0; n < FB_TEST_FRAMES; n++) {
+        char price[16];
+        sprintf(price, "431%02d.%02d", 25 + (n / 3), (n * 25) % 100);
+        demo_currency_screen_price(price);
+        TFT_fb_swap();
+        printf("  frame %2u  draw=%7u us wait=%7u us diff=%5u us flush=%7u us  %u rects %6u pixels\n",
+               tft_fb_frame.frame, tft_fb_frame.draw_us, tft_fb_frame.wait_us, tft_fb_frame.diff_us,
+               tft_fb_frame.flush_us, tft_fb_frame.rects, tft_fb_frame.pixels);
+    }
+    report("fb x2 dashboard frames");
+    TFT_fb_end();
+    TFT_resetclipwin();
+
+    for (int i = 0; i < FB_TEST_SCREENS; i++) {
+        printf("  %-14s", names[i]);
+        for (int m = 0; m < FB_TEST_MODES; m++) {
+            printf(" %s trans=%5llu bytes=%6llu bus=%7.1f us%s", modes[m], (unsigned long long)traffic[m][i].trans,
+                   (unsigned long long)traffic[m][i].bytes, traffic[m][i].bus_ns / 1000.0, (m < (FB_TEST_MODES - 1)) ? " |" : "\n");
+        }
+        free(ref[i]);
+    }
+    printf("pixels differing from direct drawing: fb %d, band %d, fb x2 %d\n", diff[1], diff[2], diff[3]);
+    if (diff[1] || diff[2] || diff[3]) checks_failed++;
+    fb_rotate_test();
+}
+
+// ==== Frame differ ====
+// Screens which are drawn again in full every cycle, the traffic of the cycles after the first
+#define DIFF_TEST_FRAMES 10
+#define DIFF_TEST_COSTS 5
+#define DIFF_WIDGET_W 200
+#define DIFF_WIDGET_H 100
+#define DIFF_WIDGET_BARS 12
+
+// The dashboard as disp_header() based code draws it: cleared, then printed again
+//----------------------------------------
+static void diff_dashboard_frame(int n) {
+    char price[24], time[24];
+
+    snprintf(price, sizeof(price), "431%02d.%02d", 25 + (n / 4), (n * 25) % 100);
+    snprintf(time, sizeof(time), "12:34:%02d", n);
+    demo_currency_screen_price(price);
+    demo_clock(time);
+}
+
+// A bar graph rendered by the application into 'buf', a few bars change every frame
+//---------------------------------------------------------
+static void diff_widget_frame(uint8_t *buf, int n) {
+    uint8_t back[TFT_PIXEL_BYTES], grid[TFT_PIXEL_BYTES], bar[TFT_PIXEL_BYTES];
+    int bar_w = DIFF_WIDGET_W / DIFF_WIDGET_BARS;
+
+    TFT_pixel_pack(back, (color_t){ 16, 16, 32 });
+    TFT_pixel_pack(grid, (color_t){ 64, 64, 64 });
+    TFT_pixel_pack(bar, TFT_GREENYELLOW);
+    for (int y = 0; y < DIFF_WIDGET_H; y++) {
+        for (int x = 0; x < DIFF_WIDGET_W; x++) {
+            int i = x / bar_w;
+            // bar i moves every (i % 4 + 1)th frame
+            int level = 20 + ((i * 37 + (n / ((i % 4) + 1)) * 11) % (DIFF_WIDGET_H - 30));
+            const uint8_t *p = ((y % 20) == 0) ? grid : back;
+            if (((x % bar_w) > 1) && ((x % bar_w) < (bar_w - 2)) && (y >= (DIFF_WIDGET_H - level))) p = bar;
+            memcpy(buf + (((y * DIFF_WIDGET_W) + x) * TFT_PIXEL_BYTES), p, TFT_PIXEL_BYTES);
+        }
+    }
+}
+
+// Draw the frames of a screen, 'ref' holds the screens of the first run
+//-------------------------------------------------------------------------------------------------
+static int diff_test_run(int screen, int mode, uint8_t **ref, fb_test_traffic_t *traffic, uint8_t *buf, uint8_t *shadow) {
+    uint64_t start_ns = 0;
+    int diff = 0;
+
+    if (mode == 1) ESP_ERROR_CHECK(TFT_fb_begin());
+    if (mode == 2) ESP_ERROR_CHECK(TFT_fb_begin_double());
+    memset(shadow, 0, DIFF_WIDGET_W * DIFF_WIDGET_H * TFT_PIXEL_BYTES);
+    for (int n = 0; n <= DIFF_TEST_FRAMES; n++) {
+        if (screen == 0) diff_dashboard_frame(n);
+        else {
+            // in the middle of the display
+            int x = (tft_width - DIFF_WIDGET_W) / 2;
+            int y = (tft_height - DIFF_WIDGET_H) / 2;
+            diff_widget_frame(buf, n);
+            TFT_resetclipwin();
+            disp_select();
+            if (mode == 0) send_rect_pixels(tft_dispWin.x1 + x, tft_dispWin.y1 + y, DIFF_WIDGET_W, DIFF_WIDGET_H, buf, DIFF_WIDGET_W);
+            else TFT_diff_send(x, y, DIFF_WIDGET_W, DIFF_WIDGET_H, buf, shadow, DIFF_WIDGET_W);
+            disp_deselect();
+        }
+        TFT_flush();
+        if (n == 0) {
+            // the first frame is sent in full
+            emu_spi_stats_reset();
+            memset(&tft_diff_stats, 0, sizeof(tft_diff_stats));
+            start_ns = emu_clock_ns();
+        }
+        else diff += screen_compare(&ref[n - 1]);
+    }
+    traffic->trans = emu_spi_stats.polling + emu_spi_stats.queued;
+    traffic->bytes = emu_spi_stats.bytes;
+    traffic->bus_ns = emu_spi_stats.bus_ns;
+    traffic->time_ns = emu_clock_ns() - start_ns;
+    emu_spi_stats_reset();
+    if ((mode == 1) || (mode == 2)) TFT_fb_end();
+    return diff;
+}
+
+// Draw screens that are regenerated every cycle directly or in full, then through the differ,
+// the double framebuffer with several rectangle costs, and compare the bytes sent
+//-------------------------
+static void diff_test() {
+    static const char *names[2] = { "dashboard", "bar graph" };
+    static const char *base[2][2] = { { "direct", "fb" }, { "full send", NULL } };
+    static const int costs[DIFF_TEST_COSTS] = { 0, 32, 64, 128, 512 };
+    uint8_t *buf = malloc(DIFF_WIDGET_W * DIFF_WIDGET_H * TFT_PIXEL_BYTES);
+    uint8_t *shadow = malloc(DIFF_WIDGET_W * DIFF_WIDGET_H * TFT_PIXEL_BYTES);
+    int cost = tft_fb_rect_cost;
+
+    TFT_setRotation(LANDSCAPE_FLIP);
+    TFT_fillScreen(TFT_BLACK);
+    report("setRotation flip");
+    printf("frame differ, %d frames drawn again in full after the first one:\n", DIFF_TEST_FRAMES);
+    for (int screen = 0; screen < 2; screen++) {
+        uint8_t *ref[DIFF_TEST_FRAMES] = {NULL};
+        fb_test_traffic_t first, t;
+
+        // the screen drawn directly or sent in full is the reference of the others
+        diff_test_run(screen, 0, ref, &first, buf, shadow);
+        printf("  %-10s %-20s trans=%6llu bytes=%8llu bus=%9.1f us time=%9.1f us\n", names[screen], base[screen][0],
+               (unsigned long long)first.trans, (unsigned long long)first.bytes, first.bus_ns / 1000.0, first.time_ns / 1000.0);
+        if (base[screen][1]) {
+            int diff = diff_test_run(screen, 1, ref, &t, buf, shadow);
+            printf("  %-10s %-20s trans=%6llu bytes=%8llu bus=%9.1f us time=%9.1f us  %d pixels differ\n", names[screen], base[screen][1],
+                   (unsigned long long)t.trans, (unsigned long long)t.bytes, t.bus_ns / 1000.0, t.time_ns / 1000.0, diff);
+        }
+        // the rectangle cost only applies to the double framebuffer
+        for (int c = 0; c < ((screen == 0) ? DIFF_TEST_COSTS : 1); c++) {
+            char what[24];
+            tft_fb_rect_cost = costs[c];
+            int diff = diff_test_run(screen, (screen == 0) ? 2 : 3, ref, &t, buf, shadow);
+            if (screen == 0) snprintf(what, sizeof(what), "fb x2 cost %d", costs[c]);
+            else snprintf(what, sizeof(what), "TFT_diff_send");
+            printf("  %-10s %-20s trans=%6llu bytes=%8llu bus=%9.1f us time=%9.1f us  %u rows changed, %u spans, %u rects, %u pixels, %.1f%% of the bytes saved, %d pixels differ\n",
+                   names[screen], what, (unsigned long long)t.trans, (unsigned long long)t.bytes, t.bus_ns / 1000.0, t.time_ns / 1000.0,
+                   tft_diff_stats.rows_changed, tft_diff_stats.spans, tft_diff_stats.rects, tft_diff_stats.pixels,
+                   100.0 - ((100.0 * t.bytes) / first.bytes), diff);
+        }
+        for (int n = 0; n < DIFF_TEST_FRAMES; n++) free(ref[n]);
+    }
+    tft_fb_rect_cost = cost;
+    TFT_resetclipwin();
+    emu_panel_stats_reset();
+    step_start_ns = emu_clock_ns();
+    free(shadow);
+    free(buf);
+}
+
+// ==== Canvas ====
+// A gauge widget drawn directly to the display and composed in a canvas, then blitted
+#define CANVAS_TEST_FRAMES 8
+#define CANVAS_TEST_MODES 4
+#define CANVAS_WIDGET_W 160
+#define CANVAS_WIDGET_H 100
+
+// The widget at the origin of the display window, a new value every frame
+//--------------------------------------------------------------
+static void canvas_widget(int n, uint8_t *bmp, int bmp_size) {
+    color_t back = { 24, 24, 48 };
+    char value[16];
+
+    tft_bg = back;
+    TFT_fillRoundRect(0, 0, CANVAS_WIDGET_W, CANVAS_WIDGET_H, 8, back);
+    TFT_drawRoundRect(0, 0, CANVAS_WIDGET_W, CANVAS_WIDGET_H, 8, TFT_CYAN);
+    TFT_drawArc(50, 52, 40, 8, 0, 30 + ((n * 37) % 300), TFT_GREENYELLOW, TFT_GREENYELLOW);
+    TFT_fillCircle(50, 52, 6, TFT_WHITE);
+    TFT_setFont(DEJAVU18_FONT, NULL);
+    tft_fg = TFT_YELLOW;
+    sprintf(value, "%d.%d", 40 + ((n * 7) % 50), n);
+    TFT_print(value, 100, 24);
+    TFT_setFont(DEFAULT_FONT, NULL);
+    tft_fg = TFT_CYAN;
+    TFT_print("kW", 100, 50);
+    // image positions are not relative to the display window
+    TFT_bmp_image(tft_dispWin.x1 + CANVAS_WIDGET_W - 34, tft_dispWin.y1 + CANVAS_WIDGET_H - 26, 0, NULL, bmp, bmp_size);
+    tft_bg = TFT_BLACK;
+}
+
+// Draw the widget frames in one mode, 'ref' holds the screens of the direct drawing
+//-------------------------------------------------------------------------------------
+static int canvas_test_run(int mode, uint8_t **ref, fb_test_traffic_t *traffic, uint8_t *bmp, int bmp_size) {
+    int x = (tft_width - CANVAS_WIDGET_W) / 2;
+    int y = (tft_height - CANVAS_WIDGET_H) / 2;
+    TFT_canvas_t canvas, part, *c = &canvas;
+    uint8_t *shadow = NULL;
+    uint64_t start_ns = emu_clock_ns();
+    int diff = 0;
+
+    if (mode == 2) {
+        // a part of a larger canvas in memory the bus can't read, its rows are copied
+        ESP_ERROR_CHECK(TFT_canvas_create(&canvas, CANVAS_WIDGET_W + 16, CANVAS_WIDGET_H + 8));
+        part = canvas;
+        part.width = CANVAS_WIDGET_W;
+        part.height = CANVAS_WIDGET_H;
+        part.dma = 0;
+        part.pixels = canvas.pixels + (((4 * canvas.stride) + 8) * TFT_PIXEL_BYTES);
+        c = &part;
+    }
+    else if (mode != 0) ESP_ERROR_CHECK(TFT_canvas_create(&canvas, CANVAS_WIDGET_W, CANVAS_WIDGET_H));
+    if (mode == 3) shadow = calloc(CANVAS_WIDGET_W * CANVAS_WIDGET_H, TFT_PIXEL_BYTES);
+
+    emu_spi_stats_reset();
+    emu_panel_stats_reset();
+    for (int n = 0; n < CANVAS_TEST_FRAMES; n++) {
+        if (mode == 0) {
+            TFT_setclipwin(x, y, x + CANVAS_WIDGET_W - 1, y + CANVAS_WIDGET_H - 1);
+            canvas_widget(n, bmp, bmp_size);
+            TFT_resetclipwin();
+        }
+        else {
+            ESP_ERROR_CHECK(TFT_canvas_begin(c));
+            canvas_widget(n, bmp, bmp_size);
+            TFT_canvas_end();
+            if (mode == 3) {
+                disp_select();
+                TFT_diff_send(x, y, c->width, c->height, c->pixels, shadow, c->stride);
+                disp_deselect();
+            }
+            else ESP_ERROR_CHECK(TFT_blitCanvas(c, x, y));
+        }
+        TFT_flush();
+        diff += screen_compare(&ref[n]);
+    }
+    traffic->trans = emu_spi_stats.polling + emu_spi_stats.queued;
+    traffic->bytes = emu_spi_stats.bytes;
+    traffic->bus_ns = emu_spi_stats.bus_ns;
+    traffic->time_ns = emu_clock_ns() - start_ns;
+
+    if (mode == 1) {
+        // reads of a selected canvas are served from it
+        color_t *buf = malloc(CANVAS_WIDGET_W * CANVAS_WIDGET_H * sizeof(color_t));
+        int bad = 0;
+        ESP_ERROR_CHECK(TFT_canvas_begin(c));
+        int len = TFT_readRect(0, 0, CANVAS_WIDGET_W, CANVAS_WIDGET_H, buf);
+        TFT_canvas_end();
+        for (int i = 0; i < (CANVAS_WIDGET_W * CANVAS_WIDGET_H); i++) {
+            uint8_t *g = emu_panel_pixel(EMU_VIEW_SCREEN, tft_dispWin.x1 + x + (i % CANVAS_WIDGET_W), tft_dispWin.y1 + y + (i / CANVAS_WIDGET_W));
+            uint8_t *p = (uint8_t *)&buf[i];
+            for (int k = 0; k < 3; k++) {
+                uint8_t v = g[k] & 0xFC;
+                if (p[k] != (v | (v >> 6))) bad++;
+            }
+        }
+        printf("  read back %d pixels from the canvas, %d wrong bytes\n", len, bad);
+        free(buf);
+    }
+    if (mode != 0) TFT_canvas_delete(&canvas);
+    free(shadow);
+    return diff;
+}
+
+// Draw a widget directly and through a canvas and compare the traffic and the screens
+//-------------------------
+static void canvas_test() {
+    static const char *names[CANVAS_TEST_MODES] = { "direct", "canvas", "canvas part, copied", "canvas, TFT_diff_send" };
+    uint8_t *ref[CANVAS_TEST_FRAMES] = {NULL};
+    int bmp_size;
+    uint8_t *bmp = make_bmp(24, 16, &bmp_size);
+
+    TFT_resetclipwin();
+    TFT_fillScreen(TFT_BLACK);
+    report("fillScreen");
+    printf("canvas, a %dx%d widget drawn %d times:\n", CANVAS_WIDGET_W, CANVAS_WIDGET_H, CANVAS_TEST_FRAMES);
+    for (int mode = 0; mode < CANVAS_TEST_MODES; mode++) {
+        fb_test_traffic_t t;
+        char differ[32] = "";
+        // the screens drawn directly are the reference
+        int diff = canvas_test_run(mode, ref, &t, bmp, bmp_size);
+        if (mode != 0) sprintf(differ, "  %d pixels differ", diff);
+        printf("  %-22s trans=%6llu bytes=%8llu caset=%5u ramwr=%5u bus=%9.1f us time=%9.1f us%s\n", names[mode],
+               (unsigned long long)t.trans, (unsigned long long)t.bytes, emu_panel_stats.cmds[TFT_CASET], emu_panel_stats.cmds[TFT_RAMWR],
+               t.bus_ns / 1000.0, t.time_ns / 1000.0, differ);
+    }
+    for (int n = 0; n < CANVAS_TEST_FRAMES; n++) free(ref[n]);
+    free(bmp);
+    emu_spi_stats_reset();
+    emu_panel_stats_reset();
+    step_start_ns = emu_clock_ns();
+}
+
+// ==== Bus scheduler ====
+// A touch task (priority 5) reads the XPT2046 every 10 ms while the main task draws
+#define BUS_TEST_POLLS 30
+static volatile uint8_t bus_test_done = 0;
+static int bus_test_touched = 0;
+
+//----------------------------------
+static void touch_task(void *arg) {
+    (void)arg;
+    int x, y;
+
+    for (int i = 0; i < BUS_TEST_POLLS; i++) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+        if (TFT_read_touch(&x, &y, 1)) bus_test_touched++;
+    }
+    bus_test_done = 1;
+    vTaskDelete(NULL);
+}
+
+//---------------------------------------
+static void bus_test_run(const char *what) {
+    static const char *names[TFT_SCHED_CLIENTS] = { "display", "touch", "read" };
+    uint64_t start = emu_clock_ns();
+
+    tft_sched_stats_reset();
+    bus_test_done = 0;
+    bus_test_touched = 0;
+    xTaskCreate(touch_task, "touch", 2048, NULL, 5, NULL);
+    for (int i = 0; i < 4; i++) TFT_fillScreen((i & 1) ? TFT_NAVY : TFT_BLACK);
+    uint64_t draw_ns = emu_clock_ns() - start;
+    while (!bus_test_done) vTaskDelay(10 / portTICK_PERIOD_MS);
+
+    printf("%s: 4 x fillScreen in %.1f ms, %d of %d touch reads\n", what, draw_ns / 1000000.0, bus_test_touched, BUS_TEST_POLLS);
+    for (int i = 0; i < TFT_SCHED_CLIENTS; i++) {
+        tft_sched_stats_t *st = &tft_sched_stats[i];
+        printf("  %-8s acquires=%4u yields=%4u max wait=%6u us (%u over %u us) max hold=%6u us\n", names[i],
+               st->acquires, st->yields, st->max_wait_us, st->over_budget, tft_sched_config[i].budget_us, st->max_hold_us);
+    }
+}
+
+static volatile int select_test_done = 0;
+
+// Fills a rectangle over the pixels the main task draws with the display selected
+//---------------------------------------
+static void select_task(void *arg) {
+    (void)arg;
+    disp_select();
+    TFT_fillRect(0, 0, 32, 8, TFT_RED);
+    disp_deselect();
+    select_test_done = 1;
+    vTaskDelete(NULL);
+}
+
+// A task which draws while another one has the display selected waits until it is deselected,
+// its fill must not be overwritten by the coalesced pixels of the other task
+//----------------------------
+static void select_test() {
+    int early, wrong = 0;
+
+    TFT_resetclipwin();
+    select_test_done = 0;
+    disp_select();
+    for (int x = 0; x < 32; x++) drawPixel(tft_dispWin.x1 + x, tft_dispWin.y1 + 4, TFT_GREEN);
+    // the task has a higher priority and runs at once
+    xTaskCreate(select_task, "select", 2048, NULL, 5, NULL);
+    early = select_test_done;
+    disp_deselect();
+    while (!select_test_done) vTaskDelay(1);
+    TFT_flush();
+
+    // the pixels of the line are those of the fill, as in the line above
+    for (int x = 0; x < 32; x++) {
+        uint8_t *p = emu_panel_pixel(EMU_VIEW_SCREEN, tft_dispWin.x1 + x, tft_dispWin.y1 + 4);
+        uint8_t *r = emu_panel_pixel(EMU_VIEW_SCREEN, tft_dispWin.x1 + x, tft_dispWin.y1);
+        if (memcmp(p, r, 3) != 0) wrong++;
+    }
+    report("two drawing tasks");
+    printf("second task %s while the display was selected, %d pixels of its fill overwritten\n",
+           (early) ? "drew" : "waited", wrong);
+    if ((early) || (wrong)) checks_failed++;
+}
+
+// Touch reads while the display draws, without and with the scheduler
+//-----------------------
+static void bus_test() {
+    tft_sched_config_t config[TFT_SCHED_CLIENTS];
+
+    select_test();
+    if (tft_ts_spi == NULL) {
+        printf("bus test needs the XPT2046 touch controller (-DTFT_EMU_OPTIONS=CONFIG_TFT_TOUCH_CONTROLLER=1 with display type 0)\n");
+        return;
+    }
+    memcpy(config, tft_sched_config, sizeof(config));
+    for (int i = 0; i < TFT_SCHED_CLIENTS; i++) {
+        tft_sched_config[i].priority = 0;
+        tft_sched_config[i].slice_us = 0;
+    }
+    bus_test_run("scheduler off");
+    memcpy(tft_sched_config, config, sizeof(config));
+    bus_test_run("scheduler on");
+    emu_spi_stats_reset();
+    emu_panel_stats_reset();
+    step_start_ns = emu_clock_ns();
+}
+
+//==============================
+int main(int argc, char **argv) {
+    const char *frame_file = NULL, *gram_file = NULL, *trace_file = NULL;
+    uint8_t cxx = 0, transform = 0, scroll = 0, power = 0, bus = 0, framebuffer = 0, differ = 0, canvas = 0;
+    spi_device_handle_t spi;
+    esp_err_t ret;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-o") == 0) && ((i + 1) < argc)) frame_file = argv[++i];
+        else if ((strcmp(argv[i], "-g") == 0) && ((i + 1) < argc)) gram_file = argv[++i];
+        else if ((strcmp(argv[i], "-t") == 0) && ((i + 1) < argc)) trace_file = argv[++i];
+        else if ((strcmp(argv[i], "-r") == 0) && ((i + 1) < argc)) emu_max_read_clock = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-a") == 0) tft_async = 1;
+        else if (strcmp(argv[i], "-p") == 0) cxx = 1;
+        else if (strcmp(argv[i], "-c") == 0) transform = 1;
+        else if (strcmp(argv[i], "-s") == 0) scroll = 1;
+        else if (strcmp(argv[i], "-w") == 0) power = 1;
+        else if (strcmp(argv[i], "-b") == 0) bus = 1;
+        else if (strcmp(argv[i], "-f") == 0) framebuffer = 1;
+        else if (strcmp(argv[i], "-d") == 0) differ = 1;
+        else if (strcmp(argv[i], "-k") == 0) canvas = 1;
+        else {
+            fprintf(stderr, "usage: %s [-o frame.ppm] [-g gram.ppm] [-t trace] [-a] [-p] [-c] [-s] [-w] [-b] [-f] [-d] [-k] [-r read_clock_hz]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    emu_panel_config_t cfg = panel_config(tft_disp_type);
+    emu_panel_init(&cfg);
+    printf("controller %d, GRAM %dx%d, display %dx%d, spi clock %d Hz\n",
+           tft_disp_type, cfg.gram_width, cfg.gram_height, DEFAULT_TFT_DISPLAY_WIDTH, DEFAULT_TFT_DISPLAY_HEIGHT, DEFAULT_SPI_CLOCK);
+
+    // ==== Initialize the library as main/tft_demo.c does ====
+    TFT_PinsInit();
+
+    spi_bus_config_t buscfg = {
+        .miso_io_num = PIN_NUM_MISO,
+        .mosi_io_num = PIN_NUM_MOSI,
+        .sclk_io_num = PIN_NUM_CLK,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = 6*1024,
+    };
+    spi_device_interface_config_t devcfg = {
+        .mode = 0,
+        .clock_speed_hz = DEFAULT_SPI_CLOCK,
+        .spics_io_num = PIN_NUM_CS,
+        .flags = SPI_DEVICE_HALFDUPLEX,
+        .queue_size = TFT_SPI_QUEUE_SIZE,
+        .pre_cb = &TFT_transaction_begin_callback,
+    };
+    ret = spi_bus_initialize(CONFIG_TFT_SPI_HOST, &buscfg, 1);
+    ESP_ERROR_CHECK(ret);
+    ret = spi_bus_add_device(CONFIG_TFT_SPI_HOST, &devcfg, &spi);
+    ESP_ERROR_CHECK(ret);
+    tft_disp_spi = spi;
+#if USE_TOUCH == TOUCH_TYPE_XPT2046
+    spi_device_interface_config_t tsdevcfg = {
+        .mode = 0,
+        .clock_speed_hz = 2500000,
+        .spics_io_num = PIN_NUM_TCS,
+        .queue_size = 1,
+    };
+    ret = spi_bus_add_device(CONFIG_TFT_SPI_HOST, &tsdevcfg, &tft_ts_spi);
+    ESP_ERROR_CHECK(ret);
+#endif
+
+    // the init task runs when it is created, the delays in it are free for boot work on the ESP32
+    if (cxx) emu_cxx_init();
+    else {
+        ESP_ERROR_CHECK(TFT_display_init_start(NULL));
+        ESP_ERROR_CHECK(TFT_display_wait_ready(portMAX_DELAY));
+    }
+    uint64_t init_delay_ns = emu_spi_stats.delay_ns;
+#ifdef TFT_START_COLORS_INVERTED
+    TFT_invertDisplay(1);
+#endif
+    tft_font_rotate = 0;
+    tft_text_wrap = 0;
+    tft_font_transparent = 0;
+    tft_font_forceFixed = 0;
+    tft_gray_scale = 0;
+    TFT_resetclipwin();
+    printf("display ready %lld us after start, %.1f ms of it in delays\n",
+           (long long)tft_ready_time, init_delay_ns / 1000000.0);
+    report("init");
+    printf("fills up to %u pixels are sent polled\n", (unsigned int)tft_short_run_len);
+
+    uint8_t can_read = 0;
+    ret = TFT_read_device_init(CONFIG_TFT_SPI_HOST, tft_max_rdclock);
+    if (ret == ESP_OK) {
+        can_read = (find_rd_speed() != 0);
+        report("find_rd_speed");
+        printf("display read speed %u Hz\n", tft_max_rdclock);
+    }
+
+    // ==== Test scene ====
+    if (transform) {
+        TFT_color_transform_t t = { .gamma = 2.2f, .brightness = 224 };
+        ESP_ERROR_CHECK(TFT_setColorTransform(&t));
+    }
+    if (trace_file) ESP_ERROR_CHECK(TFT_trace_start(1 << 20));
+    if (cxx) emu_cxx_landscape();
+    else TFT_setRotation(LANDSCAPE);
+    report("setRotation");
+    if (cxx) emu_cxx_fill_rect(0, 0, tft_width, tft_height, TFT_BLACK);
+    else TFT_fillScreen(TFT_BLACK);
+    report("fillScreen");
+    if (cxx) emu_cxx_fill_rect(10, 10, 60, 40, TFT_NAVY);
+    else TFT_fillRect(10, 10, 60, 40, TFT_NAVY);
+    report("fillRect 60x40");
+    TFT_fillCircle(60, 60, 30, TFT_RED);
+    report("fillCircle r30");
+    TFT_drawCircle(60, 60, 40, TFT_GREEN);
+    report("drawCircle r40");
+    TFT_fillTriangle(10, 10, 100, 30, 50, 100, TFT_BLUE);
+    report("fillTriangle");
+    TFT_drawLine(0, 0, 200, 100, TFT_WHITE);
+    report("drawLine");
+    TFT_drawRoundRect(5, 5, 100, 50, 8, TFT_YELLOW);
+    report("drawRoundRect");
+    TFT_drawArc(120, 60, 40, 6, 0, 120, TFT_ORANGE, TFT_ORANGE);
+    report("drawArc");
+    TFT_drawEllipse(100, 90, 40, 20, TFT_CYAN, 15);
+    report("drawEllipse 40x20");
+    TFT_setFont(DEJAVU18_FONT, NULL);
+    TFT_print("Hello 123", 10, 80);
+    report("print dejavu18");
+    tft_font_transparent = 1;
+    TFT_print("Transp", 120, 100);
+    tft_font_transparent = 0;
+    report("print transparent");
+    tft_font_rotate = 30;
+    TFT_print("Rot", 20, 100);
+    tft_font_rotate = 0;
+    report("print rotated");
+    TFT_setFont(FONT_7SEG, NULL);
+    set_7seg_font_atrib(12, 2, 1, TFT_DARKGREY);
+    TFT_print("12:34", 0, 20);
+    report("print 7seg");
+    {
+        int size;
+        uint8_t *bmp = make_bmp(40, 30, &size);
+        // image positions are not relative to the display window
+        TFT_bmp_image(tft_dispWin.x1 + 140, tft_dispWin.y1 + 10, 0, NULL, bmp, size);
+        free(bmp);
+        report("bmp 40x30");
+    }
+    if (transform) {
+        send_data_test();
+        report("send_data 32x24");
+    }
+    if (power) power_test();
+    if (scroll) scroll_test();
+    if (bus) bus_test();
+    if (framebuffer) fb_test();
+    if (differ) diff_test();
+    if (canvas) canvas_test();
+    if (can_read) {
+        char from[40];
+        sprintf(from, "the display at %u Hz", tft_max_rdclock);
+        read_back_test(from);
+        report("readRect 40x20");
+    }
+
+    if (trace_file) {
+        TFT_trace_stop();
+        if (TFT_trace_save(trace_file) != ESP_OK) {
+            fprintf(stderr, "can't write %s\n", trace_file);
+            return 1;
+        }
+        printf("%u transactions recorded\n", TFT_trace_count());
+    }
+    if (emu_panel_stats.errors) printf("%u controller protocol errors\n", emu_panel_stats.errors);
+    if (frame_file) {
+        int w, h;
+        emu_panel_logical_size(&w, &h);
+        if (emu_panel_dump_ppm(frame_file, EMU_VIEW_SCREEN, TFT_STATIC_X_OFFSET, TFT_STATIC_Y_OFFSET, tft_width, tft_height) != 0) {
+            fprintf(stderr, "can't write %s\n", frame_file);
+            return 1;
+        }
+    }
+    if (gram_file) {
+        int w = cfg.gram_width, h = cfg.gram_height;
+        if (emu_panel_dump_ppm(gram_file, EMU_VIEW_GRAM, 0, 0, w, h) != 0) {
+            fprintf(stderr, "can't write %s\n", gram_file);
+            return 1;
+        }
+    }
+    return ((emu_panel_stats.errors) || (checks_failed)) ? 1 : 0;
+}
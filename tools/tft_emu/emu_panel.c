@@ -0,0 +1,504 @@
+/*
+ *
+ * HOST EMULATOR, DISPLAY CONTROLLER MODEL
+ *
+ * The part of the MIPI DCS command set used by the library:
+ * CASET, PASET, RAMWR, RAMRD, MADCTL, COLMOD, INVON/INVOFF, DISPON/DISPOFF, SLPIN/SLPOUT, SWRESET,
+ * VSCRDEF/VSCRSADD (vertical scrolling), PTLAR/PTLON/NORON (partial mode).
+ * The waiting times after SLPIN and SLPOUT are checked.
+ * Other commands (power, gamma, frame rate ...) are counted, their parameters are ignored.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "emu_panel.h"
+#include "emu_idf.h"
+
+#define CMD_SWRESET 0x01
+#define CMD_SLPIN   0x10
+#define CMD_SLPOUT  0x11
+#define CMD_PTLON   0x12
+#define CMD_NORON   0x13
+#define CMD_INVOFF  0x20
+#define CMD_INVON   0x21
+#define CMD_DISPOFF 0x28
+#define CMD_DISPON  0x29
+#define CMD_CASET   0x2A
+#define CMD_PASET   0x2B
+#define CMD_RAMWR   0x2C
+#define CMD_RAMRD   0x2E
+#define CMD_PTLAR   0x30
+#define CMD_VSCRDEF 0x33
+#define CMD_MADCTL  0x36
+#define CMD_VSCRSADD 0x37
+#define CMD_COLMOD  0x3A
+#define CMD_RAMWRC  0x3C
+#define CMD_RAMRDC  0x3E
+
+#define MADCTL_MY   0x80
+#define MADCTL_MX   0x40
+#define MADCTL_MV   0x20
+#define MADCTL_BGR  0x08
+
+emu_panel_stats_t emu_panel_stats = {0};
+
+typedef struct {
+    emu_panel_config_t cfg;
+    uint8_t *gram;          // cfg.gram_width * cfg.gram_height pixels, 3 bytes each
+
+    // registers
+    uint8_t madctl;
+    uint8_t bytes_per_pixel; // 2 (COLMOD 0x55) or 3 (COLMOD 0x66)
+    uint8_t inverted;
+    uint8_t display_on;
+    uint8_t sleeping;
+    uint16_t xs, xe, ys, ye;
+    uint16_t tfa, vsa, bfa; // vertical scrolling: top fixed, scroll and bottom fixed area, in GRAM rows
+    uint16_t vsp;           // GRAM row shown at the first line of the scroll area
+    uint8_t scrolling;      // vertical scroll mode, entered with VSCRSADD, left with NORON or PTLON
+    uint8_t partial;        // partial mode, only the gate lines sr ~ er are shown
+    uint16_t sr, er;
+    uint64_t slpin_ns;      // emulator time of the last SLPIN and SLPOUT
+    uint64_t slpout_ns;
+
+    // command decoding
+    int cmd;                // current command, -1 if none
+    uint32_t nparam;        // parameter bytes received for it
+    uint8_t param[6];
+
+    // memory access
+    int col, row;           // address counter, logical coordinates
+    uint8_t pixel[3];       // bytes of the pixel being received
+    uint8_t npixel;
+    uint8_t reading;        // a read command is running, terminated by CS release
+    uint64_t read_pos;      // bits clocked out for the read command
+    uint64_t read_gen;      // bytes generated for the read command
+    uint8_t read_last;      // last generated byte
+    uint8_t read_pixel[3];  // pixel being sent
+} emu_panel_t;
+
+static emu_panel_t panel = {0};
+
+//==========================================
+void emu_panel_error(const char *fmt, ...) {
+    va_list ap;
+
+    emu_panel_stats.errors++;
+    fprintf(stderr, "tft_emu: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+//=============================
+void emu_panel_stats_reset() {
+    memset(&emu_panel_stats, 0, sizeof(emu_panel_stats));
+}
+
+// Register values after reset
+//-----------------------------
+static void panel_defaults() {
+    panel.madctl = 0;
+    panel.bytes_per_pixel = 3;
+    panel.inverted = 0;
+    panel.display_on = 0;
+    panel.sleeping = 1;
+    panel.xs = 0;
+    panel.xe = panel.cfg.gram_width - 1;
+    panel.ys = 0;
+    panel.ye = panel.cfg.gram_height - 1;
+    panel.tfa = 0;
+    panel.vsa = panel.cfg.gram_height;
+    panel.bfa = 0;
+    panel.vsp = 0;
+    panel.scrolling = 0;
+    panel.partial = 0;
+    panel.sr = 0;
+    panel.er = panel.cfg.gram_height - 1;
+    panel.slpin_ns = 0;
+    panel.slpout_ns = 0;
+    panel.cmd = -1;
+    panel.reading = 0;
+}
+
+//=================================================
+void emu_panel_init(const emu_panel_config_t *config) {
+    panel.cfg = *config;
+    free(panel.gram);
+    panel.gram = calloc((size_t)config->gram_width * config->gram_height, 3);
+    if (panel.gram == NULL) {
+        fprintf(stderr, "tft_emu: no memory for the GRAM\n");
+        exit(1);
+    }
+    panel_defaults();
+}
+
+// The GRAM keeps its contents over a reset
+//======================
+void emu_panel_reset() {
+    panel_defaults();
+}
+
+//===============================================
+void emu_panel_logical_size(int *width, int *height) {
+    uint8_t mv = panel.madctl & MADCTL_MV;
+    *width = (mv) ? panel.cfg.gram_height : panel.cfg.gram_width;
+    *height = (mv) ? panel.cfg.gram_width : panel.cfg.gram_height;
+}
+
+//=======================
+int emu_panel_partial() {
+    return panel.partial;
+}
+
+// GRAM position (x,y) of the logical position (col,row) with the current MADCTL, 0 if outside
+//----------------------------------------------------------------
+static int logical_to_gram(int col, int row, int *x, int *y) {
+    int w, h;
+
+    emu_panel_logical_size(&w, &h);
+    if ((col < 0) || (row < 0) || (col >= w) || (row >= h)) return 0;
+    if (panel.madctl & MADCTL_MX) col = w - 1 - col;
+    if (panel.madctl & MADCTL_MY) row = h - 1 - row;
+    *x = (panel.madctl & MADCTL_MV) ? row : col;
+    *y = (panel.madctl & MADCTL_MV) ? col : row;
+    return 1;
+}
+
+// GRAM pixel at logical position (col,row) with the current MADCTL, NULL if outside
+//---------------------------------------------------
+static uint8_t *logical_pixel(int col, int row) {
+    int x, y;
+
+    if (!logical_to_gram(col, row, &x, &y)) return NULL;
+    return &panel.gram[((y * panel.cfg.gram_width) + x) * 3];
+}
+
+// GRAM row shown on the gate line 'line' with the current scroll position
+//-----------------------------------
+static int shown_row(int line) {
+    if ((!panel.scrolling) || (line < panel.tfa) || (line >= (panel.tfa + panel.vsa)) || (panel.vsa == 0)) return line;
+    return panel.tfa + (((panel.vsp - panel.tfa) + (line - panel.tfa)) % panel.vsa);
+}
+
+//=============================================================
+uint8_t *emu_panel_pixel(int view, int x, int y) {
+    if (view == EMU_VIEW_LOGICAL) return logical_pixel(x, y);
+    if (view == EMU_VIEW_SCREEN) {
+        int gx, gy;
+        if (!logical_to_gram(x, y, &gx, &gy)) return NULL;
+        return &panel.gram[((shown_row(gy) * panel.cfg.gram_width) + gx) * 3];
+    }
+    if ((x < 0) || (y < 0) || (x >= panel.cfg.gram_width) || (y >= panel.cfg.gram_height)) return NULL;
+    return &panel.gram[((y * panel.cfg.gram_width) + x) * 3];
+}
+
+// Advance the address counter inside the window, wraps around at the end
+//-----------------------------
+static void address_next() {
+    if (++panel.col > panel.xe) {
+        panel.col = panel.xs;
+        if (++panel.row > panel.ye) panel.row = panel.ys;
+    }
+}
+
+// Store a received pixel, 16-bit pixels are expanded to the 18-bit GRAM format
+//----------------------------
+static void pixel_store() {
+    uint8_t *p = logical_pixel(panel.col, panel.row);
+
+    if (p == NULL) emu_panel_stats.pixels_clipped++;
+    else {
+        if (panel.bytes_per_pixel == 2) {
+            uint16_t v = (panel.pixel[0] << 8) | panel.pixel[1];
+            p[0] = (v >> 8) & 0xF8;
+            p[1] = (v >> 3) & 0xFC;
+            p[2] = (v << 3) & 0xF8;
+        }
+        else memcpy(p, panel.pixel, 3);
+        emu_panel_stats.pixels_written++;
+    }
+    address_next();
+}
+
+// The gate line at logical position (col,row) is driven, in partial mode only the partial area is
+//------------------------------------------
+static int line_shown(int col, int row) {
+    int gx, gy;
+
+    if (!panel.partial) return 1;
+    if (!logical_to_gram(col, row, &gx, &gy)) return 0;
+    if (panel.sr <= panel.er) return (gy >= panel.sr) && (gy <= panel.er);
+    // the area wraps around the end of the GRAM
+    return (gy >= panel.sr) || (gy <= panel.er);
+}
+
+// Check the waiting time after SLPIN and SLPOUT before a command
+//---------------------------------------
+static void sleep_timing(uint8_t cmd) {
+    uint64_t now = emu_clock_ns();
+    uint64_t wait_ns = (uint64_t)panel.cfg.sleep_delay_ms * 1000000;
+
+    if ((panel.slpout_ns) && ((now - panel.slpout_ns) < wait_ns)) {
+        emu_panel_error("command 0x%02x %llu us after SLPOUT", cmd, (unsigned long long)((now - panel.slpout_ns) / 1000));
+    }
+    else if ((panel.slpin_ns) && (cmd == CMD_SLPOUT) && ((now - panel.slpin_ns) < wait_ns)) {
+        emu_panel_error("SLPOUT %llu us after SLPIN", (unsigned long long)((now - panel.slpin_ns) / 1000));
+    }
+    if ((cmd == CMD_SLPIN) && (panel.slpout_ns) && ((now - panel.slpout_ns) < 120000000ULL)) {
+        emu_panel_error("SLPIN %llu us after SLPOUT", (unsigned long long)((now - panel.slpout_ns) / 1000));
+    }
+}
+
+// Command byte received
+//----------------------------------
+static void command(uint8_t cmd) {
+    emu_panel_stats.cmds[cmd]++;
+    sleep_timing(cmd);
+    panel.cmd = cmd;
+    panel.nparam = 0;
+    panel.npixel = 0;
+    panel.reading = 0;
+
+    switch (cmd) {
+        case CMD_SWRESET:
+            panel_defaults();
+            break;
+        case CMD_SLPIN:
+            panel.sleeping = 1;
+            panel.slpin_ns = emu_clock_ns();
+            break;
+        case CMD_SLPOUT:
+            panel.sleeping = 0;
+            panel.slpout_ns = emu_clock_ns();
+            break;
+        case CMD_PTLON:
+            panel.partial = 1;
+            panel.scrolling = 0;
+            break;
+        case CMD_NORON:
+            panel.partial = 0;
+            panel.scrolling = 0;
+            break;
+        case CMD_INVOFF:
+            panel.inverted = 0;
+            break;
+        case CMD_INVON:
+            panel.inverted = 1;
+            break;
+        case CMD_DISPOFF:
+            panel.display_on = 0;
+            break;
+        case CMD_DISPON:
+            panel.display_on = 1;
+            break;
+        case CMD_RAMWR:
+        case CMD_RAMRD:
+            // memory access starts at the window start
+            panel.col = panel.xs;
+            panel.row = panel.ys;
+            // fall through
+        case CMD_RAMRDC:
+            if (cmd != CMD_RAMWR) {
+                panel.reading = 1;
+                panel.read_pos = 0;
+                panel.read_gen = 0;
+            }
+            break;
+    }
+}
+
+// Parameter or pixel byte received
+//-------------------------------
+static void data(uint8_t b) {
+    switch (panel.cmd) {
+        case CMD_CASET:
+        case CMD_PASET:
+            if (panel.nparam < 4) panel.param[panel.nparam] = b;
+            if (++panel.nparam == 4) {
+                uint16_t s = (panel.param[0] << 8) | panel.param[1];
+                uint16_t e = (panel.param[2] << 8) | panel.param[3];
+                if (s > e) emu_panel_error("%s start %u > end %u", (panel.cmd == CMD_CASET) ? "CASET" : "PASET", s, e);
+                if (panel.cmd == CMD_CASET) {
+                    panel.xs = s;
+                    panel.xe = e;
+                }
+                else {
+                    panel.ys = s;
+                    panel.ye = e;
+                }
+            }
+            break;
+        case CMD_MADCTL:
+            if (panel.nparam++ == 0) panel.madctl = b;
+            break;
+        case CMD_VSCRDEF:
+            if (panel.nparam < 6) panel.param[panel.nparam] = b;
+            if (++panel.nparam == 6) {
+                uint16_t tfa = (panel.param[0] << 8) | panel.param[1];
+                uint16_t vsa = (panel.param[2] << 8) | panel.param[3];
+                uint16_t bfa = (panel.param[4] << 8) | panel.param[5];
+                if ((tfa + vsa + bfa) != panel.cfg.gram_height) {
+                    emu_panel_error("VSCRDEF %u + %u + %u is not %d lines", tfa, vsa, bfa, panel.cfg.gram_height);
+                }
+                else {
+                    panel.tfa = tfa;
+                    panel.vsa = vsa;
+                    panel.bfa = bfa;
+                }
+            }
+            break;
+        case CMD_VSCRSADD:
+            if (panel.nparam < 2) panel.param[panel.nparam] = b;
+            if (++panel.nparam == 2) {
+                uint16_t vsp = (panel.param[0] << 8) | panel.param[1];
+                if ((vsp < panel.tfa) || (vsp >= (panel.tfa + panel.vsa))) {
+                    emu_panel_error("VSCRSADD %u outside of the scroll area %u ~ %u", vsp, panel.tfa, panel.tfa + panel.vsa - 1);
+                }
+                else {
+                    panel.vsp = vsp;
+                    panel.scrolling = 1;
+                }
+            }
+            break;
+        case CMD_PTLAR:
+            if (panel.nparam < 4) panel.param[panel.nparam] = b;
+            if (++panel.nparam == 4) {
+                uint16_t sr = (panel.param[0] << 8) | panel.param[1];
+                uint16_t er = (panel.param[2] << 8) | panel.param[3];
+                if ((sr >= panel.cfg.gram_height) || (er >= panel.cfg.gram_height)) {
+                    emu_panel_error("PTLAR %u ~ %u outside of the GRAM", sr, er);
+                }
+                else {
+                    panel.sr = sr;
+                    panel.er = er;
+                }
+            }
+            break;
+        case CMD_COLMOD:
+            if (panel.nparam++ == 0) panel.bytes_per_pixel = ((b & 7) == 5) ? 2 : 3;
+            break;
+        case CMD_RAMWR:
+        case CMD_RAMWRC:
+            panel.pixel[panel.npixel++] = b;
+            if (panel.npixel == panel.bytes_per_pixel) {
+                panel.npixel = 0;
+                pixel_store();
+            }
+            break;
+        case -1:
+            emu_panel_error("data byte 0x%02x without a command", b);
+            break;
+        default:
+            panel.nparam++;
+            break;
+    }
+}
+
+//=====================================================================
+void emu_panel_write(uint8_t dc, const uint8_t *data_buf, size_t len) {
+    if (dc) emu_panel_stats.data_bytes += len;
+    else emu_panel_stats.cmd_bytes += len;
+
+    for (size_t i = 0; i < len; i++) {
+        if (dc) data(data_buf[i]);
+        else command(data_buf[i]);
+    }
+}
+
+// Next byte sent by the controller for the running read command
+// The first byte is a dummy byte, then 3 bytes per pixel, 6 significant bits each
+//-------------------------------
+static uint8_t read_stream_next() {
+    uint64_t n = panel.read_gen++;
+    uint8_t b = 0;
+
+    if ((n > 0) && ((panel.cmd == CMD_RAMRD) || (panel.cmd == CMD_RAMRDC))) {
+        uint32_t k = (n - 1) % 3;
+        if (k == 0) {
+            uint8_t *p = logical_pixel(panel.col, panel.row);
+            if (p == NULL) {
+                memset(panel.read_pixel, 0, 3);
+                emu_panel_stats.pixels_clipped++;
+            }
+            else {
+                for (int i = 0; i < 3; i++) panel.read_pixel[i] = p[i] & 0xFC;
+                emu_panel_stats.pixels_read++;
+            }
+            address_next();
+        }
+        b = panel.read_pixel[k];
+    }
+    panel.read_last = b;
+    return b;
+}
+
+//=======================================================================
+void emu_panel_read(uint32_t skip_bits, uint8_t *dst, size_t len) {
+    uint64_t bit = panel.read_pos + skip_bits;
+    uint64_t first = bit / 8;
+    uint32_t shift = bit % 8;
+    uint8_t cur;
+
+    if (!panel.reading) {
+        // nothing drives the line
+        memset(dst, 0, len);
+        return;
+    }
+    if (len == 0) return;
+
+    // the controller sends every byte, skipped ones too
+    while (panel.read_gen < first) read_stream_next();
+    // the first byte may be partially clocked out already
+    cur = (panel.read_gen > first) ? panel.read_last : read_stream_next();
+
+    for (size_t i = 0; i < len; i++) {
+        if (shift == 0) {
+            dst[i] = cur;
+            if ((i + 1) < len) cur = read_stream_next();
+        }
+        else {
+            uint8_t next = read_stream_next();
+            dst[i] = (uint8_t)((cur << shift) | (next >> (8 - shift)));
+            cur = next;
+        }
+    }
+    panel.read_pos = bit + (8 * len);
+}
+
+//==========================
+void emu_panel_deselect() {
+    panel.reading = 0;
+}
+
+//=============================================================================
+int emu_panel_dump_ppm(const char *path, int view, int x, int y, int w, int h) {
+    FILE *f = fopen(path, "wb");
+    uint8_t invert = panel.inverted ^ panel.cfg.glass_inverted;
+    uint8_t swap = ((panel.madctl & MADCTL_BGR) ? 1 : 0) ^ panel.cfg.glass_bgr;
+    uint8_t visible = (panel.display_on) && (!panel.sleeping);
+
+    if (f == NULL) return -1;
+    fprintf(f, "P6\n%d %d\n255\n", w, h);
+    for (int row = y; row < (y + h); row++) {
+        for (int col = x; col < (x + w); col++) {
+            uint8_t rgb[3] = {0, 0, 0};
+            uint8_t *p = emu_panel_pixel(view, col, row);
+            if ((view == EMU_VIEW_SCREEN) && (!line_shown(col, row))) p = NULL;
+            if ((p) && (visible)) {
+                rgb[0] = p[(swap) ? 2 : 0];
+                rgb[1] = p[1];
+                rgb[2] = p[(swap) ? 0 : 2];
+                if (invert) {
+                    for (int i = 0; i < 3; i++) rgb[i] = ~rgb[i];
+                }
+            }
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    return (fclose(f) == 0) ? 0 : -1;
+}
@@ -0,0 +1,89 @@
+/*
+ *
+ * HOST EMULATOR, DISPLAY CONTROLLER MODEL
+ *
+ * Interprets the byte stream the library sends to ILI9341, ILI9488, ST7789V and ST7735
+ * controllers and keeps the display RAM (GRAM) contents.
+ *
+*/
+
+#ifndef _EMU_PANEL_H_
+#define _EMU_PANEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==== Panel description =======================================
+typedef struct {
+    int gram_width;         // GRAM columns in memory order (MADCTL = 0)
+    int gram_height;        // GRAM rows in memory order
+    uint8_t glass_bgr;      // the glass has BGR sub pixels, colors look right with MADCTL BGR bit set
+    uint8_t glass_inverted; // the glass inverts colors (IPS panels), colors look right after INVON
+    uint32_t sleep_delay_ms;// time the controller needs after SLPIN / SLPOUT before the next command
+} emu_panel_config_t;
+
+// ==== Statistics ==============================================
+typedef struct {
+    uint32_t cmds[256];         // number of times each command was received
+    uint64_t cmd_bytes;         // bytes received with DC low
+    uint64_t data_bytes;        // bytes received with DC high
+    uint64_t pixels_written;    // pixels written to the GRAM
+    uint64_t pixels_read;       // pixels read from the GRAM
+    uint64_t pixels_clipped;    // pixels written or read outside of the GRAM
+    uint32_t errors;            // protocol errors, see emu_panel_error()
+} emu_panel_stats_t;
+
+extern emu_panel_stats_t emu_panel_stats;
+
+// Views for emu_panel_dump_ppm()
+#define EMU_VIEW_LOGICAL 0      // coordinates as addressed with the current MADCTL
+#define EMU_VIEW_GRAM    1      // GRAM in memory order
+#define EMU_VIEW_SCREEN  2      // logical coordinates as the glass shows them, with the scroll position
+
+// Set up the controller for the panel, the GRAM is cleared
+//=================================================
+void emu_panel_init(const emu_panel_config_t *config);
+
+// Bytes clocked in while the controller is selected, 'dc' is the level of the DC pin
+//=====================================================================
+void emu_panel_write(uint8_t dc, const uint8_t *data, size_t len);
+
+// Bytes clocked out while the controller is selected,
+// the first 'skip_bits' bits the controller sends are not stored
+//=======================================================================
+void emu_panel_read(uint32_t skip_bits, uint8_t *dst, size_t len);
+
+// CS was released, a running read command is terminated
+//==========================
+void emu_panel_deselect();
+
+// Hardware reset
+//======================
+void emu_panel_reset();
+
+// Width and height of the logical view with the current MADCTL
+//===============================================
+void emu_panel_logical_size(int *width, int *height);
+
+// The controller is in partial mode (PTLON received, no NORON since)
+//=======================
+int emu_panel_partial();
+
+// Pointer to the 3 GRAM bytes of the pixel at (x,y) of the view, NULL if outside the GRAM
+//=============================================================
+uint8_t *emu_panel_pixel(int view, int x, int y);
+
+// Write the rectangle (x,y,w,h) of the view as the glass shows it to a binary PPM file
+// Returns 0 on success
+//=============================================================================
+int emu_panel_dump_ppm(const char *path, int view, int x, int y, int w, int h);
+
+// Clear the statistics
+//=============================
+void emu_panel_stats_reset();
+
+// Report a protocol error, it is counted and printed to stderr
+//==========================================
+void emu_panel_error(const char *fmt, ...);
+
+#endif
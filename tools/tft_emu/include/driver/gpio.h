@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#define GPIO_MODE_INPUT     1
+#define GPIO_MODE_OUTPUT    2
+#define GPIO_PULLUP_ONLY    0
+
+static inline void gpio_pad_select_gpio(int gpio_num) { (void)gpio_num; }
+static inline esp_err_t gpio_set_direction(int gpio_num, int mode) { (void)gpio_num; (void)mode; return ESP_OK; }
+static inline esp_err_t gpio_set_pull_mode(int gpio_num, int pull) { (void)gpio_num; (void)pull; return ESP_OK; }
+esp_err_t gpio_set_level(int gpio_num, uint32_t level);
+int gpio_get_level(int gpio_num);
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// Layout of the ESP32 DMA link descriptor, only used by the host tests of tft_dma_chain.h
+typedef struct lldesc_s {
+    volatile uint32_t size  :12,
+                      length:12,
+                      offset: 5,
+                      sosf  : 1,
+                      eof   : 1,
+                      owner : 1;
+    volatile uint8_t *buf;
+    union {
+        volatile uint32_t empty;
+        struct {
+            struct lldesc_s *stqe_next;
+        } qe;
+    };
+} lldesc_t;
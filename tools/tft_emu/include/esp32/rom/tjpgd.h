@@ -0,0 +1,22 @@
+/*
+ * HOST EMULATOR, JPEG decoding is not emulated, every image is rejected
+ */
+#pragma once
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef unsigned char BYTE;
+typedef enum { JDR_OK = 0, JDR_INTR, JDR_INP, JDR_MEM1, JDR_MEM2, JDR_PAR, JDR_FMT1, JDR_FMT2, JDR_FMT3 } JRESULT;
+typedef struct { uint16_t left, right, top, bottom; } JRECT;
+typedef struct JDEC JDEC;
+struct JDEC { UINT dctr; uint16_t width, height; void *device; UINT sz_pool; };
+
+static inline JRESULT jd_prepare(JDEC *jd, UINT (*infunc)(JDEC*, BYTE*, UINT), void *pool, UINT sz_pool, void *dev) {
+    (void)infunc; (void)pool; (void)sz_pool;
+    jd->device = dev;
+    return JDR_FMT3;
+}
+static inline JRESULT jd_decomp(JDEC *jd, UINT (*outfunc)(JDEC*, void*, JRECT*), BYTE scale) {
+    (void)jd; (void)outfunc; (void)scale;
+    return JDR_FMT3;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define DMA_ATTR WORD_ALIGNED_ATTR
+#define EXT_RAM_ATTR
+#define WORD_ALIGNED_ATTR __attribute__((aligned(4)))
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
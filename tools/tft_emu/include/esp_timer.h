@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// Time of the emulator's virtual clock in us, see emu_idf.c
+int64_t esp_timer_get_time(void);
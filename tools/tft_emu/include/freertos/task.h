@@ -0,0 +1,20 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// Block the task, the virtual clock advances
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+// Tasks are coroutines on the virtual clock (emu_idf.c), a task of higher priority runs at once
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+#define tskNO_AFFINITY 0x7FFFFFFF
+// There is one core, the core is ignored
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+    (void)core;
+    return xTaskCreate(task, name, stack, arg, priority, handle);
+}
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
@@ -0,0 +1,79 @@
+/*
+ * HOST EMULATOR, configuration
+ * Default values of the options in components/tft/Kconfig, every value can be set from CMake.
+ */
+#pragma once
+
+#ifndef CONFIG_TFT_PREDEFINED_DISPLAY_TYPE
+#define CONFIG_TFT_PREDEFINED_DISPLAY_TYPE 5
+#endif
+
+// used with CONFIG_TFT_PREDEFINED_DISPLAY_TYPE 0
+#ifndef CONFIG_TFT_DISPLAY_CONTROLLER_MODEL
+#define CONFIG_TFT_DISPLAY_CONTROLLER_MODEL 0
+#endif
+#ifndef CONFIG_TFT_DISPLAY_WIDTH
+#define CONFIG_TFT_DISPLAY_WIDTH 240
+#endif
+#ifndef CONFIG_TFT_DISPLAY_HEIGHT
+#define CONFIG_TFT_DISPLAY_HEIGHT 320
+#endif
+#ifndef CONFIG_TFT_TOUCH_CONTROLLER
+#define CONFIG_TFT_TOUCH_CONTROLLER 0
+#endif
+#ifndef CONFIG_TFT_INVERT_ROTATION1
+#define CONFIG_TFT_INVERT_ROTATION1 0
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_MOSI
+#define CONFIG_TFT_PIN_NUM_MOSI 23
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_MISO
+#define CONFIG_TFT_PIN_NUM_MISO 19
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_CLK
+#define CONFIG_TFT_PIN_NUM_CLK 18
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_CS
+#define CONFIG_TFT_PIN_NUM_CS 5
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_DC
+#define CONFIG_TFT_PIN_NUM_DC 26
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_TCS
+#define CONFIG_TFT_PIN_NUM_TCS 25
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_RST
+#define CONFIG_TFT_PIN_NUM_RST 0
+#endif
+#ifndef CONFIG_TFT_PIN_NUM_BCKL
+#define CONFIG_TFT_PIN_NUM_BCKL 0
+#endif
+
+#ifndef CONFIG_TFT_REPEAT_BUFFER_SIZE
+#define CONFIG_TFT_REPEAT_BUFFER_SIZE 500
+#endif
+#ifndef CONFIG_TFT_REPEAT_BUFFER_COUNT
+#define CONFIG_TFT_REPEAT_BUFFER_COUNT 3
+#endif
+#ifndef CONFIG_TFT_DC_DIRECT_REG
+#define CONFIG_TFT_DC_DIRECT_REG 1
+#endif
+#ifndef CONFIG_TFT_READ_DUMMY_BITS
+#define CONFIG_TFT_READ_DUMMY_BITS 8
+#endif
+#ifndef CONFIG_TFT_SHORT_RUN_BUFFER_SIZE
+#define CONFIG_TFT_SHORT_RUN_BUFFER_SIZE 64
+#endif
+#ifndef CONFIG_TFT_SPI_HOST
+#define CONFIG_TFT_SPI_HOST 1
+#endif
+#ifndef CONFIG_TFT_SPI_QUEUE_SIZE
+#define CONFIG_TFT_SPI_QUEUE_SIZE 8
+#endif
+
+// the recorder is enabled, tft_emu -t writes a trace of the test scene
+#ifndef CONFIG_TFT_SPI_TRACE
+#define CONFIG_TFT_SPI_TRACE 1
+#endif
+
+#define CONFIG_IDF_TARGET_ESP32 1
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// Cycles of a 240 MHz CPU, from the host clock
+static inline uint32_t esp_cpu_get_ccount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec) * 240 / 1000);
+}
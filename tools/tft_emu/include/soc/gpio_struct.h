@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Only the output signal selection of the GPIO matrix, written by gpio_matrix_out() and spi_bus_add_device()
+typedef struct {
+    struct {
+        uint32_t func_sel;
+    } func_out_sel_cfg[40];
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
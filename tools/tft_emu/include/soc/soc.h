@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+// Register writes go to the emulated peripherals, see emu_idf.c
+void emu_reg_write(uint32_t reg, uint32_t value);
+#define REG_WRITE(reg, value) emu_reg_write((reg), (value))
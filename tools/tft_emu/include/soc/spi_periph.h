@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    uint8_t spics_out[3];
+} spi_signal_conn_t;
+
+extern const spi_signal_conn_t spi_periph_signal[3];
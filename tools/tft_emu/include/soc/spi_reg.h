@@ -0,0 +1,4 @@
+#pragma once
+#define SPI_OUT_RST         (1<<3)
+#define SPI_AHBM_FIFO_RST   (1<<4)
+#define SPI_AHBM_RST        (1<<5)
@@ -0,0 +1,2 @@
+#pragma once
+#error "CONFIG_TFT_DMA_CHAIN_FILL programs the SPI peripheral directly and is not emulated"
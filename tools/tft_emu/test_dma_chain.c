@@ -0,0 +1,95 @@
+/*
+ *
+ * HOST TEST OF THE DMA DESCRIPTOR CHAIN BUILDER
+ *
+ * Checks tft_dma_chain_build() (components/tft/tft_dma_chain.h) without any hardware:
+ * the descriptors must send exactly 'len' bytes, all from the start of the buffer,
+ * linked in order with only the last one marked as end of frame.
+ *
+ * Run with ctest, or directly: tft_dma_chain_test
+ *
+*/
+
+#include <stdio.h>
+#include "tft_dma_chain.h"
+
+#define TEST_DESC 16
+
+static lldesc_t desc[TEST_DESC + 1];
+static uint8_t buf[TFT_DMA_DESC_MAX_LEN + 4];
+static int failed = 0;
+
+//-------------------------------------------------------------
+static void check(int ok, const char *name, const char *what) {
+    if (!ok) {
+        printf("FAIL %-24s %s\n", name, what);
+        failed++;
+    }
+}
+
+// Build a chain and check every descriptor, 'expect' is the expected number of descriptors, 0 for a refused chain
+//-------------------------------------------------------------------------------------------------
+static void test_chain(const char *name, int ndesc, uint32_t chunk, uint32_t len, int expect) {
+    int failed_before = failed;
+    lldesc_t guard;
+
+    // the descriptor behind the pool must stay untouched
+    memset(desc, 0xA5, sizeof(desc));
+    memset(&guard, 0xA5, sizeof(guard));
+    int n = tft_dma_chain_build(desc, ndesc, buf, chunk, len);
+
+    check(n == expect, name, "descriptor count");
+    check(memcmp(&desc[ndesc], &guard, sizeof(guard)) == 0, name, "descriptor behind the pool written");
+    if ((n != expect) || (n == 0)) {
+        printf("%s %-24s refused\n", (failed != failed_before) ? "FAIL" : "ok  ", name);
+        return;
+    }
+
+    uint32_t total = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t dlen = desc[i].length;
+        total += dlen;
+        check(desc[i].buf == buf, name, "buffer address");
+        check(desc[i].owner == 1, name, "owner is not the DMA");
+        check(desc[i].size == ((dlen + 3) & ~3u), name, "size is not the word aligned length");
+        check(desc[i].size <= TFT_DMA_DESC_MAX_LEN, name, "size above the descriptor limit");
+        check(desc[i].offset == 0 && desc[i].sosf == 0, name, "offset / sosf set");
+        if (i < n - 1) {
+            check(dlen == chunk, name, "short descriptor before the last");
+            check(desc[i].eof == 0, name, "eof before the last descriptor");
+            check(desc[i].qe.stqe_next == &desc[i+1], name, "broken link");
+        }
+        else {
+            check((dlen > 0) && (dlen <= chunk), name, "length of the last descriptor");
+            check(desc[i].eof == 1, name, "last descriptor without eof");
+            check(desc[i].qe.stqe_next == NULL, name, "last descriptor is linked");
+        }
+    }
+    check(total == len, name, "total length");
+    printf("%s %-24s %d descriptors, %u bytes\n", (failed != failed_before) ? "FAIL" : "ok  ", name, n, total);
+}
+
+//=============
+int main(void) {
+    // 'len' is a multiple of the chunk, every descriptor is full
+    test_chain("exact multiple", TEST_DESC, 192, 192 * 10, 10);
+    test_chain("single chunk", TEST_DESC, 192, 192, 1);
+    // the last descriptor sends the rest
+    test_chain("short tail", TEST_DESC, 192, (192 * 10) + 3, 11);
+    test_chain("tail not word aligned", TEST_DESC, 300, (300 * 2) + 150, 3);
+    test_chain("shorter than a chunk", TEST_DESC, 192, 6, 1);
+    // largest chunk one descriptor can send
+    test_chain("descriptor limit", TEST_DESC, TFT_DMA_DESC_MAX_LEN, TFT_DMA_DESC_MAX_LEN * TEST_DESC, TEST_DESC);
+    test_chain("descriptor limit + tail", TEST_DESC, TFT_DMA_DESC_MAX_LEN, (TFT_DMA_DESC_MAX_LEN * 3) + 6, 4);
+    // all descriptors of the pool used
+    test_chain("pool full", TEST_DESC, 192, 192 * TEST_DESC, TEST_DESC);
+    // refused chains
+    test_chain("pool overflow", TEST_DESC, 192, (192 * TEST_DESC) + 1, 0);
+    test_chain("oversized chunk", TEST_DESC, TFT_DMA_DESC_MAX_LEN + 3, TFT_DMA_DESC_MAX_LEN + 3, 0);
+    test_chain("zero length", TEST_DESC, 192, 0, 0);
+    test_chain("zero chunk", TEST_DESC, 0, 192, 0);
+    test_chain("empty pool", 0, 192, 192, 0);
+
+    printf("%s\n", (failed) ? "FAILED" : "PASSED");
+    return (failed) ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+/*
+ *
+ * DISPLAY TRANSACTION TRACE REPLAY
+ *
+ * Reads a trace written by TFT_trace_save() or the console output of TFT_trace_print()
+ * and replays it at a given spi clock. Reports wire time, transaction overhead,
+ * idle gaps of the bus and the cost of every display command.
+ *
+ * Usage: tft_trace [-c clock_hz] [-r read_clock_hz] [-p polling_ns] [-q queued_ns] [-l] trace
+ *   -c  write clock of the replay, default: the clock the trace was recorded with
+ *   -r  read clock of the replay, default: the recorded read clock
+ *   -p  driver overhead of a polling transaction in ns
+ *   -q  driver overhead of a queued transaction in ns
+ *   -l  list the transactions with their replay times
+ *
+ * Timing model
+ *   Every transaction occupies the bus for its driver overhead plus its bits at the spi clock,
+ *   it starts when it is sent by the CPU and the previous transaction has ended.
+ *   The CPU waits for the end of a polling transaction, and before a polling transaction
+ *   for all queued ones (the library flushes the queue first); it waits for the oldest
+ *   transaction when the queue is full. The CPU time between transactions is the recorded
+ *   time minus these waits, modelled at the recorded clock, and is kept for the replay.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "tft_trace.h"
+
+#define DEFAULT_POLLING_NS  8000
+#define DEFAULT_QUEUED_NS   12000
+
+// Bus idle gaps are counted in these classes, upper limits in us
+static const uint32_t gap_limits[] = {10, 100, 1000, 10000, 0xFFFFFFFF};
+#define GAP_CLASSES (sizeof(gap_limits) / sizeof(gap_limits[0]))
+
+typedef struct {
+    uint32_t clock;
+    uint32_t rd_clock;
+    uint32_t polling_ns;
+    uint32_t queued_ns;
+    uint8_t list;
+} options_t;
+
+// Modelled times of one transaction in ns
+typedef struct {
+    double submit;      // sent by the CPU
+    double start;       // first bit on the wire
+    double end;         // last bit on the wire
+} sched_t;
+
+typedef struct {
+    uint32_t count;             // commands sent
+    uint32_t transactions;      // transactions of the command, the command byte included
+    uint64_t bytes;             // parameter / pixel bytes
+    double wire_ns;
+    double overhead_ns;         // transaction overhead and bus idle time between its transactions
+} cmd_stats_t;
+
+static tft_trace_header_t hdr;
+static tft_trace_record_t *recs = NULL;
+static uint32_t *queued_idx = NULL;     // number of queued transactions before each transaction
+static uint32_t *queued_pos = NULL;     // record index of the k-th queued transaction
+
+//------------------------------------------
+static const char *cmd_name(uint8_t cmd) {
+    switch (cmd) {
+        case 0x01: return "SWRESET";
+        case 0x11: return "SLPOUT";
+        case 0x13: return "NORON";
+        case 0x20: return "INVOFF";
+        case 0x21: return "INVON";
+        case 0x26: return "GAMMASET";
+        case 0x28: return "DISPOFF";
+        case 0x29: return "DISPON";
+        case 0x2A: return "CASET";
+        case 0x2B: return "PASET";
+        case 0x2C: return "RAMWR";
+        case 0x2E: return "RAMRD";
+        case 0x33: return "VSCRDEF";
+        case 0x36: return "MADCTL";
+        case 0x37: return "VSCRSADD";
+        case 0x3A: return "COLMOD";
+        case 0x3C: return "RAMWRC";
+        case 0x3E: return "RAMRDC";
+        default: return NULL;
+    }
+}
+
+//---------------------------------------------
+static int hexval(int c) {
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    c = tolower(c);
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    return -1;
+}
+
+// Read a binary trace or the TFTTRACE lines of a console log, the last trace of a log is used
+//-------------------------------------------------------
+static uint8_t *load(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    size_t len = 0, cap = 0;
+    uint32_t magic = 0;
+
+    if (f == NULL) return NULL;
+    if ((fread(&magic, 4, 1, f) == 1) && (magic == TFT_TRACE_MAGIC)) {
+        fseek(f, 0, SEEK_END);
+        len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buf = malloc(len);
+        if ((buf) && (fread(buf, 1, len, f) != len)) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    else {
+        char line[1024];
+        rewind(f);
+        while (fgets(line, sizeof(line), f)) {
+            char *p = strstr(line, TFT_TRACE_LINE_TAG " ");
+            if (p == NULL) continue;
+            p += strlen(TFT_TRACE_LINE_TAG) + 1;
+            if (strncmp(p, "BEGIN", 5) == 0) {
+                len = 0;
+                continue;
+            }
+            if (strncmp(p, "END", 3) == 0) continue;
+            while ((hexval(p[0]) >= 0) && (hexval(p[1]) >= 0)) {
+                if (len == cap) {
+                    cap = (cap) ? cap * 2 : 4096;
+                    buf = realloc(buf, cap);
+                    if (buf == NULL) break;
+                }
+                buf[len++] = (hexval(p[0]) << 4) | hexval(p[1]);
+                p += 2;
+            }
+        }
+    }
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+// Bus time of the transaction at the given clocks without the overhead, in ns
+//-------------------------------------------------------------------------------------
+static double wire_ns(const tft_trace_record_t *rec, uint32_t clock, uint32_t rd_clock) {
+    double bits = 8.0 * TFT_TRACE_LEN(rec);
+
+    if (TFT_TRACE_FLAGS(rec) & TFT_TRACE_READ) return ((bits + 8 + hdr.read_dummy) * 1e9) / rd_clock;
+    return (bits * 1e9) / clock;
+}
+
+//-------------------------------------------------------------------------
+static double overhead_ns(const tft_trace_record_t *rec, const options_t *opt) {
+    if (TFT_TRACE_FLAGS(rec) & TFT_TRACE_QUEUED) return opt->queued_ns;
+    return opt->polling_ns;
+}
+
+// Index of the transaction the CPU waits for before it can send transaction 'i', -1 if none
+//------------------------------------
+static int32_t wait_for(uint32_t i) {
+    const tft_trace_record_t *prev, *rec = &recs[i];
+
+    if (i == 0) return -1;
+    prev = &recs[i - 1];
+    // a polling transaction is finished when it returns, all transactions are finished before one is started
+    if (!(TFT_TRACE_FLAGS(prev) & TFT_TRACE_QUEUED)) return i - 1;
+    if (!(TFT_TRACE_FLAGS(rec) & TFT_TRACE_QUEUED)) return i - 1;
+    // queue full, the oldest queued transaction must be finished
+    if ((hdr.queue_size > 0) && (queued_idx[i] >= hdr.queue_size)) return queued_pos[queued_idx[i] - hdr.queue_size];
+    return -1;
+}
+
+// Time the CPU can send transaction 'i' at, without its own CPU time
+//--------------------------------------------------------
+static double ready_time(const sched_t *s, uint32_t i) {
+    int32_t w = wait_for(i);
+    double ready = s[i - 1].submit;
+
+    if ((w >= 0) && (s[w].end > ready)) ready = s[w].end;
+    return ready;
+}
+
+// Schedule the transactions at the given clocks, 'cpu_ns[i]' is the CPU time between transaction i and i+1
+//---------------------------------------------------------------------------------------------------------------------
+static void schedule(sched_t *s, const double *cpu_ns, const options_t *opt, uint32_t clock, uint32_t rd_clock) {
+    double bus_free = 0;
+
+    for (uint32_t i = 0; i < hdr.count; i++) {
+        s[i].submit = (i == 0) ? 0 : ready_time(s, i) + cpu_ns[i - 1];
+        s[i].start = ((s[i].submit > bus_free) ? s[i].submit : bus_free) + overhead_ns(&recs[i], opt);
+        s[i].end = s[i].start + wire_ns(&recs[i], clock, rd_clock);
+        bus_free = s[i].end;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c clock_hz] [-r read_clock_hz] [-p polling_ns] [-q queued_ns] [-l] trace\n", prog);
+}
+
+//==============================
+int main(int argc, char **argv) {
+    options_t opt = {0};
+    const char *path = NULL;
+    size_t size;
+
+    opt.polling_ns = DEFAULT_POLLING_NS;
+    opt.queued_ns = DEFAULT_QUEUED_NS;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-c") == 0) && ((i + 1) < argc)) opt.clock = strtoul(argv[++i], NULL, 0);
+        else if ((strcmp(argv[i], "-r") == 0) && ((i + 1) < argc)) opt.rd_clock = strtoul(argv[++i], NULL, 0);
+        else if ((strcmp(argv[i], "-p") == 0) && ((i + 1) < argc)) opt.polling_ns = strtoul(argv[++i], NULL, 0);
+        else if ((strcmp(argv[i], "-q") == 0) && ((i + 1) < argc)) opt.queued_ns = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-l") == 0) opt.list = 1;
+        else if ((argv[i][0] != '-') && (path == NULL)) path = argv[i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint8_t *buf = load(path, &size);
+    if ((buf == NULL) || (size < sizeof(tft_trace_header_t))) {
+        fprintf(stderr, "%s: no trace found\n", path);
+        return 1;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if ((hdr.magic != TFT_TRACE_MAGIC) || (hdr.version != TFT_TRACE_VERSION) || (hdr.record_size != sizeof(tft_trace_record_t))) {
+        fprintf(stderr, "%s: unsupported trace format\n", path);
+        return 1;
+    }
+    if (size < sizeof(hdr) + ((size_t)hdr.count * sizeof(tft_trace_record_t))) {
+        fprintf(stderr, "%s: trace is truncated, %u records expected\n", path, hdr.count);
+        hdr.count = (size - sizeof(hdr)) / sizeof(tft_trace_record_t);
+    }
+    recs = (tft_trace_record_t *)(buf + sizeof(hdr));
+    if (hdr.count == 0) {
+        printf("%s: empty trace\n", path);
+        return 0;
+    }
+    if (opt.clock == 0) opt.clock = hdr.spi_clock;
+    if (opt.rd_clock == 0) opt.rd_clock = (hdr.rd_clock) ? hdr.rd_clock : 1000000;
+
+    uint32_t n = hdr.count;
+    sched_t *rec_s = calloc(n, sizeof(sched_t));
+    sched_t *s = calloc(n, sizeof(sched_t));
+    double *cpu_ns = calloc(n, sizeof(double));
+    queued_idx = calloc(n, sizeof(uint32_t));
+    queued_pos = calloc(n, sizeof(uint32_t));
+    uint32_t nqueued = 0, npolling = 0, nread = 0, ndirect = 0;
+    uint64_t bytes = 0;
+
+    // recorded times, the 32-bit us counter may wrap around
+    double *t = calloc(n, sizeof(double));
+    uint64_t t_hi = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t flags = TFT_TRACE_FLAGS(&recs[i]);
+        if ((i > 0) && (recs[i].time < recs[i - 1].time)) t_hi += 0x100000000ULL;
+        t[i] = (double)(t_hi + recs[i].time) * 1000.0;
+        queued_idx[i] = nqueued;
+        if (flags & TFT_TRACE_QUEUED) queued_pos[nqueued++] = i;
+        else npolling++;
+        if (flags & TFT_TRACE_READ) nread++;
+        if (flags & TFT_TRACE_DIRECT) ndirect++;
+        bytes += TFT_TRACE_LEN(&recs[i]);
+    }
+
+    // CPU time between the transactions: the recorded time minus the modelled waits at the recorded clock
+    for (uint32_t i = 0; i < n; i++) {
+        double bus_free = (i > 0) ? rec_s[i - 1].end : 0;
+        rec_s[i].submit = t[i] - t[0];
+        rec_s[i].start = ((rec_s[i].submit > bus_free) ? rec_s[i].submit : bus_free) + overhead_ns(&recs[i], &opt);
+        rec_s[i].end = rec_s[i].start + wire_ns(&recs[i], hdr.spi_clock, (hdr.rd_clock) ? hdr.rd_clock : opt.rd_clock);
+    }
+    for (uint32_t i = 0; (i + 1) < n; i++) {
+        cpu_ns[i] = rec_s[i + 1].submit - ready_time(rec_s, i + 1);
+        if (cpu_ns[i] < 0) cpu_ns[i] = 0;
+    }
+
+    schedule(s, cpu_ns, &opt, opt.clock, opt.rd_clock);
+
+    // ==== Totals and idle gaps ====
+    double wire = 0, overhead = 0, idle = 0;
+    double gap_time[GAP_CLASSES] = {0};
+    uint32_t gap_count[GAP_CLASSES] = {0};
+    for (uint32_t i = 0; i < n; i++) {
+        double prev_end = (i > 0) ? s[i - 1].end : 0;
+        double gap = s[i].start - overhead_ns(&recs[i], &opt) - prev_end;
+        wire += s[i].end - s[i].start;
+        overhead += overhead_ns(&recs[i], &opt);
+        if ((i > 0) && (gap > 0)) {
+            uint32_t k = 0;
+            while (((gap / 1000.0) >= gap_limits[k]) && (k < (GAP_CLASSES - 1))) k++;
+            gap_count[k]++;
+            gap_time[k] += gap;
+            idle += gap;
+        }
+    }
+    double total = s[n - 1].end;
+
+    // ==== Per command ====
+    cmd_stats_t cmds[256];
+    int cur = -1;
+    memset(cmds, 0, sizeof(cmds));
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t flags = TFT_TRACE_FLAGS(&recs[i]);
+        double w = s[i].end - s[i].start;
+        if ((flags & TFT_TRACE_READ) || (!(flags & TFT_TRACE_DC))) {
+            // a command byte starts a new command, reads send it in their command phase
+            cur = (flags & TFT_TRACE_INLINE) || (flags & TFT_TRACE_READ) ? (int)(recs[i].data & 0xFF) : -1;
+            if (cur < 0) continue;
+            cmds[cur].count++;
+            if (flags & TFT_TRACE_READ) cmds[cur].bytes += TFT_TRACE_LEN(&recs[i]);
+        }
+        else if (cur >= 0) {
+            cmds[cur].bytes += TFT_TRACE_LEN(&recs[i]);
+            // idle time inside the command
+            if (i > 0) {
+                double gap = s[i].start - overhead_ns(&recs[i], &opt) - s[i - 1].end;
+                if (gap > 0) cmds[cur].overhead_ns += gap;
+            }
+        }
+        else continue;
+        cmds[cur].transactions++;
+        cmds[cur].wire_ns += w;
+        cmds[cur].overhead_ns += overhead_ns(&recs[i], &opt);
+    }
+
+    if (opt.list) {
+        printf("     #   time us  replay us   bytes  flags   data\n");
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t flags = TFT_TRACE_FLAGS(&recs[i]);
+            const char *name = NULL;
+            if ((!(flags & TFT_TRACE_DC)) && ((flags & TFT_TRACE_INLINE) || (flags & TFT_TRACE_READ))) name = cmd_name(recs[i].data & 0xFF);
+            printf("%6u %9.1f %10.1f %7u  %c%c%c%c%c  %08x %s\n", i, (t[i] - t[0]) / 1000.0, s[i].start / 1000.0, TFT_TRACE_LEN(&recs[i]),
+                   (flags & TFT_TRACE_DC) ? 'D' : 'C', (flags & TFT_TRACE_QUEUED) ? 'Q' : 'P', (flags & TFT_TRACE_READ) ? 'R' : '-',
+                   (flags & TFT_TRACE_DIRECT) ? 'X' : '-', (flags & TFT_TRACE_INLINE) ? 'I' : '-', recs[i].data, (name) ? name : "");
+        }
+        printf("\n");
+    }
+
+    printf("trace %s: %u transactions (%u polling, %u queued, %u reads, %u direct), %llu bytes\n",
+           path, n, npolling, nqueued, nread, ndirect, (unsigned long long)bytes);
+    if (hdr.dropped) printf("  %u transactions were not recorded, the trace buffer was full\n", hdr.dropped);
+    printf("recorded at %u Hz (read %u Hz), queue size %u: %.1f us\n", hdr.spi_clock, hdr.rd_clock, hdr.queue_size, (rec_s[n - 1].end) / 1000.0);
+    printf("replay at %u Hz (read %u Hz), overhead %u ns polling, %u ns queued\n", opt.clock, opt.rd_clock, opt.polling_ns, opt.queued_ns);
+    printf("  total        %12.1f us\n", total / 1000.0);
+    printf("  wire time    %12.1f us  %5.1f %%\n", wire / 1000.0, (100.0 * wire) / total);
+    printf("  overhead     %12.1f us  %5.1f %%\n", overhead / 1000.0, (100.0 * overhead) / total);
+    printf("  idle         %12.1f us  %5.1f %%\n", idle / 1000.0, (100.0 * idle) / total);
+
+    printf("\nidle gaps        count        time us\n");
+    for (uint32_t k = 0; k < GAP_CLASSES; k++) {
+        char label[32];
+        if (k == (GAP_CLASSES - 1)) snprintf(label, sizeof(label), ">= %u us", gap_limits[k - 1]);
+        else snprintf(label, sizeof(label), "< %u us", gap_limits[k]);
+        printf("  %-12s %8u %14.1f\n", label, gap_count[k], gap_time[k] / 1000.0);
+    }
+
+    printf("\ncommand      count  transactions        bytes   wire us  overhead us  overhead/cmd us\n");
+    for (int c = 0; c < 256; c++) {
+        if (cmds[c].count == 0) continue;
+        const char *name = cmd_name(c);
+        char label[16];
+        if (name == NULL) {
+            snprintf(label, sizeof(label), "0x%02X", c);
+            name = label;
+        }
+        printf("  %-9s %6u %13u %12llu %9.1f %12.1f %16.2f\n", name, cmds[c].count, cmds[c].transactions,
+               (unsigned long long)cmds[c].bytes, cmds[c].wire_ns / 1000.0, cmds[c].overhead_ns / 1000.0,
+               cmds[c].overhead_ns / 1000.0 / cmds[c].count);
+    }
+    return 0;
+}